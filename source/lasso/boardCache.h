@@ -0,0 +1,342 @@
+//
+// boardCache.h
+// An in-process cache of zeroboards, so that jobs switching between several input sets (e.g. adduct sets or element sets) only write each
+// zeroboard once. Boards are kept while they fit within a memory budget, and the least recently used boards that no query is reading are
+// evicted to make room. A missing board is written without holding the cache lock, so queries on other boards carry on meanwhile.
+// Used alongside UnboundedSubsetSum.
+//
+
+#ifndef BOARDCACHE_H
+#define BOARDCACHE_H
+
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <boost/functional/hash.hpp>
+
+#include "unboundedSubsetSum.h"
+
+/**
+ * @brief A zeroboard held by the cache
+ *
+ * @param key The hash of the input set, zeroboard combination length and precision the board was written for
+ * @param input_set A copy of the processed input set the board was written for
+ * @param input_set_size The number of values in the input set
+ * @param search_space_comb_len The zeroboard combination length
+ * @param dp The order of magnitude of epsilon the board was written with
+ * @param zeroboard The zeroboard
+ * @param reachability The reachability table of the largest query on the board so far, kept for the queries that follow
+ * @param bytes The estimated memory used by the zeroboard, see zeroboard_bytes()
+ * @param ready Whether the board has been written; other queries wait for a board that is still being written
+ * @param users The number of queries reading the board; a board in use is never evicted
+ * @param last_used The cache clock when the board was last acquired or released, for least recently used eviction
+ */
+struct cached_board {
+  std::size_t key;
+  double* input_set;
+  int     input_set_size;
+  int     search_space_comb_len;
+  double  dp;
+  Board   zeroboard;
+  reachability_cache reachability;
+  size_t  bytes;
+  bool    ready;
+  int     users;
+  unsigned long last_used;
+};
+
+// The boards in a cache, by key; boards with equal keys are told apart by comparing their input sets
+typedef boost::unordered_multimap< std::size_t, cached_board* > BoardRegistry;
+
+/**
+ * @brief A cache of zeroboards with a memory budget
+ *
+ * @param budget The memory, in bytes, that the cached boards may use; boards in use are kept even if they go over the budget
+ * @param used The estimated memory used by the boards that have been written
+ * @param summarise Whether boards are summarised for multiplicity constrained and subset queries when they are written
+ * @param clock Counts acquires and releases, giving the order in which boards were used
+ * @param boards The cached boards
+ * @param lock Guards every field of the cache and the ready, users, last_used and reachability fields of its boards
+ * @param written Signalled whenever a board has been written
+ * @param hits Number of queries that found their board in the cache
+ * @param misses Number of queries that had to write their board
+ * @param evictions Number of boards evicted
+ */
+struct board_cache {
+  size_t  budget;
+  size_t  used;
+  bool    summarise;
+  unsigned long clock;
+  BoardRegistry boards;
+  std::mutex lock;
+  std::condition_variable written;
+  unsigned long hits;
+  unsigned long misses;
+  unsigned long evictions;
+};
+
+
+/**
+ * @brief Sets up an empty cache
+ *
+ * @param cache The cache to initialise
+ * @param budget The memory, in bytes, that the cached boards may use
+ * @param summarise Write multiplicity summaries and index masks for every board, so that any query can reject whole bins; costs memory and write time
+ */
+void init_board_cache(board_cache* cache, size_t budget, bool summarise) {
+  cache->budget    = budget;
+  cache->used      = 0;
+  cache->summarise = summarise;
+  cache->clock     = 0;
+  cache->hits      = 0;
+  cache->misses    = 0;
+  cache->evictions = 0;
+}
+
+/**
+ * @brief Calculates the cache key of a zeroboard
+ *
+ * @param input_set The processed input set
+ * @param n The number of values in the input set
+ * @param search_space_comb_len The zeroboard combination length
+ * @param dp The order of magnitude of epsilon
+ * @return std::size_t: the key
+ */
+std::size_t board_key(double* input_set, int n, int search_space_comb_len, double dp) {
+  std::size_t seed = 0;
+  boost::hash_combine(seed, n);
+  boost::hash_combine(seed, search_space_comb_len);
+  boost::hash_combine(seed, dp);
+  for (int i=0; i<n; ++i)
+    boost::hash_combine(seed, input_set[i]);
+  return seed;
+}
+
+/**
+ * @brief Frees a cached board and its zeroboard
+ *
+ * @param board The board
+ */
+void free_cached_board(cached_board* board) {
+  delete_zeroboard(&board->zeroboard);
+  free_reachability_cache(&board->reachability);
+  free(board->input_set);
+  delete board;
+}
+
+/**
+ * @brief Removes the least recently used boards that no query is reading until the cache is within its budget. Must be called holding the cache lock.
+ * The boards are only removed from the cache; the caller frees them once the lock is released, so that other queries are not held up.
+ *
+ * @param cache The cache
+ * @param evicted Set to the boards removed from the cache
+ */
+void evict_boards(board_cache* cache, std::vector<cached_board*>* evicted) {
+  while (cache->used > cache->budget) {
+    BoardRegistry::iterator oldest = cache->boards.end();
+    for (BoardRegistry::iterator entry=cache->boards.begin(); entry!=cache->boards.end(); ++entry)
+      if (entry->second->ready && entry->second->users == 0
+          && (oldest == cache->boards.end() || entry->second->last_used < oldest->second->last_used))
+        oldest = entry;
+    if (oldest == cache->boards.end())
+      return;
+    cache->used -= oldest->second->bytes;
+    ++cache->evictions;
+    evicted->push_back(oldest->second);
+    cache->boards.erase(oldest);
+  }
+}
+
+/**
+ * @brief Finds the zeroboard for an input set in the cache, writing it if it is missing. If another query is already writing the board, waits for it.
+ * The board must be given back with release_board() once the query is finished with it.
+ *
+ * @param cache The cache
+ * @param input_set The processed input set
+ * @param n The number of values in the input set
+ * @param search_space_comb_len The zeroboard combination length
+ * @param epsilon The amount by which query values can vary
+ * @param dp The order of magnitude of epsilon
+ * @param trace If not NULL, the trace that writing a missing board is recorded in
+ * @return cached_board*: the board, which is not evicted until it is released
+ */
+cached_board* acquire_board(
+  board_cache* cache,
+  double* input_set,
+  int n,
+  int search_space_comb_len,
+  double epsilon,
+  double dp,
+  query_trace* trace = NULL )
+{
+  std::size_t key = board_key(input_set, n, search_space_comb_len, dp);
+  std::unique_lock<std::mutex> guard(cache->lock);
+
+  while (true) {
+    cached_board* found = NULL;
+    std::pair<BoardRegistry::iterator, BoardRegistry::iterator> range = cache->boards.equal_range(key);
+    for (BoardRegistry::iterator entry=range.first; entry!=range.second; ++entry) {
+      cached_board* board = entry->second;
+      if (board->input_set_size == n && board->search_space_comb_len == search_space_comb_len && board->dp == dp
+          && memcmp(board->input_set, input_set, sizeof(double)*n) == 0) {
+        found = board;
+        break;
+      }
+    }
+    if (found == NULL)
+      break;
+    // Another query is writing this board, so wait for it rather than writing it twice
+    if (!found->ready) {
+      cache->written.wait(guard);
+      continue;
+    }
+    ++found->users;
+    found->last_used = ++cache->clock;
+    ++cache->hits;
+    return found;
+  }
+
+  // The board is missing: claim it, then write it without holding the lock
+  cached_board* board = new cached_board;
+  board->key                   = key;
+  board->input_set             = (double*)malloc(sizeof(double)*n);
+  memcpy(board->input_set, input_set, sizeof(double)*n);
+  board->input_set_size        = n;
+  board->search_space_comb_len = search_space_comb_len;
+  board->dp                    = dp;
+  init_reachability_cache(&board->reachability);
+  board->bytes                 = 0;
+  board->ready                 = false;
+  board->users                 = 1;
+  board->last_used             = ++cache->clock;
+  cache->boards.insert(BoardRegistry::value_type(key, board));
+  ++cache->misses;
+  bool summarise = cache->summarise;
+  guard.unlock();
+
+  trace_span build_span;
+  begin_trace_span(&build_span, trace, "build", "comb_len", search_space_comb_len);
+  writeZeroBoard(board->input_set, &board->zeroboard, n, search_space_comb_len, epsilon, dp);
+  if (summarise) {
+    summarise_multiplicities(&board->zeroboard, n);
+    summarise_index_masks(&board->zeroboard, n);
+  }
+  end_trace_span(&build_span);
+  board->bytes = zeroboard_bytes(&board->zeroboard, n);
+
+  std::vector<cached_board*> evicted;
+  guard.lock();
+  board->ready = true;
+  cache->used += board->bytes;
+  evict_boards(cache, &evicted);
+  cache->written.notify_all();
+  guard.unlock();
+  for (size_t i=0; i<evicted.size(); ++i)
+    free_cached_board(evicted[i]);
+  return board;
+}
+
+/**
+ * @brief Gives a board back to the cache once a query is finished with it. The board may then be evicted.
+ *
+ * @param cache The cache
+ * @param board The board, from acquire_board()
+ */
+void release_board(board_cache* cache, cached_board* board) {
+  std::vector<cached_board*> evicted;
+  {
+    std::lock_guard<std::mutex> guard(cache->lock);
+    --board->users;
+    board->last_used = ++cache->clock;
+    evict_boards(cache, &evicted);
+  }
+  for (size_t i=0; i<evicted.size(); ++i)
+    free_cached_board(evicted[i]);
+}
+
+/**
+ * @brief Prints the number of boards held, the memory they use, and how often queries found their board in the cache
+ *
+ * @param cache The cache
+ */
+void print_board_cache(board_cache* cache) {
+  std::lock_guard<std::mutex> guard(cache->lock);
+  printf("Board cache: %lu board(s), %zu of %zu bytes, %lu hit(s), %lu miss(es), %lu eviction(s)\n",
+         (unsigned long)cache->boards.size(), cache->used, cache->budget, cache->hits, cache->misses, cache->evictions);
+}
+
+/**
+ * @brief Frees every board in the cache. No query may be using the cache.
+ *
+ * @param cache The cache
+ */
+void free_board_cache(board_cache* cache) {
+  for (BoardRegistry::iterator entry=cache->boards.begin(); entry!=cache->boards.end(); ++entry)
+    free_cached_board(entry->second);
+  cache->boards.clear();
+  cache->used = 0;
+}
+
+/**
+ * @brief Runs the algorithm like unboundedSubsetSum(), but takes the zeroboard from a cache rather than writing and deleting it for every query.
+ * Queries on the same input set reuse its zeroboard for as long as it stays in the cache. Several threads can run queries through one cache at once.
+ *
+ * @param cache The cache
+ * @param input_set The input set: a pointer to the first item in an array of double type values
+ * @param input_set_size The number of items in the input set
+ * @param query_value The target value to which combinations must sum
+ * @param epsilon The value that the target value can vary by
+ * @param print_times Require printing of runtimes for finding the zeroboard and querying it
+ * @param print_comb Require printing of all commbinations summing to the target value
+ * @param print_details Require printing of details about the algorithm run
+ * @param options Optional query settings, as for unboundedSubsetSum(); hardware counter profiling is not supported
+ */
+void unboundedSubsetSumCached(
+  board_cache* cache,
+  double* input_set,
+  int input_set_size,
+  double query_value,
+  double epsilon,
+  int print_times,
+  int print_comb,
+  int print_details,
+  query_options* options = NULL )
+{
+  int     search_space_comb_len = 0,
+          search_space_min      = SEARCH_SPACE_MIN;
+  double  dp_precision          = 0.0;
+  process_inputs(input_set, input_set_size, query_value, epsilon, &dp_precision, &search_space_comb_len, search_space_min, SEARCH_SPACE_MAX, dp_precision, 0, print_details);
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  cached_board* board = acquire_board(cache, input_set, input_set_size, search_space_comb_len, epsilon, dp_precision, query_tracer(options));
+  // the board keeps the reachability table of its largest query so far, which later queries read as it is; a query it does not cover only
+  // rebuilds it while no other query holds the board, and otherwise builds a table of its own
+  reachability_cache        own_reachability;
+  const reachability_table* reachability_ptr = NULL;
+  init_reachability_cache(&own_reachability);
+  if (options != NULL && options->reachability_scale > 0) {
+    double tolerance = epsilon + 1.0/bin_scale(dp_precision);
+    {
+      std::lock_guard<std::mutex> guard(cache->lock);
+      if (board->users == 1 || reachability_cache_covers(&board->reachability, query_value, tolerance, options->reachability_scale))
+        reachability_ptr = cached_reachability_table(&board->reachability, board->input_set, input_set_size, query_value, tolerance, options->reachability_scale);
+    }
+    if (reachability_ptr == NULL)
+      reachability_ptr = cached_reachability_table(&own_reachability, input_set, input_set_size, query_value, tolerance, options->reachability_scale);
+  }
+  std::chrono::steady_clock::time_point found = std::chrono::steady_clock::now();
+
+  queryZeroBoard(input_set, input_set_size, &board->zeroboard, search_space_comb_len, search_space_min, dp_precision, query_value, epsilon, 0, print_details, print_comb, options, reachability_ptr);
+  std::chrono::steady_clock::time_point queried = std::chrono::steady_clock::now();
+
+  release_board(cache, board);
+  free_reachability_cache(&own_reachability);
+
+  if (print_times) {
+    printf("%f seconds to find or create zeroboard\n", std::chrono::duration<double>(found - start).count());
+    printf("%f seconds to query zeroboard\n\n", std::chrono::duration<double>(queried - found).count());
+  }
+}
+
+#endif /* BOARDCACHE_H */
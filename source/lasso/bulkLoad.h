@@ -0,0 +1,292 @@
+//
+// bulkLoad.h
+// Writes a whole zeroboard in one pass rather than one board_insert() at a time. Every (key, combination) pair is generated into a flat buffer,
+// the pairs are radix-sorted by key, and each run of equal bins, and of equal keys within a bin, becomes one bin list and one item, linked in
+// order. Each pair is handled a fixed number of times however the keys are distributed, whereas board_insert() walks the items of a bin for
+// every combination added to it, which is slow when a few bins hold most of the combinations.
+// Used by subsetSummer.
+//
+
+#ifndef BULKLOAD_H
+#define BULKLOAD_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <algorithm>
+
+#include "zeroboard.h"
+#include "combinationKernels.h"
+
+// The number of bits of the key sorted by each pass of the radix sort
+#define BULK_RADIX_BITS 16
+// Buffers with fewer combinations than this are sorted with std::stable_sort, as each radix pass visits every bucket however few pairs there are
+#define BULK_RADIX_MIN_COUNT 4096
+// The most bytes writeZeroBoard() lets the bulk loader hold; larger zeroboards are written one combination at a time even if bulk loading is on
+#define BULK_LOAD_MAX_BYTES ((double)(1UL << 30))
+
+/**
+ * @brief A combination waiting to be loaded, and the key it sorts by
+ *
+ * @param key The bits of the tare sum of the combination; tare sums are never negative, so the bits sort in the same order as the sums
+ * @param record The position of the combination in the record buffer, which holds the combinations in the order they were generated
+ */
+struct bulk_pair {
+  uint64_t key;
+  size_t   record;
+};
+
+/**
+ * @brief The combinations of a zeroboard, in the order they were generated
+ *
+ * @param record_len The number of uint16_t in each record: the combination length, then the indexes
+ * @param count The number of records
+ * @param records The records
+ * @param pairs The key and record of each combination, sorted by key once every combination has been generated
+ */
+struct bulk_buffer {
+  int      record_len;
+  size_t   count;
+  uint16_t* records;
+  bulk_pair* pairs;
+};
+
+
+/**
+ * @brief Counts the combinations, of every length from 1 to the zeroboard combination length, that the zeroboard holds
+ *
+ * @param n The number of values in the input set
+ * @param search_space_comb_len The zeroboard combination length
+ * @return double: the number of combinations, as a double so that the count for a zeroboard too large to write does not overflow
+ */
+double bulk_combination_count(int n, int search_space_comb_len) {
+  // there are (n+len-1) choose len combinations of length len with repetition
+  double total = 0.0,
+         count = 1.0;
+  for (int len=1; len<=search_space_comb_len; ++len) {
+    count  = count*(n+len-1)/len;
+    total += count;
+  }
+  return total;
+}
+
+/**
+ * @brief Bytes the bulk loader holds at once for a zeroboard: the record and pair of each combination, and the scratch pairs of the radix sort
+ *
+ * @param n The number of values in the input set
+ * @param search_space_comb_len The zeroboard combination length
+ * @return double: the number of bytes
+ */
+double bulk_load_bytes(int n, int search_space_comb_len) {
+  return bulk_combination_count(n, search_space_comb_len) * (2*sizeof(bulk_pair) + sizeof(uint16_t)*(search_space_comb_len+1));
+}
+
+/**
+ * @brief The enumerate_combinations() visitor of the bulk loader: every combination is generated into the buffer
+ */
+struct bulk_generator {
+  bulk_buffer* buffer;
+
+  int prefix(int /* len */, int /* pos */, double /* smallest */, double /* largest */) {
+    return COMBINATION_EXTEND;
+  }
+
+  void combination(double key, const uint16_t* combination, int len) {
+    uint16_t* record = buffer->records + buffer->count*buffer->record_len;
+    record[0] = (uint16_t)len;
+    memcpy(record+1, combination, sizeof(uint16_t)*len);
+    memcpy(&buffer->pairs[buffer->count].key, &key, sizeof(double));
+    buffer->pairs[buffer->count].record = buffer->count;
+    ++buffer->count;
+  }
+};
+
+/**
+ * @brief Sorts the pairs of a buffer by key with a least significant digit radix sort. Each pass is stable, so pairs with equal keys stay in the
+ * order they were generated. Passes over digits that every key shares are skipped, and small buffers are sorted with a stable comparison sort.
+ *
+ * @param buffer The buffer
+ */
+void radix_sort_bulk_pairs(bulk_buffer* buffer) {
+  if (buffer->count < BULK_RADIX_MIN_COUNT) {
+    std::stable_sort(buffer->pairs, buffer->pairs + buffer->count, [](const bulk_pair& a, const bulk_pair& b) { return a.key < b.key; });
+    return;
+  }
+  size_t     count   = buffer->count,
+             buckets = (size_t)1 << BULK_RADIX_BITS;
+  bulk_pair* from    = buffer->pairs;
+  bulk_pair* to      = (bulk_pair*)malloc(sizeof(bulk_pair)*count);
+  size_t*    offset  = (size_t*)malloc(sizeof(size_t)*buckets);
+  if ((to == NULL && count > 0) || offset == NULL) {
+    printf("Error: unable to allocate the radix sort of %zu combinations\n", count);
+    exit(EXIT_FAILURE);
+  }
+  for (int shift=0; shift<64; shift+=BULK_RADIX_BITS) {
+    memset(offset, 0, sizeof(size_t)*buckets);
+    for (size_t i=0; i<count; ++i)
+      ++offset[(from[i].key >> shift) & (buckets-1)];
+    if (count == 0 || offset[(from[0].key >> shift) & (buckets-1)] == count)
+      continue;
+    // turn the counts into the position of each digit's first pair
+    size_t position = 0;
+    for (size_t d=0; d<buckets; ++d) {
+      size_t digit_count = offset[d];
+      offset[d] = position;
+      position += digit_count;
+    }
+    for (size_t i=0; i<count; ++i)
+      to[offset[(from[i].key >> shift) & (buckets-1)]++] = from[i];
+    bulk_pair* swap = from;
+    from = to;
+    to   = swap;
+  }
+  // after an odd number of passes the sorted pairs are in the scratch array
+  if (from != buffer->pairs) {
+    memcpy(buffer->pairs, from, sizeof(bulk_pair)*count);
+    to = from;
+  }
+  free(to);
+  free(offset);
+}
+
+/**
+ * @brief Puts the pairs of each item back in the order they were generated. The radix sort keeps that order among equal keys, but keys that
+ * board_insert() does not tell apart (see precision_key()) can still differ in their last bits, and readers rely on the combinations of an item
+ * being in generation order. Only items whose keys differ are sorted.
+ *
+ * @param buffer The buffer, sorted by key
+ * @param dp The order of magnitude of epsilon
+ */
+void order_bulk_items(bulk_buffer* buffer, double dp) {
+  double scale = bin_scale(dp);
+  size_t first = 0;
+  while (first < buffer->count) {
+    double first_key;
+    memcpy(&first_key, &buffer->pairs[first].key, sizeof(double));
+    double    bin      = bin_value(first_key, scale);
+    long long item_key = precision_key(first_key);
+    bool      mixed    = false;
+    size_t    last     = first+1;
+    while (last < buffer->count) {
+      double key;
+      memcpy(&key, &buffer->pairs[last].key, sizeof(double));
+      if (bin_value(key, scale) != bin || precision_key(key) != item_key)
+        break;
+      mixed = mixed || buffer->pairs[last].key != buffer->pairs[first].key;
+      ++last;
+    }
+    if (mixed)
+      std::sort(buffer->pairs + first, buffer->pairs + last, [](const bulk_pair& a, const bulk_pair& b) { return a.record < b.record; });
+    first = last;
+  }
+}
+
+/**
+ * @brief Links the sorted pairs into the zeroboard in one pass. Each run of pairs in the same bin becomes a bin list, and each run of keys that
+ * board_insert() would tell apart becomes an item, with items in ascending order of key. Within an item, combinations are added to the head in
+ * the order they were generated, so every list is ordered as writeZeroBoard() orders it.
+ *
+ * @param buffer The buffer, sorted
+ * @param zeroboard The zeroboard to write into; it must be empty
+ * @param dp The order of magnitude of epsilon
+ */
+void link_bulk_pairs(bulk_buffer* buffer, Board* zeroboard, double dp) {
+  double scale = bin_scale(dp);
+  // count the bins first, so the hash-table is sized once
+  size_t bins = 0;
+  double previous_bin = 0.0;
+  for (size_t i=0; i<buffer->count; ++i) {
+    double key;
+    memcpy(&key, &buffer->pairs[i].key, sizeof(double));
+    double bin = bin_value(key, scale);
+    if (i == 0 || bin != previous_bin)
+      ++bins;
+    previous_bin = bin;
+  }
+  zeroboard->reserve(bins);
+
+  combination_set_list* list = NULL;
+  combination_set_item* item = NULL;
+  long long item_key = 0;
+  for (size_t i=0; i<buffer->count; ++i) {
+    double key;
+    memcpy(&key, &buffer->pairs[i].key, sizeof(double));
+    double bin = bin_value(key, scale);
+    if (list == NULL || bin != previous_bin) {
+      list = (combination_set_list*)malloc(sizeof(combination_set_list));
+      list->head        = NULL;
+      list->tail        = NULL;
+      list->summary     = NULL;
+      list->index_masks = NULL;
+      zeroboard->emplace(bin, list);
+      item = NULL;
+      previous_bin = bin;
+    }
+    if (item == NULL || precision_key(key) != item_key) {
+      item = (combination_set_item*)malloc(sizeof(combination_set_item));
+      item->key  = key;
+      item->head = NULL;
+      item->next = NULL;
+      item->prev = list->tail;
+      if (list->tail != NULL)
+        list->tail->next = item;
+      else
+        list->head = item;
+      list->tail = item;
+      item_key   = precision_key(key);
+    }
+    const uint16_t*  record  = buffer->records + buffer->pairs[i].record*buffer->record_len;
+    combination_set* new_set = new_combination_set(record+1, record[0]);
+    new_set->next = item->head;
+    item->head    = new_set;
+  }
+}
+
+/**
+ * @brief Writes every combination of every length from 1 to the zeroboard combination length into an empty zeroboard, by generating them into a
+ * flat buffer, radix-sorting them by key and linking each run of equal keys in one pass. The zeroboard holds the same combinations in the same
+ * bins, in the same order within each bin, as one written with board_insert(). The buffer holds about 16 + 2*(k+1) bytes per combination,
+ * twice over while sorting, until the zeroboard is linked.
+ *
+ * @param input_set The input set
+ * @param zeroboard The zeroboard to write into; it must be empty
+ * @param n The number of items in the input set
+ * @param search_space_comb_len The zeroboard combination length
+ * @param dp The order of magnitude of epsilon; used for creating and querying zeroboard bins
+ */
+void bulkWriteZeroBoard(
+  double* input_set,
+  Board* zeroboard,
+  int n,
+  int search_space_comb_len,
+  double dp )
+{
+  bulk_buffer buffer;
+  size_t capacity   = (size_t)bulk_combination_count(n, search_space_comb_len);
+  buffer.record_len = search_space_comb_len + 1;
+  buffer.count      = 0;
+  buffer.records    = (uint16_t*)malloc(sizeof(uint16_t)*buffer.record_len*capacity);
+  buffer.pairs      = (bulk_pair*)malloc(sizeof(bulk_pair)*capacity);
+  if (capacity > 0 && (buffer.records == NULL || buffer.pairs == NULL)) {
+    printf("Error: unable to allocate the bulk load of %zu combinations\n", capacity);
+    exit(EXIT_FAILURE);
+  }
+
+  double tare[n];
+  for (int i=0; i<n; ++i)
+    tare[i] = input_set[n-1] - input_set[i];
+  uint16_t       combination[search_space_comb_len];
+  bulk_generator generator = { &buffer };
+  // Generate the longest combinations first, as writeZeroBoard() does, so that combinations with equal keys are linked in the same order
+  for (int len=search_space_comb_len; len>=1; --len)
+    enumerate_combinations(tare, n, combination, len, 0, 0.0, generator);
+
+  radix_sort_bulk_pairs(&buffer);
+  order_bulk_items(&buffer, dp);
+  link_bulk_pairs(&buffer, zeroboard, dp);
+  free(buffer.records);
+  free(buffer.pairs);
+}
+
+#endif /* BULKLOAD_H */
@@ -0,0 +1,188 @@
+//
+// combinationKernels.h
+// Compile-time specialised kernels for writing and reading combinations of a fixed length.
+// The zeroboard combination length used in practice is between 3 and 7 and the zeroboard also holds every shorter length,
+// so each length from 1 to 7 gets its own kernel; longer lengths use the general loops. Also holds the one combination enumerator, and the one
+// tare sum, shared by the zeroboard writers that visit combinations of any length (bulk, partial and out-of-core), so that every writer gives a
+// combination the same key and writes combinations in the same order.
+// Used by subsetSummer, bulkLoad, partialBoard and externalBoard.
+//
+
+#ifndef COMBINATIONKERNELS_H
+#define COMBINATIONKERNELS_H
+
+#include <array>
+
+#include "zeroboard.h"
+
+// Largest combination length with specialised kernels; every length from 1 up to it has one
+#define KERNEL_MAX_LEN 7
+
+// What an enumerate_combinations() visitor does with the next value of a position: fill the position with it, skip it and try the next value,
+// or skip it and every later value
+#define COMBINATION_EXTEND 0
+#define COMBINATION_SKIP   1
+#define COMBINATION_STOP   2
+
+
+/**
+ * @brief Sums the values of a combination of fixed length K. K is a compile-time constant so the loop is fully unrolled.
+ *
+ * @tparam K The combination length
+ * @param input_set The input set
+ * @param combination The combination of input set indexes
+ * @return double: the sum of the combination's values
+ */
+template <int K>
+double combination_sum(const double* input_set, const uint16_t* combination) {
+  double sum = 0.0;
+  for (int i=0; i<K; ++i)
+    sum += input_set[combination[i]];
+  return sum;
+}
+
+// Pointer to a combination_sum kernel, chosen once per query by select_combination_sum()
+typedef double (*combination_sum_kernel)(const double*, const uint16_t*);
+
+/**
+ * @brief Chooses the combination_sum kernel for a combination length
+ *
+ * @param combination_len The combination length
+ * @return combination_sum_kernel: the kernel, or NULL if the length has no specialised kernel
+ */
+combination_sum_kernel select_combination_sum(int combination_len) {
+  switch (combination_len) {
+    case 1: return &combination_sum<1>;
+    case 2: return &combination_sum<2>;
+    case 3: return &combination_sum<3>;
+    case 4: return &combination_sum<4>;
+    case 5: return &combination_sum<5>;
+    case 6: return &combination_sum<6>;
+    case 7: return &combination_sum<7>;
+    default: return NULL;
+  }
+}
+
+
+/**
+ * @brief Sums the tare values of a combination, in the order every zeroboard writer sums them: the last two values first, then each earlier value
+ * from the back. Floating-point addition is not associative, so writers that summed in another order could put a combination in another bin.
+ *
+ * @param tare The tare value of each input set value
+ * @param combination The combination of input set indexes
+ * @param len The combination length
+ * @return double: the tare sum, the key of the combination in the zeroboard
+ */
+double combination_tare_sum(const double* tare, const uint16_t* combination, int len) {
+  if (len == 1)
+    return tare[combination[0]];
+  double sum = tare[combination[len-2]] + tare[combination[len-1]];
+  for (int j=len-3; j>=0; --j)
+    sum += tare[combination[j]];
+  return sum;
+}
+
+/**
+ * @brief Visits every combination of one length that extends a partial combination. Position 'pos' is filled with each index from the index at
+ * position pos-1 upwards, so combinations are visited in ascending order with the first index changing slowest, the order get_bin_combinations()
+ * relies on. Before a value fills a position, visitor.prefix(len, pos, smallest, largest) is given the smallest and largest tare sums of the
+ * combinations it would lead to, and returns COMBINATION_EXTEND, COMBINATION_SKIP or COMBINATION_STOP; tare values shrink as the index grows, so
+ * a visitor can stop once the largest sum falls below every sum it wants. Each complete combination is passed to
+ * visitor.combination(key, combination, len) with its key from combination_tare_sum().
+ *
+ * @tparam Visitor The type of the visitor
+ * @param tare The tare value of each input set value
+ * @param n The number of values in the input set
+ * @param combination The partial combination
+ * @param len The combination length
+ * @param pos The position being filled
+ * @param partial The tare sum of the positions before 'pos'
+ * @param visitor The visitor
+ */
+template <typename Visitor>
+void enumerate_combinations(const double* tare, int n, uint16_t* combination, int len, int pos, double partial, Visitor& visitor) {
+  for (int i=(pos == 0) ? 0 : combination[pos-1]; i<n; ++i) {
+    double smallest = partial + tare[i];
+    int    step     = visitor.prefix(len, pos, smallest, smallest + tare[i]*(len-pos-1));
+    if (step == COMBINATION_STOP)
+      break;
+    if (step == COMBINATION_SKIP)
+      continue;
+    combination[pos] = (uint16_t)i;
+    if (pos < len-1)
+      enumerate_combinations(tare, n, combination, len, pos+1, smallest, visitor);
+    else
+      visitor.combination(combination_tare_sum(tare, combination, len), combination, len);
+  }
+}
+
+
+/**
+ * @brief Writes every combination that extends a partial combination of fixed length K into the zeroboard.
+ * Position D is filled with each index from the index at position D-1 up to the input set maximum, so combinations are generated in ascending order
+ * with the first index changing slowest, which is the order get_bin_combinations() relies on.
+ *
+ * @tparam K The combination length
+ * @tparam D The position being filled
+ */
+template <int K, int D>
+struct combination_writer {
+  static void write(
+    const double* tare,
+    Board* zeroboard,
+    int n,
+    double dp,
+    std::array<uint16_t, K>& combination )
+  {
+    for (int i=(D == 0) ? 0 : combination[D-1]; i<n; ++i) {
+      combination[D] = (uint16_t)i;
+      combination_writer<K, D+1>::write(tare, zeroboard, n, dp, combination);
+    }
+  }
+};
+
+/**
+ * @brief The final step of combination_writer: the combination is complete, so sum it and insert it into the zeroboard.
+ * K is a compile-time constant, so combination_tare_sum() is unrolled to the sum for this length.
+ *
+ * @tparam K The combination length
+ */
+template <int K>
+struct combination_writer<K, K> {
+  static void write(
+    const double* tare,
+    Board* zeroboard,
+    int /* n */,
+    double dp,
+    std::array<uint16_t, K>& combination )
+  {
+    board_insert(zeroboard, combination_tare_sum(tare, combination.data(), K), dp, combination.data(), K);
+  }
+};
+
+/**
+ * @brief Writes all combinations of fixed length K into the zeroboard. Keys are tare sums, i.e. the sum of (input set max - value) over the combination.
+ *
+ * @tparam K The combination length
+ * @param input_set The input set
+ * @param zeroboard The zeroboard to write combinations and sums into
+ * @param n The number of items in the input set
+ * @param dp The order or magnitude of epsilon; used for creating and querying zeroboard bins
+ */
+template <int K>
+void writeZeroBoardKernel(
+  double* input_set,
+  Board* zeroboard,
+  int n,
+  double dp )
+{
+  // Tare value of each input set value, calculated once rather than for every combination
+  double tare[n];
+  for (int i=0; i<n; ++i)
+    tare[i] = input_set[n-1] - input_set[i];
+
+  std::array<uint16_t, K> combination;
+  combination_writer<K, 0>::write(tare, zeroboard, n, dp, combination);
+}
+
+#endif /* COMBINATIONKERNELS_H */
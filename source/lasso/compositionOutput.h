@@ -0,0 +1,208 @@
+//
+// compositionOutput.h
+// Printing of query results. A combination is printed either as the list of its values, or as its composition: the sparse vector of
+// (input set index, multiplicity) pairs, e.g. "0:2 3:1 7:4" rather than eight values. Combinations are stored and tracked with their indexes in
+// ascending order, so a composition is built in one pass, and the same composition always prints as the same line. Compositions can also be
+// grouped as they are found, so that one found by several queries is printed once with its count.
+// Used by zeroboard, subsetSummer, resultHeap, resultCache, queryCursor and fixedPoint.
+//
+
+#ifndef COMPOSITIONOUTPUT_H
+#define COMPOSITIONOUTPUT_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "queryOptions.h"
+
+/**
+ * @brief Checks whether query results are printed as compositions
+ *
+ * @param options The query options, may be NULL
+ * @return true if the options ask for composition output
+ */
+bool composition_output(query_options* options) {
+  return options != NULL && options->compositions;
+}
+
+/**
+ * @brief Prints a combination as its composition: the input set indexes it uses, in ascending order, each with the number of times it is used.
+ * The combination is a prefix of tracked indexes followed by a suffix stored in the zeroboard, and together they must be in ascending order.
+ *
+ * @param output The stream to print to
+ * @param prefix The prefix indexes, may be NULL if prefix_len is 0
+ * @param prefix_len The number of prefix indexes
+ * @param suffix The suffix indexes, may be NULL if suffix_len is 0
+ * @param suffix_len The number of suffix indexes
+ */
+void print_composition(FILE* output, const int* prefix, int prefix_len, const uint16_t* suffix, int suffix_len) {
+  int len   = prefix_len + suffix_len,
+      index = -1,
+      count = 0;
+  for (int i=0; i<len; ++i) {
+    int next = (i < prefix_len) ? prefix[i] : suffix[i-prefix_len];
+    if (next != index && count > 0) {
+      fprintf(output, "%d:%d ", index, count);
+      count = 0;
+    }
+    index = next;
+    ++count;
+  }
+  if (count > 0)
+    fprintf(output, "%d:%d ", index, count);
+  fprintf(output, "\n");
+}
+
+/**
+ * @brief Prints a combination, made of a prefix of tracked indexes followed by a suffix stored in the zeroboard, as its values or as its composition
+ *
+ * @param output The stream to print to
+ * @param input_set The input set that the indexes refer to
+ * @param prefix The prefix indexes, may be NULL if prefix_len is 0
+ * @param prefix_len The number of prefix indexes
+ * @param suffix The suffix indexes, may be NULL if suffix_len is 0
+ * @param suffix_len The number of suffix indexes
+ * @param compositions Print the composition rather than the values
+ */
+void print_combination(FILE* output, double* input_set, const int* prefix, int prefix_len, const uint16_t* suffix, int suffix_len, bool compositions) {
+  if (compositions) {
+    print_composition(output, prefix, prefix_len, suffix, suffix_len);
+    return;
+  }
+  for (int i=0; i<prefix_len; ++i)
+    fprintf(output, "%f ", input_set[prefix[i]]);
+  for (int i=0; i<suffix_len; ++i)
+    fprintf(output, "%f ", input_set[suffix[i]]);
+  fprintf(output, "\n");
+}
+
+/**
+ * @brief Prints a combination that uses a single input set value, as its values or as its composition
+ *
+ * @param output The stream to print to
+ * @param input_set The input set
+ * @param index The index of the value
+ * @param len The number of times the value is used
+ * @param compositions Print the composition rather than the values
+ */
+void print_uniform_combination(FILE* output, double* input_set, int index, int len, bool compositions) {
+  if (compositions) {
+    fprintf(output, "%d:%d \n", index, len);
+    return;
+  }
+  for (int i=0; i<len; ++i)
+    fprintf(output, "%f ", input_set[index]);
+  fprintf(output, "\n");
+}
+
+/**
+ * @brief Groups identical compositions as queries find them, so that a composition found by several queries, e.g. by neighbouring query values
+ * whose windows overlap, is printed once with the number of times it was found. Queries add to it while it is set in their options, from any
+ * number of threads, and the caller prints and empties it with flush_composition_aggregator(), e.g. after each query or after a batch of queries.
+ *
+ * @param counts The number of times each composition has been found, keyed by its index and multiplicity pairs
+ * @param lock Held while a composition is added or the aggregator is flushed
+ */
+struct composition_aggregator {
+  std::map<std::vector<int>, unsigned long> counts;
+  std::mutex lock;
+};
+
+/**
+ * @brief Adds a combination to an aggregator as its composition. The combination is a prefix of tracked indexes followed by a suffix stored in
+ * the zeroboard, and together they must be in ascending order.
+ *
+ * @param aggregator The aggregator
+ * @param prefix The prefix indexes, may be NULL if prefix_len is 0
+ * @param prefix_len The number of prefix indexes
+ * @param suffix The suffix indexes, may be NULL if suffix_len is 0
+ * @param suffix_len The number of suffix indexes
+ */
+void aggregate_composition(composition_aggregator* aggregator, const int* prefix, int prefix_len, const uint16_t* suffix, int suffix_len) {
+  std::vector<int> pairs;
+  for (int i=0; i<prefix_len+suffix_len; ++i) {
+    int index = (i < prefix_len) ? prefix[i] : suffix[i-prefix_len];
+    if (!pairs.empty() && pairs[pairs.size()-2] == index)
+      ++pairs.back();
+    else {
+      pairs.push_back(index);
+      pairs.push_back(1);
+    }
+  }
+  std::lock_guard<std::mutex> guard(aggregator->lock);
+  ++aggregator->counts[pairs];
+}
+
+/**
+ * @brief Prints every composition in an aggregator once, in ascending order of its pairs, as the number of times it was found followed by
+ * the composition as print_composition() prints it, e.g. "3\t0:4 2:1 ". The aggregator is emptied, ready for the next query or batch.
+ *
+ * @param aggregator The aggregator
+ * @param output The stream to print to
+ * @return unsigned long: the number of distinct compositions printed
+ */
+unsigned long flush_composition_aggregator(composition_aggregator* aggregator, FILE* output) {
+  std::lock_guard<std::mutex> guard(aggregator->lock);
+  unsigned long printed = aggregator->counts.size();
+  for (std::map<std::vector<int>, unsigned long>::const_iterator entry=aggregator->counts.begin(); entry!=aggregator->counts.end(); ++entry) {
+    fprintf(output, "%lu\t", entry->second);
+    for (size_t i=0; i<entry->first.size(); i+=2)
+      fprintf(output, "%d:%d ", entry->first[i], entry->first[i+1]);
+    fprintf(output, "\n");
+  }
+  aggregator->counts.clear();
+  return printed;
+}
+
+/**
+ * @brief Prints a combination found by a query, as print_combination() does with the options' output format, or adds it to the options'
+ * composition aggregator if there is one; and adds it to the options' list of printed combinations if there is one
+ *
+ * @param options The query options, may be NULL
+ * @param output The stream to print to
+ * @param input_set The input set that the indexes refer to
+ * @param prefix The prefix indexes, may be NULL if prefix_len is 0
+ * @param prefix_len The number of prefix indexes
+ * @param suffix The suffix indexes, may be NULL if suffix_len is 0
+ * @param suffix_len The number of suffix indexes
+ */
+void print_query_combination(query_options* options, FILE* output, double* input_set, const int* prefix, int prefix_len, const uint16_t* suffix, int suffix_len) {
+  if (options != NULL && options->aggregate != NULL)
+    aggregate_composition(options->aggregate, prefix, prefix_len, suffix, suffix_len);
+  else
+    print_combination(output, input_set, prefix, prefix_len, suffix, suffix_len, composition_output(options));
+  if (options == NULL || options->printed_combinations == NULL)
+    return;
+  std::vector<uint16_t>* printed = options->printed_combinations;
+  printed->push_back((uint16_t)(prefix_len + suffix_len));
+  for (int i=0; i<prefix_len; ++i)
+    printed->push_back((uint16_t)prefix[i]);
+  printed->insert(printed->end(), suffix, suffix + suffix_len);
+}
+
+/**
+ * @brief Prints a combination found by a query that uses a single input set value, as print_uniform_combination() does with the options' output
+ * format, or adds it to the options' composition aggregator if there is one; and adds it to the options' list of printed combinations if there is one
+ *
+ * @param options The query options, may be NULL
+ * @param output The stream to print to
+ * @param input_set The input set
+ * @param index The index of the value
+ * @param len The number of times the value is used
+ */
+void print_query_uniform_combination(query_options* options, FILE* output, double* input_set, int index, int len) {
+  if (options != NULL && options->aggregate != NULL) {
+    std::vector<uint16_t> combination(len, (uint16_t)index);
+    aggregate_composition(options->aggregate, NULL, 0, combination.data(), len);
+  } else
+    print_uniform_combination(output, input_set, index, len, composition_output(options));
+  if (options == NULL || options->printed_combinations == NULL)
+    return;
+  options->printed_combinations->push_back((uint16_t)len);
+  options->printed_combinations->insert(options->printed_combinations->end(), len, (uint16_t)index);
+}
+
+#endif /* COMPOSITIONOUTPUT_H */
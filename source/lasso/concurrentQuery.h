@@ -0,0 +1,345 @@
+//
+// concurrentQuery.h
+// Runs many queries against one shared zeroboard from a pool of threads. Queries only ever read the zeroboard (see get_stored_length_combinations()), so each
+// thread needs only its own copy of the query options and its own output; the zeroboard is written once and never copied.
+// Used alongside UnboundedSubsetSum.
+//
+
+#ifndef CONCURRENTQUERY_H
+#define CONCURRENTQUERY_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "unboundedSubsetSum.h"
+
+/**
+ * @brief The state shared by the threads of a concurrent query
+ *
+ * @param input_set The processed input set
+ * @param n The number of values in the input set
+ * @param zeroboard The zeroboard shared by every thread; it is only read
+ * @param search_space_comb_len The zeroboard combination length
+ * @param search_space_min The minimum combination length of the search space
+ * @param dp The order of magnitude of epsilon
+ * @param query_values The query values
+ * @param num_queries The number of query values
+ * @param epsilon The amount by which each query value can vary
+ * @param print_details Require printing of the number of combinations of each length for each query value
+ * @param print_comb Require printing of all combinations summing to each query value
+ * @param options Query options applied to every query; each thread queries through its own copy
+ * @param reachability The table of reachable sums, built once for the largest query value and read by every thread; NULL if the options ask for none
+ * @param next The next query value to hand out
+ * @param results The number of combinations found for each query value
+ * @param outputs The output of each query, captured in memory so that it can be printed in order; NULL entries if the output is discarded
+ * @param output_lens The length of each output
+ */
+struct concurrent_query {
+  double* input_set;
+  int     n;
+  const Board* zeroboard;
+  int     search_space_comb_len;
+  int     search_space_min;
+  double  dp;
+  const double* query_values;
+  int     num_queries;
+  double  epsilon;
+  int     print_details;
+  int     print_comb;
+  query_options* options;
+  const reachability_table* reachability;
+  std::atomic<int> next;
+  unsigned long* results;
+  char**  outputs;
+  size_t* output_lens;
+};
+
+
+/**
+ * @brief A thread of the pool. Takes query values one at a time until none are left, so that threads that draw cheap queries take more of them.
+ *
+ * @param state The shared state
+ */
+void concurrent_query_worker(concurrent_query* state) {
+  query_options options;
+  if (state->options != NULL)
+    options = *state->options;
+  else
+    init_query_options(&options, state->n);
+  query_status status;
+  options.status = &status;
+
+  for (int q = state->next.fetch_add(1); q < state->num_queries; q = state->next.fetch_add(1)) {
+    FILE* stream = (state->outputs != NULL) ? open_memstream(&state->outputs[q], &state->output_lens[q]) : fopen("/dev/null", "w");
+    if (stream == NULL) {
+      printf("Error: cannot capture the query output\n");
+      exit(EXIT_FAILURE);
+    }
+    options.output = stream;
+    queryZeroBoard(state->input_set, state->n, state->zeroboard, state->search_space_comb_len, state->search_space_min, state->dp,
+                   state->query_values[q], state->epsilon, 0, state->print_details, state->print_comb, &options, state->reachability);
+    fclose(stream);
+    state->results[q] = status.results;
+  }
+}
+
+/**
+ * @brief Queries a zeroboard for every query value from a pool of threads, all reading the same zeroboard
+ *
+ * @param input_set The processed input set
+ * @param n The number of values in the input set
+ * @param zeroboard The zeroboard, written with writeZeroBoard() for the largest query value
+ * @param search_space_comb_len The zeroboard combination length
+ * @param search_space_min The minimum combination length of the search space
+ * @param dp The order of magnitude of epsilon that the zeroboard was written with
+ * @param query_values The query values
+ * @param num_queries The number of query values
+ * @param epsilon The amount by which each query value can vary
+ * @param num_threads The number of threads
+ * @param print_details Require printing of the number of combinations of each length for each query value
+ * @param print_comb Require printing of all combinations summing to each query value
+ * @param options Query options applied to every query, may be NULL; ranked queries are not supported since the result heap would be shared
+ * @param results The number of combinations found for each query value
+ * @param output The stream the output of every query is printed to, in the order of the query values; NULL to discard it
+ */
+void queryZeroBoardConcurrent(
+  double* input_set,
+  int n,
+  const Board* zeroboard,
+  int search_space_comb_len,
+  int search_space_min,
+  double dp,
+  const double* query_values,
+  int num_queries,
+  double epsilon,
+  int num_threads,
+  int print_details,
+  int print_comb,
+  query_options* options,
+  unsigned long* results,
+  FILE* output )
+{
+  concurrent_query state;
+  state.input_set             = input_set;
+  state.n                     = n;
+  state.zeroboard             = zeroboard;
+  state.search_space_comb_len = search_space_comb_len;
+  state.search_space_min      = search_space_min;
+  state.dp                    = dp;
+  state.query_values          = query_values;
+  state.num_queries           = num_queries;
+  state.epsilon               = epsilon;
+  state.print_details         = print_details;
+  state.print_comb            = print_comb;
+  state.options               = options;
+  state.reachability          = NULL;
+  state.results               = results;
+  state.outputs               = NULL;
+  state.output_lens           = NULL;
+  state.next.store(0);
+  if (output != NULL) {
+    state.outputs     = (char**)calloc(num_queries, sizeof(char*));
+    state.output_lens = (size_t*)calloc(num_queries, sizeof(size_t));
+    if (state.outputs == NULL || state.output_lens == NULL) {
+      printf("Error: unable to allocate the output of %d queries\n", num_queries);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  // the reachability table built for the largest query value covers every other query, so it is built once and shared
+  reachability_cache reachability;
+  init_reachability_cache(&reachability);
+  if (options != NULL && num_queries > 0) {
+    double largest = query_values[0];
+    for (int q=1; q<num_queries; ++q)
+      if (query_values[q] > largest)
+        largest = query_values[q];
+    state.reachability = cached_reachability_table(&reachability, input_set, n, largest, epsilon + 1.0/bin_scale(dp), options->reachability_scale);
+  }
+
+  std::vector<std::thread> threads;
+  for (int i=1; i<num_threads; ++i)
+    threads.push_back(std::thread(concurrent_query_worker, &state));
+  // the calling thread is the first thread of the pool
+  concurrent_query_worker(&state);
+  for (size_t i=0; i<threads.size(); ++i)
+    threads[i].join();
+  free_reachability_cache(&reachability);
+
+  if (output != NULL) {
+    for (int q=0; q<num_queries; ++q) {
+      fprintf(output, "Query value: %f\n", query_values[q]);
+      fwrite(state.outputs[q], 1, state.output_lens[q], output);
+      free(state.outputs[q]);
+    }
+    fflush(output);
+    free(state.outputs);
+    free(state.output_lens);
+  }
+}
+
+/**
+ * @brief Checks the settings of a concurrent run and writes the zeroboard they share: process_inputs() is given the largest query value, so the
+ * zeroboard serves every query value
+ *
+ * @param input_set The input set; it is processed in place
+ * @param input_set_size The number of items in the input set
+ * @param zeroboard The zeroboard to write
+ * @param query_values The query values
+ * @param num_queries The number of query values
+ * @param epsilon The value that each query value can vary by
+ * @param num_threads The number of threads
+ * @param search_space_comb_len Set to the zeroboard combination length
+ * @param search_space_min The minimum combination length of the search space
+ * @param dp_precision Set to the order of magnitude of epsilon
+ * @param print_details Require printing of details about the algorithm run
+ * @param options The query options, may be NULL
+ */
+void write_concurrent_zeroboard(
+  double* input_set,
+  int input_set_size,
+  Board* zeroboard,
+  const double* query_values,
+  int num_queries,
+  double epsilon,
+  int num_threads,
+  int* search_space_comb_len,
+  int search_space_min,
+  double* dp_precision,
+  int print_details,
+  query_options* options )
+{
+  if (num_threads < 1) {
+    printf("\nERROR: A concurrent query needs at least one thread\n\tThreads: %d\n\n", num_threads);
+    exit(EXIT_FAILURE);
+  }
+  if (options != NULL && (options->ranked != NULL || options->fixed_point_scale > 0 || options->external != NULL)) {
+    printf("\nERROR: Ranked queries, the fixed-point engine and out-of-core zeroboards cannot be run concurrently\n\n");
+    exit(EXIT_FAILURE);
+  }
+  *search_space_comb_len = 0;
+  *dp_precision          = 0.0;
+  process_query_values(input_set, input_set_size, query_values, num_queries, epsilon, dp_precision, search_space_comb_len, search_space_min, SEARCH_SPACE_MAX, print_details);
+
+  trace_span build_span;
+  begin_trace_span(&build_span, query_tracer(options), "build", "comb_len", *search_space_comb_len);
+  writeZeroBoard(input_set, zeroboard, input_set_size, *search_space_comb_len, epsilon, *dp_precision, options);
+  if (has_multiplicity_bounds(options))
+    summarise_multiplicities(zeroboard, input_set_size);
+  if (has_index_mask(options))
+    summarise_index_masks(zeroboard, input_set_size);
+  end_trace_span(&build_span);
+}
+
+/**
+ * @brief Runs the algorithm for every query value from a pool of threads. One zeroboard is written for the largest query value and read by every
+ * thread, rather than each thread writing or copying its own. The output of each query is printed in the order of the query values.
+ *
+ * @param input_set The input set: a pointer to the first item in an array of double type values
+ * @param input_set_size The number of items in the input set
+ * @param query_values The target values to which combinations must sum
+ * @param num_queries The number of query values
+ * @param epsilon The value that each query value can vary by
+ * @param num_threads The number of threads
+ * @param print_times Require printing of the time taken to write the zeroboard and to run the queries
+ * @param print_comb Require printing of all combinations summing to each query value
+ * @param print_details Require printing of details about the algorithm run
+ * @param options Optional query settings applied to every query, as for unboundedSubsetSum(); ranked queries and the fixed-point engine are not supported
+ */
+void unboundedSubsetSumConcurrent(
+  double* input_set,
+  int input_set_size,
+  const double* query_values,
+  int num_queries,
+  double epsilon,
+  int num_threads,
+  int print_times,
+  int print_comb,
+  int print_details,
+  query_options* options = NULL )
+{
+  if (num_queries <= 0)
+    return;
+  int     search_space_comb_len,
+          search_space_min = SEARCH_SPACE_MIN;
+  double  dp_precision;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  Board zeroboard;
+  write_concurrent_zeroboard(input_set, input_set_size, &zeroboard, query_values, num_queries, epsilon, num_threads, &search_space_comb_len, search_space_min,
+                             &dp_precision, print_details, options);
+  std::chrono::steady_clock::time_point written = std::chrono::steady_clock::now();
+
+  unsigned long* results = (unsigned long*)malloc(sizeof(unsigned long)*num_queries);
+  queryZeroBoardConcurrent(input_set, input_set_size, &zeroboard, search_space_comb_len, search_space_min, dp_precision, query_values, num_queries, epsilon,
+                           num_threads, print_details, print_comb, options, results, query_output(options));
+  std::chrono::steady_clock::time_point queried = std::chrono::steady_clock::now();
+  free(results);
+  delete_zeroboard(&zeroboard);
+
+  if (print_times) {
+    double seconds = std::chrono::duration<double>(queried - written).count();
+    printf("%f seconds to create zeroboard\n", std::chrono::duration<double>(written - start).count());
+    printf("%f seconds to run %d queries on %d threads (%.1f queries per second)\n\n", seconds, num_queries, num_threads, num_queries/seconds);
+  }
+}
+
+/**
+ * @brief Measures how query throughput scales with the number of threads. One zeroboard is written, then every query value is run against it with
+ * 1, 2, 4, ... threads up to max_threads (and max_threads itself), discarding the query output. Prints the throughput and speedup of each run,
+ * and checks that every run found the same number of combinations for each query value as the single-threaded run.
+ *
+ * @param input_set The input set: a pointer to the first item in an array of double type values
+ * @param input_set_size The number of items in the input set
+ * @param query_values The target values to which combinations must sum
+ * @param num_queries The number of query values
+ * @param epsilon The value that each query value can vary by
+ * @param max_threads The largest number of threads to run with, e.g. std::thread::hardware_concurrency()
+ * @param options Optional query settings applied to every query, as for unboundedSubsetSumConcurrent()
+ */
+void benchmarkConcurrentQueries(
+  double* input_set,
+  int input_set_size,
+  const double* query_values,
+  int num_queries,
+  double epsilon,
+  int max_threads,
+  query_options* options = NULL )
+{
+  if (num_queries <= 0)
+    return;
+  int     search_space_comb_len,
+          search_space_min = SEARCH_SPACE_MIN;
+  double  dp_precision;
+  Board zeroboard;
+  write_concurrent_zeroboard(input_set, input_set_size, &zeroboard, query_values, num_queries, epsilon, max_threads, &search_space_comb_len, search_space_min,
+                             &dp_precision, 0, options);
+
+  unsigned long* expected = (unsigned long*)malloc(sizeof(unsigned long)*num_queries);
+  unsigned long* results  = (unsigned long*)malloc(sizeof(unsigned long)*num_queries);
+  double single = 0.0;
+  printf("%8s %12s %16s %8s\n", "threads", "seconds", "queries/second", "speedup");
+  for (int threads=1; threads<=max_threads; threads = (threads*2 > max_threads && threads < max_threads) ? max_threads : threads*2) {
+    unsigned long* found = (threads == 1) ? expected : results;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    queryZeroBoardConcurrent(input_set, input_set_size, &zeroboard, search_space_comb_len, search_space_min, dp_precision, query_values, num_queries, epsilon,
+                             threads, 0, 0, options, found, NULL);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (threads == 1)
+      single = seconds;
+    printf("%8d %12f %16.1f %8.2f\n", threads, seconds, num_queries/seconds, single/seconds);
+    for (int q=0; q<num_queries && threads > 1; ++q)
+      if (results[q] != expected[q]) {
+        printf("Error: %d threads found %lu combinations for query value %f, 1 thread found %lu\n", threads, results[q], query_values[q], expected[q]);
+        exit(EXIT_FAILURE);
+      }
+  }
+  free(expected);
+  free(results);
+  delete_zeroboard(&zeroboard);
+}
+
+#endif /* CONCURRENTQUERY_H */
@@ -0,0 +1,765 @@
+//
+// differentialTest.h
+// A brute-force reference engine, and a differential harness that checks the zeroboard engine and each of its accelerated modes against it.
+// The reference enumerates every non-decreasing multiset of input set indexes whose sum lies within epsilon of the query value, with no zeroboard
+// and no pruning beyond the running sum. The harness draws random input sets, query values and tolerances, runs every mode with its results
+// printed as compositions, and compares the number of combinations of each length, and the combinations themselves, with the reference and with
+// the standard engine. A mode fails a trial whenever its combinations differ from the reference's; the comparison with the standard engine is
+// reported alongside, to help place the cause.
+// Used by main.
+//
+
+#ifndef DIFFERENTIALTEST_H
+#define DIFFERENTIALTEST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <iterator>
+#include <set>
+#include <cmath>
+
+#include "unboundedSubsetSum.h"
+#include "externalBoard.h"
+#include "partialBoard.h"
+#include "concurrentQuery.h"
+#include "boardCache.h"
+#include "resultCache.h"
+#include "pipeline.h"
+
+// The most missing and unexpected combinations printed for each mismatch
+#define DIFFERENTIAL_MAX_LISTED 5
+// The number of results the ranked mode keeps; more than any trial finds, so that it should report every combination
+#define DIFFERENTIAL_RANKED_CAPACITY (1 << 16)
+// The draws the sampler mode makes per combination, beyond the ln(total) per combination a full collection takes on average
+#define DIFFERENTIAL_SAMPLE_MARGIN 20
+
+/**
+ * @brief Finds the longest combination the reference can report: every value is at least the smallest input set value
+ *
+ * @param input_set The input set, sorted in ascending order
+ * @param query_value The target value
+ * @param epsilon The value that the target value can vary by
+ * @return int: the longest combination length whose smallest sum is within the window
+ */
+int reference_max_length(const double* input_set, double query_value, double epsilon) {
+  return (int)((query_value + epsilon)/input_set[0]);
+}
+
+/**
+ * @brief Extends a partial combination by every index from start upwards, reporting each extension whose sum lies in the window.
+ * The input set is sorted in ascending order, so the first index that takes the sum past the window ends the loop.
+ *
+ * @param input_set The input set, sorted in ascending order
+ * @param n The number of values in the input set
+ * @param lo The smallest sum in the window
+ * @param hi The largest sum in the window
+ * @param combination The indexes of the partial combination
+ * @param len The length of the partial combination
+ * @param max_length The longest combination length to enumerate
+ * @param sum The sum of the partial combination
+ * @param start The smallest index the next value may have
+ * @param output The stream each combination is printed to as a composition, may be NULL
+ * @param length_counts The number of combinations found of each length, indexed by length
+ */
+void reference_combinations(
+  const double* input_set,
+  int n,
+  double lo,
+  double hi,
+  int* combination,
+  int len,
+  int max_length,
+  double sum,
+  int start,
+  FILE* output,
+  unsigned long* length_counts )
+{
+  for (int i=start; i<n; ++i) {
+    double next = sum + input_set[i];
+    if (next > hi)
+      break;
+    combination[len] = i;
+    if (next >= lo) {
+      if (output != NULL)
+        print_composition(output, combination, len+1, NULL, 0);
+      ++length_counts[len+1];
+    }
+    if (len+1 < max_length)
+      reference_combinations(input_set, n, lo, hi, combination, len+1, max_length, next, i, output, length_counts);
+  }
+}
+
+/**
+ * @brief The reference engine: enumerates every combination, with repetition, of input set values whose sum lies within epsilon of the query
+ * value, without a zeroboard. It is slow but simple enough to trust, so it is used to check the zeroboard engine and its accelerated modes.
+ *
+ * @param input_set The input set, sorted in ascending order with no duplicates or negative values, as process_inputs() leaves it
+ * @param n The number of values in the input set
+ * @param query_value The target value to which combinations must sum
+ * @param epsilon The value that the target value can vary by
+ * @param output The stream each combination is printed to as a composition (see compositionOutput.h); NULL to only count them
+ * @param length_counts If not NULL, the number of combinations of each length, indexed by length; it needs reference_max_length()+1 entries
+ * @return unsigned long: the number of combinations found
+ */
+unsigned long bruteForceSubsetSum(
+  const double* input_set,
+  int n,
+  double query_value,
+  double epsilon,
+  FILE* output,
+  unsigned long* length_counts )
+{
+  int max_length = reference_max_length(input_set, query_value, epsilon);
+  if (max_length < 1)
+    return 0;
+  std::vector<unsigned long> counts(max_length+1, 0);
+  std::vector<int> combination(max_length);
+  reference_combinations(input_set, n, query_value-epsilon, query_value+epsilon, combination.data(), 0, max_length, 0.0, 0, output, counts.data());
+  unsigned long total = 0;
+  for (int len=1; len<=max_length; ++len) {
+    total += counts[len];
+    if (length_counts != NULL)
+      length_counts[len] = counts[len];
+  }
+  return total;
+}
+
+/**
+ * @brief The combinations one engine printed, as sorted composition lines, and how many there are of each length
+ *
+ * @param combinations The composition lines, sorted
+ * @param length_counts The number of combinations of each length, indexed by length, with no trailing zeros
+ */
+struct differential_result {
+  std::vector<std::string>   combinations;
+  std::vector<unsigned long> length_counts;
+};
+
+/**
+ * @brief Checks whether two engines found the same combinations, each as many times
+ *
+ * @param a One result
+ * @param b The other result
+ * @return true if the results hold the same combinations
+ */
+bool same_differential_result(const differential_result* a, const differential_result* b) {
+  return a->combinations == b->combinations;
+}
+
+/**
+ * @brief Reads a composition, i.e. one or more "index:multiplicity " pairs. The ranked mode prints the error of each combination before it,
+ * as "error : composition", so anything up to " : " is skipped.
+ *
+ * @param line The line
+ * @param indexes If not NULL, set to the index of each pair
+ * @param multiplicities If not NULL, set to the multiplicity of each pair
+ * @return int: the combination length, the sum of the multiplicities, or 0 if the line is not a composition
+ */
+int parse_composition(const std::string& line, std::vector<int>* indexes, std::vector<int>* multiplicities) {
+  size_t error_end = line.find(" : ");
+  const char* pos  = line.c_str() + ((error_end == std::string::npos) ? 0 : error_end+3);
+  int length = 0;
+  if (indexes != NULL)
+    indexes->clear();
+  if (multiplicities != NULL)
+    multiplicities->clear();
+  while (*pos != '\0') {
+    int index, multiplicity, read;
+    if (sscanf(pos, "%d:%d%n", &index, &multiplicity, &read) != 2 || multiplicity < 1)
+      return 0;
+    length += multiplicity;
+    if (indexes != NULL)
+      indexes->push_back(index);
+    if (multiplicities != NULL)
+      multiplicities->push_back(multiplicity);
+    pos += read;
+    while (*pos == ' ')
+      ++pos;
+  }
+  return length;
+}
+
+/**
+ * @brief Adds a composition to a result, counting it under its length
+ *
+ * @param result The result
+ * @param composition The composition, with any ranked error removed
+ * @param length The combination length
+ */
+void add_differential_combination(differential_result* result, const std::string& composition, int length) {
+  if ((size_t)length >= result->length_counts.size())
+    result->length_counts.resize(length+1, 0);
+  ++result->length_counts[length];
+  result->combinations.push_back(composition);
+}
+
+/**
+ * @brief Reads the combinations from the output of an engine. Only lines made entirely of index:multiplicity pairs, with or without a ranked
+ * error before them, are compositions; other lines, e.g. the query value headers of concurrent and batched queries, are skipped.
+ *
+ * @param text The output
+ * @param text_len The length of the output
+ * @param result The result to fill
+ */
+void collect_compositions(const char* text, size_t text_len, differential_result* result) {
+  result->combinations.clear();
+  result->length_counts.assign(1, 0);
+  size_t begin = 0;
+  while (begin < text_len) {
+    size_t end = begin;
+    while (end < text_len && text[end] != '\n')
+      ++end;
+    std::string line(text+begin, end-begin);
+    begin = end+1;
+    int length = parse_composition(line, NULL, NULL);
+    if (length == 0)
+      continue;
+    size_t error_end = line.find(" : ");
+    add_differential_combination(result, (error_end == std::string::npos) ? line : line.substr(error_end+3), length);
+  }
+  std::sort(result->combinations.begin(), result->combinations.end());
+}
+
+/**
+ * @brief Decides whether a constrained mode may report a combination, so that the reference and standard engine results can be narrowed to what
+ * the mode should find
+ *
+ * @param indexes The input set indexes of the combination
+ * @param multiplicities The multiplicity of each index
+ * @return true if the constrained mode may report the combination
+ */
+typedef bool (*differential_filter)(const std::vector<int>& indexes, const std::vector<int>& multiplicities);
+
+/**
+ * @brief Narrows a result to the combinations a constrained mode may report
+ *
+ * @param all The result
+ * @param keep The constraint of the mode; NULL to keep every combination
+ * @param kept The result to fill, sorted as the full result is
+ */
+void filter_differential_result(const differential_result* all, differential_filter keep, differential_result* kept) {
+  if (keep == NULL) {
+    *kept = *all;
+    return;
+  }
+  kept->combinations.clear();
+  kept->length_counts.assign(1, 0);
+  std::vector<int> indexes, multiplicities;
+  for (size_t i=0; i<all->combinations.size(); ++i) {
+    int length = parse_composition(all->combinations[i], &indexes, &multiplicities);
+    if (keep(indexes, multiplicities))
+      add_differential_combination(kept, all->combinations[i], length);
+  }
+}
+
+/**
+ * @brief One randomly drawn query, and the caches that the cached modes keep between their warm-up run and their timed run
+ *
+ * @param input_set The input set, sorted in ascending order with no duplicates
+ * @param n The number of values in the input set
+ * @param query_value The target value
+ * @param epsilon The value that the target value can vary by
+ * @param sample_seed The seed of the sampler mode's random number generator
+ * @param directory The directory out-of-core zeroboards and peak lists are written to
+ * @param boards The board cache of the trial
+ * @param results The result cache of the trial
+ */
+struct differential_trial {
+  std::vector<double> input_set;
+  int    n;
+  double query_value;
+  double epsilon;
+  unsigned long long sample_seed;
+  const char*  directory;
+  board_cache  boards;
+  result_cache results;
+};
+
+/**
+ * @brief Runs one mode of the engine on a trial
+ *
+ * @param trial The trial
+ * @param input_set A copy of the trial's input set, which the mode may modify
+ * @param options Query options with the output stream set and results printed as compositions; the mode adds its own settings
+ */
+typedef void (*differential_runner)(differential_trial* trial, double* input_set, query_options* options);
+
+/**
+ * @brief A mode of the engine checked by the harness
+ *
+ * @param name The name the mode is reported by
+ * @param run Runs the mode
+ * @param warm Run the mode once, untimed, before the run that is checked and timed, so that its caches are filled
+ * @param keep The constraint the mode applies, against which the reference and standard engine results are narrowed; NULL for unconstrained modes
+ */
+struct differential_mode {
+  const char* name;
+  differential_runner run;
+  bool warm;
+  differential_filter keep;
+};
+
+/**
+ * @brief The standard engine, as run by unboundedSubsetSum(); see differential_runner
+ */
+void run_zeroboard(differential_trial* trial, double* input_set, query_options* options) {
+  unboundedSubsetSum(input_set, trial->n, trial->query_value, trial->epsilon, 0, 1, 0, 0, options);
+}
+
+/**
+ * @brief The standard engine on a bulk loaded zeroboard (see bulkLoad.h); see differential_runner
+ */
+void run_bulk_load(differential_trial* trial, double* input_set, query_options* options) {
+  options->bulk_load = true;
+  run_zeroboard(trial, input_set, options);
+}
+
+/**
+ * @brief Zeroboard lookups resolved in batches (see probeBatch.h); see differential_runner
+ */
+void run_batched_probes(differential_trial* trial, double* input_set, query_options* options) {
+  options->probe_batch_size = 64;
+  run_zeroboard(trial, input_set, options);
+}
+
+/**
+ * @brief Zeroboard lookups resolved in batches, in hash-table bucket order; see differential_runner
+ */
+void run_sorted_probes(differential_trial* trial, double* input_set, query_options* options) {
+  options->probe_batch_size = 64;
+  options->sort_probes      = true;
+  run_zeroboard(trial, input_set, options);
+}
+
+/**
+ * @brief The search pruned with a table of reachable sums (see reachability.h); see differential_runner
+ */
+void run_reachability(differential_trial* trial, double* input_set, query_options* options) {
+  options->reachability_scale = 100.0;
+  run_zeroboard(trial, input_set, options);
+}
+
+/**
+ * @brief Every combination length searched in one traversal (see queryZeroBoardIncremental()); see differential_runner
+ */
+void run_length_incremental(differential_trial* trial, double* input_set, query_options* options) {
+  options->length_incremental = true;
+  run_zeroboard(trial, input_set, options);
+}
+
+/**
+ * @brief The fixed-point engine (see fixedPoint.h), at a scale that holds every value exactly; see differential_runner
+ */
+void run_fixed_point(differential_trial* trial, double* input_set, query_options* options) {
+  options->fixed_point_scale = 1e4;
+  run_zeroboard(trial, input_set, options);
+}
+
+/**
+ * @brief The results pulled a page at a time from a cursor (see queryCursor.h); see differential_runner
+ */
+void run_cursor(differential_trial* trial, double* input_set, query_options* options) {
+  query_cursor cursor;
+  Board zeroboard;
+  openQueryCursor(&cursor, &zeroboard, input_set, trial->n, trial->query_value, trial->epsilon, options);
+  while (cursor_print_page(&cursor, 7, options->output) == 7)
+    ;
+  closeQueryCursor(&cursor, &zeroboard);
+}
+
+/**
+ * @brief The results pulled a page at a time, each page from a new cursor resumed from the token saved by the one before (see cursor_resume());
+ * see differential_runner
+ */
+void run_cursor_resume(differential_trial* trial, double* input_set, query_options* options) {
+  query_cursor cursor;
+  Board zeroboard;
+  char  token[512];
+  openQueryCursor(&cursor, &zeroboard, input_set, trial->n, trial->query_value, trial->epsilon, options);
+  while (cursor_print_page(&cursor, 7, options->output) == 7) {
+    if (cursor_save_token(&cursor, token, sizeof(token)) >= (int)sizeof(token)) {
+      printf("Error: the cursor resume token does not fit in %zu bytes\n", sizeof(token));
+      exit(EXIT_FAILURE);
+    }
+    query_cursor resumed;
+    // the zeroboard's bin scale is also the dp it was written with (see bin_scale())
+    init_query_cursor(&resumed, cursor.input_set, cursor.n, cursor.zeroboard, cursor.search_space_comb_len, cursor.scale, cursor.query_val,
+                      cursor.epsilon, cursor.combination_length, cursor.options);
+    if (!cursor_resume(&resumed, token)) {
+      fprintf(options->output, "cursor could not resume from: %s\n", token);
+      free_query_cursor(&resumed);
+      break;
+    }
+    free_query_cursor(&cursor);
+    cursor = resumed;
+  }
+  closeQueryCursor(&cursor, &zeroboard);
+}
+
+/**
+ * @brief The zeroboard written to disk (see externalBoard.h), from a small buffer so that it is merged from several runs; see differential_runner
+ */
+void run_out_of_core(differential_trial* trial, double* input_set, query_options* options) {
+  unboundedSubsetSumExternal(input_set, trial->n, trial->query_value, trial->epsilon, 0, trial->directory, 64 << 10, 0, 1, 0, options);
+}
+
+/**
+ * @brief A partial zeroboard written for the query value (see partialBoard.h); see differential_runner
+ */
+void run_partial(differential_trial* trial, double* input_set, query_options* options) {
+  unboundedSubsetSumBatch(input_set, trial->n, &trial->query_value, 1, trial->epsilon, 0, 1, 0, options);
+}
+
+/**
+ * @brief The query run from a pool of two threads (see concurrentQuery.h); see differential_runner
+ */
+void run_concurrent(differential_trial* trial, double* input_set, query_options* options) {
+  unboundedSubsetSumConcurrent(input_set, trial->n, &trial->query_value, 1, trial->epsilon, 2, 0, 1, 0, options);
+}
+
+/**
+ * @brief The zeroboard taken from a board cache (see boardCache.h); see differential_runner
+ */
+void run_board_cache(differential_trial* trial, double* input_set, query_options* options) {
+  unboundedSubsetSumCached(&trial->boards, input_set, trial->n, trial->query_value, trial->epsilon, 0, 1, 0, options);
+}
+
+/**
+ * @brief The result taken from a result cache (see resultCache.h); see differential_runner
+ */
+void run_result_cache(differential_trial* trial, double* input_set, query_options* options) {
+  options->memo = &trial->results;
+  run_zeroboard(trial, input_set, options);
+}
+
+/**
+ * @brief A ranked query (see resultHeap.h) whose heap holds more results than any trial finds, so it keeps every combination; see differential_runner
+ */
+void run_ranked(differential_trial* trial, double* input_set, query_options* options) {
+  result_heap heap;
+  init_result_heap(&heap, DIFFERENTIAL_RANKED_CAPACITY);
+  options->ranked = &heap;
+  run_zeroboard(trial, input_set, options);
+  free_result_heap(&heap);
+}
+
+/**
+ * @brief The constraint of the multiplicity-bounded mode: even indexes at most twice, odd indexes any number of times; see differential_filter
+ */
+bool keep_multiplicity_bounded(const std::vector<int>& indexes, const std::vector<int>& multiplicities) {
+  for (size_t i=0; i<indexes.size(); ++i)
+    if (indexes[i] % 2 == 0 && multiplicities[i] > 2)
+      return false;
+  return true;
+}
+
+/**
+ * @brief A query with per-index maximum multiplicities (see multiplicityBounds.h), as in keep_multiplicity_bounded(); see differential_runner
+ */
+void run_multiplicity_bounded(differential_trial* trial, double* input_set, query_options* options) {
+  std::vector<int> max_multiplicity(trial->n);
+  for (int i=0; i<trial->n; ++i)
+    max_multiplicity[i] = (i % 2 == 0) ? 2 : -1;
+  options->max_multiplicity = max_multiplicity.data();
+  run_zeroboard(trial, input_set, options);
+}
+
+/**
+ * @brief The constraint of the index-mask mode: every index except those one more than a multiple of three; see differential_filter
+ */
+bool keep_index_mask(const std::vector<int>& indexes, const std::vector<int>& /* multiplicities */) {
+  for (size_t i=0; i<indexes.size(); ++i)
+    if (indexes[i] % 3 == 1)
+      return false;
+  return true;
+}
+
+/**
+ * @brief A query restricted to a subset of the input set by an index mask (see indexMask.h), as in keep_index_mask(); see differential_runner
+ */
+void run_index_mask(differential_trial* trial, double* input_set, query_options* options) {
+  uint64_t* allowed = new_index_mask(trial->n);
+  for (int i=0; i<trial->n; ++i)
+    if (i % 3 != 1)
+      set_mask_index(allowed, i);
+  options->allowed = allowed;
+  run_zeroboard(trial, input_set, options);
+  free(allowed);
+}
+
+/**
+ * @brief The uniform sampler (see sampler.h), seeded from the trial, drawing until it has drawn as many distinct combinations as it counted, and
+ * printing each distinct combination once. A draw misses a given combination with probability 1 - 1/total, so after total*(ln(total) +
+ * DIFFERENTIAL_SAMPLE_MARGIN) draws a combination the sampler can draw is missing with probability below e^-DIFFERENTIAL_SAMPLE_MARGIN. A combination
+ * the sampler counts but cannot draw, or draws but should not, shows as missing or unexpected. See differential_runner.
+ */
+void run_sampler(differential_trial* trial, double* input_set, query_options* options) {
+  combination_sampler sampler;
+  init_combination_sampler(&sampler, input_set, trial->n, trial->query_value, trial->epsilon, 1e4, 0, trial->sample_seed);
+  std::set< std::vector<int> > drawn;
+  std::vector<int> combination(sampler.max_len+1);
+  double draws = (sampler.total > 0) ? sampler.total*(log(sampler.total) + DIFFERENTIAL_SAMPLE_MARGIN) : 0;
+  for (double d=0; d<draws && (double)drawn.size() < sampler.total; ++d) {
+    int len = sample_combination(&sampler, combination.data());
+    drawn.insert(std::vector<int>(combination.begin(), combination.begin()+len));
+  }
+  for (std::set< std::vector<int> >::iterator it=drawn.begin(); it!=drawn.end(); ++it)
+    print_composition(options->output, it->data(), (int)it->size(), NULL, 0);
+  free_combination_sampler(&sampler);
+}
+
+/**
+ * @brief The pipeline (see pipeline.h), with two query workers, over a peak list holding the query value as its one spectrum. The pipeline sizes its
+ * zeroboard for the largest input set value, so it is given the combination length the standard engine picks for the query value, and queries the
+ * same keys; see differential_runner
+ */
+void run_pipeline(differential_trial* trial, double* input_set, query_options* options) {
+  std::vector<double> processed = trial->input_set;
+  int    search_space_comb_len  = 0;
+  double dp_precision           = 0.0;
+  process_inputs(processed.data(), trial->n, trial->query_value, trial->epsilon, &dp_precision, &search_space_comb_len, SEARCH_SPACE_MIN, SEARCH_SPACE_MAX, dp_precision, 0, 0);
+  std::string path = std::string(trial->directory) + "/lasso_peaks_XXXXXX";
+  int   fd    = mkstemp(&path[0]);
+  FILE* peaks = (fd < 0) ? NULL : fdopen(fd, "w");
+  if (peaks == NULL) {
+    printf("Error: unable to create a peak list in %s\n", trial->directory);
+    exit(EXIT_FAILURE);
+  }
+  fprintf(peaks, "%.17g\n", trial->query_value);
+  fclose(peaks);
+  unboundedSubsetSumPipeline(input_set, trial->n, path.c_str(), options->output, trial->epsilon, search_space_comb_len, 2, 2, 0, 1, 0, options);
+  unlink(path.c_str());
+}
+
+/**
+ * @brief Draws a random trial. Half the input sets are integers and half have two decimal places. Each query value is the sum of a few input set
+ * values, sometimes moved one step off it, so most queries have results. Epsilon is 0 for integers, or otherwise an odd number of half steps,
+ * so that no sum lies on the edge of the window: whether a sum on the edge is reported depends on rounding, and the reference and the double
+ * engine may round it differently (see fixedPoint.h).
+ *
+ * @param trial The trial to fill
+ * @param rng The random number generator
+ */
+void draw_differential_trial(differential_trial* trial, std::mt19937_64* rng) {
+  bool   decimal = (*rng)() % 2;
+  // values and sums are drawn in whole steps, so that the query value lies exactly on the grid of sums
+  long   step    = decimal ? 100 : 1;
+  int    n       = 3 + (*rng)() % 10;
+  std::vector<long> steps;
+  for (int i=0; i<n; ++i)
+    steps.push_back(5*step + (long)((*rng)() % (35*step)));
+  std::sort(steps.begin(), steps.end());
+  steps.erase(std::unique(steps.begin(), steps.end()), steps.end());
+  long query_steps = 0;
+  int  length      = 1 + (*rng)() % 5;
+  for (int i=0; i<length; ++i)
+    query_steps += steps[(*rng)() % steps.size()];
+  if ((*rng)() % 4 == 0)
+    ++query_steps;
+
+  trial->n = (int)steps.size();
+  trial->input_set.resize(trial->n);
+  for (int i=0; i<trial->n; ++i)
+    trial->input_set[i] = (double)steps[i]/step;
+  trial->query_value = (double)query_steps/step;
+  int half_steps     = (decimal || (*rng)() % 2) ? 1 + 2*((*rng)() % 2) : 0;
+  trial->epsilon     = 0.5*half_steps/step;
+  trial->sample_seed = (*rng)();
+}
+
+/**
+ * @brief Prints where the combinations an engine found differ from the reference: the counts of each length that differ, and a few of the
+ * combinations that are missing or unexpected
+ *
+ * @param report The stream to print to
+ * @param expected The reference result
+ * @param found The engine's result
+ */
+void print_differential_mismatch(FILE* report, const differential_result* expected, const differential_result* found) {
+  size_t lengths = std::max(expected->length_counts.size(), found->length_counts.size());
+  for (size_t len=1; len<lengths; ++len) {
+    unsigned long want = (len < expected->length_counts.size()) ? expected->length_counts[len] : 0,
+                  got  = (len < found->length_counts.size()) ? found->length_counts[len] : 0;
+    if (want != got)
+      fprintf(report, "  length %zu: %lu expected, %lu found\n", len, want, got);
+  }
+  std::vector<std::string> missing, unexpected;
+  std::set_difference(expected->combinations.begin(), expected->combinations.end(), found->combinations.begin(), found->combinations.end(),
+                      std::back_inserter(missing));
+  std::set_difference(found->combinations.begin(), found->combinations.end(), expected->combinations.begin(), expected->combinations.end(),
+                      std::back_inserter(unexpected));
+  for (size_t i=0; i<missing.size() && i<DIFFERENTIAL_MAX_LISTED; ++i)
+    fprintf(report, "  missing:    %s\n", missing[i].c_str());
+  for (size_t i=0; i<unexpected.size() && i<DIFFERENTIAL_MAX_LISTED; ++i)
+    fprintf(report, "  unexpected: %s\n", unexpected[i].c_str());
+  // the counts differ but no combination is missing or unexpected, so some combinations were reported more than once
+  if (missing.empty() && unexpected.empty())
+    fprintf(report, "  combinations reported more than once\n");
+}
+
+/**
+ * @brief Prints a trial's query and input set, as the heading of one of its reports
+ *
+ * @param report The stream to print to
+ * @param heading What is reported, e.g. "Failure"
+ * @param t The number of the trial
+ * @param trial The trial
+ */
+void print_differential_trial(FILE* report, const char* heading, int t, const differential_trial* trial) {
+  fprintf(report, "%s in trial %d: query value %g, epsilon %g, input set", heading, t, trial->query_value, trial->epsilon);
+  for (int i=0; i<trial->n; ++i)
+    fprintf(report, " %g", trial->input_set[i]);
+  fprintf(report, "\n");
+}
+
+/**
+ * @brief Runs random trials through the reference engine and through the zeroboard engine in each of its modes. A constrained mode is compared
+ * with the reference and standard engine results narrowed to its constraint. A mode fails a trial when it reports some combination a different
+ * number of times from the reference; the standard engine is held to the reference like every other mode. Each failure is printed against the
+ * reference and against the standard engine, grouping the modes under the same constraint that found the same combinations. It then reports, for each mode, the trials that differed from the reference, from the standard engine and from both, and the time the mode took over
+ * all trials and its speedup over the reference.
+ * The modes are the standard engine, the bulk loaded zeroboard, batched and sorted probes, reachability pruning, length-incremental search, the
+ * fixed-point engine, result cursors read straight through and resumed from a token after every page, out-of-core and partial zeroboards,
+ * concurrent queries, the pipeline, ranked, multiplicity-bounded and index-masked queries, the uniform sampler, and the board and result caches,
+ * each timed on a run that finds its cache filled.
+ *
+ * @param num_trials The number of trials
+ * @param seed The seed for the random number generator; the same seed draws the same trials
+ * @param directory The directory out-of-core zeroboards and peak lists are written to
+ * @param report The stream mismatches and timings are printed to
+ * @return int: the number of mode runs that fail, i.e. differ from the reference
+ */
+int differentialTest(int num_trials, unsigned long seed, const char* directory, FILE* report) {
+  static const differential_mode modes[] = {
+    {"zeroboard",          run_zeroboard,            false, NULL},
+    {"bulk load",          run_bulk_load,            false, NULL},
+    {"batched probes",     run_batched_probes,       false, NULL},
+    {"sorted probes",      run_sorted_probes,        false, NULL},
+    {"reachability",       run_reachability,         false, NULL},
+    {"length-incremental", run_length_incremental,   false, NULL},
+    {"fixed-point",        run_fixed_point,          false, NULL},
+    {"cursor",             run_cursor,               false, NULL},
+    {"cursor resume",      run_cursor_resume,        false, NULL},
+    {"out-of-core",        run_out_of_core,          false, NULL},
+    {"partial zeroboard",  run_partial,              false, NULL},
+    {"concurrent",         run_concurrent,           false, NULL},
+    {"pipeline",           run_pipeline,             false, NULL},
+    {"ranked",             run_ranked,               false, NULL},
+    {"multiplicity bound", run_multiplicity_bounded, false, keep_multiplicity_bounded},
+    {"index mask",         run_index_mask,           false, keep_index_mask},
+    {"sampler",            run_sampler,              false, NULL},
+    {"board cache",        run_board_cache,          true,  NULL},
+    {"result cache",       run_result_cache,         true,  NULL}
+  };
+  const int num_modes = sizeof(modes)/sizeof(modes[0]);
+  std::vector<double> seconds(num_modes, 0.0);
+  std::vector<int>    mismatches(num_modes, 0),
+                      disagreements(num_modes, 0),
+                      failures(num_modes, 0);
+  double reference_seconds = 0.0;
+  std::mt19937_64 rng(seed);
+
+  for (int t=0; t<num_trials; ++t) {
+    differential_trial trial;
+    draw_differential_trial(&trial, &rng);
+    trial.directory = directory;
+
+    char*  text     = NULL;
+    size_t text_len = 0;
+    FILE*  output   = open_memstream(&text, &text_len);
+    if (output == NULL) {
+      printf("Error: cannot capture the output of the reference engine\n");
+      exit(EXIT_FAILURE);
+    }
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    bruteForceSubsetSum(trial.input_set.data(), trial.n, trial.query_value, trial.epsilon, output, NULL);
+    reference_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    fclose(output);
+    differential_result reference;
+    collect_compositions(text, text_len, &reference);
+    free(text);
+
+    std::vector<differential_result> found(num_modes);
+
+    for (int m=0; m<num_modes; ++m) {
+      init_board_cache(&trial.boards, 64 << 20, false);
+      init_result_cache(&trial.results, 0.0, 1 << 20);
+      for (int pass=modes[m].warm ? 0 : 1; pass<2; ++pass) {
+        std::vector<double> input_set = trial.input_set;
+        query_options options;
+        init_query_options(&options, trial.n);
+        options.compositions = true;
+        options.output       = open_memstream(&text, &text_len);
+        if (options.output == NULL) {
+          printf("Error: cannot capture the output of the %s mode\n", modes[m].name);
+          exit(EXIT_FAILURE);
+        }
+        start = std::chrono::steady_clock::now();
+        modes[m].run(&trial, input_set.data(), &options);
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        fclose(options.output);
+        if (pass == 1) {
+          seconds[m] += elapsed;
+          collect_compositions(text, text_len, &found[m]);
+        }
+        free(text);
+      }
+      free_board_cache(&trial.boards);
+      free_result_cache(&trial.results);
+    }
+
+    // what each mode should find, by the reference and by the standard engine, narrowed to the mode's constraint
+    std::vector<differential_result> expected(num_modes),
+                                     standard(num_modes);
+    std::vector<bool> agrees_reference(num_modes),
+                      agrees_standard(num_modes);
+    for (int m=0; m<num_modes; ++m) {
+      filter_differential_result(&reference, modes[m].keep, &expected[m]);
+      filter_differential_result(&found[0], modes[m].keep, &standard[m]);
+      agrees_reference[m] = same_differential_result(&found[m], &expected[m]);
+      agrees_standard[m]  = same_differential_result(&found[m], &standard[m]);
+      mismatches[m]    += !agrees_reference[m];
+      disagreements[m] += !agrees_standard[m];
+      failures[m]      += !agrees_reference[m];
+    }
+
+    // modes under the same constraint that found the same wrong combinations are reported together, as they usually share the cause
+    std::vector<bool> reported(num_modes, false);
+    for (int m=0; m<num_modes; ++m) {
+      if (reported[m] || agrees_reference[m])
+        continue;
+      print_differential_trial(report, "Failure", t, &trial);
+      fprintf(report, "  modes:");
+      for (int other=m; other<num_modes; ++other)
+        if (!reported[other] && modes[other].keep == modes[m].keep && same_differential_result(&found[other], &found[m])) {
+          fprintf(report, "%s %s", (other == m) ? "" : ",", modes[other].name);
+          reported[other] = true;
+        }
+      fprintf(report, "\n");
+      print_differential_mismatch(report, &expected[m], &found[m]);
+      if (m != 0 && !agrees_standard[m]) {
+        fprintf(report, "  against the standard engine:\n");
+        print_differential_mismatch(report, &standard[m], &found[m]);
+      }
+    }
+  }
+
+  int total = 0;
+  fprintf(report, "\n%d trials, seed %lu\n", num_trials, seed);
+  fprintf(report, "%-20s %12s %12s %10s %12s %10s\n", "mode", "vs reference", "vs zeroboard", "failures", "seconds", "speedup");
+  fprintf(report, "%-20s %12s %12s %10s %12f %10.2f\n", "reference", "-", "-", "-", reference_seconds, 1.0);
+  for (int m=0; m<num_modes; ++m) {
+    fprintf(report, "%-20s %12d %12d %10d %12f %10.2f\n", modes[m].name, mismatches[m], disagreements[m], failures[m], seconds[m],
+            seconds[m] > 0 ? reference_seconds/seconds[m] : 0.0);
+    total += failures[m];
+  }
+  return total;
+}
+
+#endif /* DIFFERENTIALTEST_H */
@@ -0,0 +1,453 @@
+//
+// externalBoard.h
+// Out-of-core zeroboards, for zeroboard combination lengths whose zeroboard does not fit in memory. Combinations are enumerated in the same order
+// as writeZeroBoard() and streamed, as (bin, combination) records, into a buffer of limited size; each full buffer is sorted and written to disk as a
+// run, and the runs are then merged into a single board file ordered by bin. Queries find bins through an index and read them from the file
+// (see external_board in zeroboard.h), so the size of the zeroboard is limited by disk space rather than memory.
+// Used alongside UnboundedSubsetSum.
+//
+
+#ifndef EXTERNALBOARD_H
+#define EXTERNALBOARD_H
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <algorithm>
+#include <chrono>
+#include <queue>
+#include <string>
+#include <vector>
+
+#include "unboundedSubsetSum.h"
+
+// The most runs merged at once, so that the number of run files open stays bounded however many runs the zeroboard takes
+#define EXTERNAL_MERGE_FAN_IN 64
+
+/**
+ * @brief The state of an out-of-core zeroboard while it is being written
+ *
+ * @param directory The directory that runs and the board file are written to
+ * @param record_size The size of each record in bytes
+ * @param capacity The number of records the buffer holds
+ * @param count The number of records in the buffer
+ * @param buffer The records not yet written to a run
+ * @param order The order in which the records of the buffer are written, once sorted
+ * @param runs The runs written so far and not yet merged, each ordered by bin
+ * @param levels The level of each run: 0 for a run sorted from the buffer, one more than the runs it was merged from for a merged run
+ * @param num_runs The number of runs sorted from the buffer
+ * @param dp The order of magnitude of epsilon
+ */
+struct external_build {
+  const char* directory;
+  size_t record_size;
+  size_t capacity;
+  size_t count;
+  char*  buffer;
+  size_t* order;
+  std::vector<FILE*> runs;
+  std::vector<int>   levels;
+  int    num_runs;
+  double dp;
+};
+
+
+/**
+ * @brief Orders two records: by bin, then from the shortest combination to the longest, then from the largest combination to the smallest
+ *
+ * @param a The first record
+ * @param b The second record
+ * @return true if a comes before b
+ */
+bool external_record_before(const char* a, const char* b) {
+  double bin_a = external_record_bin(a),
+         bin_b = external_record_bin(b);
+  if (bin_a != bin_b)
+    return bin_a < bin_b;
+  uint16_t len_a, len_b;
+  memcpy(&len_a, a + sizeof(double), sizeof(uint16_t));
+  memcpy(&len_b, b + sizeof(double), sizeof(uint16_t));
+  if (len_a != len_b)
+    return len_a < len_b;
+  for (int i=0; i<len_a; ++i) {
+    uint16_t index_a, index_b;
+    memcpy(&index_a, a + sizeof(double) + sizeof(uint16_t)*(i+1), sizeof(uint16_t));
+    memcpy(&index_b, b + sizeof(double) + sizeof(uint16_t)*(i+1), sizeof(uint16_t));
+    if (index_a != index_b)
+      return index_a > index_b;
+  }
+  return false;
+}
+
+/**
+ * @brief Creates a file in a directory that is removed as soon as it is closed
+ *
+ * @param directory The directory
+ * @return FILE*: the file, open for reading and writing
+ */
+FILE* open_external_file(const char* directory) {
+  std::string path = std::string(directory) + "/lasso_board_XXXXXX";
+  int fd = mkstemp(&path[0]);
+  FILE* file = (fd < 0) ? NULL : fdopen(fd, "w+b");
+  if (file == NULL) {
+    printf("Error: unable to create a zeroboard file in %s\n", directory);
+    exit(EXIT_FAILURE);
+  }
+  unlink(path.c_str());
+  return file;
+}
+
+/**
+ * @brief A run being merged, and its next record
+ *
+ * @param file The run
+ * @param record The next record of the run
+ */
+struct external_run {
+  FILE* file;
+  char* record;
+};
+
+/**
+ * @brief Merges runs into one file ordered by bin, and closes, and so removes, the runs. If a board is given, the file is its board file and
+ * the index of the board is written as it goes.
+ *
+ * @param build The build state
+ * @param inputs The runs to merge
+ * @param output The file to write
+ * @param board The board whose board file is being written; NULL if the output is itself a run
+ */
+void merge_external_files(external_build* build, const std::vector<FILE*>& inputs, FILE* output, external_board* board) {
+  size_t record_size = build->record_size,
+         num_runs    = inputs.size();
+  std::vector<external_run> runs(num_runs);
+  for (size_t r=0; r<num_runs; ++r) {
+    runs[r].file   = inputs[r];
+    runs[r].record = (char*)malloc(record_size);
+  }
+  // Runs are ordered by their next record, so the top of the queue holds the next record of the output
+  auto later = [&runs](size_t a, size_t b) { return external_record_before(runs[b].record, runs[a].record); };
+  std::priority_queue<size_t, std::vector<size_t>, decltype(later)> queue(later);
+  for (size_t r=0; r<num_runs; ++r)
+    if (fread(runs[r].record, record_size, 1, runs[r].file) == 1)
+      queue.push(r);
+
+  unsigned long index_capacity = 1024,
+                num_records    = 0;
+  if (board != NULL) {
+    board->index     = (external_index_entry*)malloc(sizeof(external_index_entry)*index_capacity);
+    board->index_len = 0;
+  }
+  while (!queue.empty()) {
+    size_t r = queue.top();
+    queue.pop();
+    // Start an index entry at the first record of each block
+    if (board != NULL && num_records % EXTERNAL_INDEX_RECORDS == 0) {
+      if (board->index_len == index_capacity) {
+        index_capacity *= 2;
+        board->index = (external_index_entry*)realloc(board->index, sizeof(external_index_entry)*index_capacity);
+      }
+      if (board->index == NULL) {
+        printf("Error: unable to allocate the index of the out-of-core zeroboard\n");
+        exit(EXIT_FAILURE);
+      }
+      uint16_t len;
+      memcpy(&len, runs[r].record + sizeof(double), sizeof(uint16_t));
+      board->index[board->index_len].bin = external_record_bin(runs[r].record);
+      board->index[board->index_len].len = len;
+      ++board->index_len;
+    }
+    if (fwrite(runs[r].record, record_size, 1, output) != 1) {
+      printf("Error: unable to write the zeroboard file to %s\n", build->directory);
+      exit(EXIT_FAILURE);
+    }
+    ++num_records;
+    if (fread(runs[r].record, record_size, 1, runs[r].file) == 1)
+      queue.push(r);
+  }
+  fflush(output);
+  rewind(output);
+  if (board != NULL)
+    board->num_records = num_records;
+
+  for (size_t r=0; r<num_runs; ++r) {
+    fclose(runs[r].file);
+    free(runs[r].record);
+  }
+}
+
+/**
+ * @brief Sorts the records in the buffer and writes them to disk as a new run
+ *
+ * @param build The build state
+ */
+void flush_external_run(external_build* build) {
+  if (build->count == 0)
+    return;
+  for (size_t i=0; i<build->count; ++i)
+    build->order[i] = i;
+  char*  buffer      = build->buffer;
+  size_t record_size = build->record_size;
+  std::sort(build->order, build->order + build->count,
+            [buffer, record_size](size_t a, size_t b) { return external_record_before(buffer + a*record_size, buffer + b*record_size); });
+
+  FILE* run = open_external_file(build->directory);
+  for (size_t i=0; i<build->count; ++i)
+    if (fwrite(buffer + build->order[i]*record_size, record_size, 1, run) != 1) {
+      printf("Error: unable to write a zeroboard run to %s\n", build->directory);
+      exit(EXIT_FAILURE);
+    }
+  fflush(run);
+  rewind(run);
+  build->runs.push_back(run);
+  build->levels.push_back(0);
+  ++build->num_runs;
+  build->count = 0;
+
+  // Once EXTERNAL_MERGE_FAN_IN runs of one level are waiting, merge them into a run of the next level, so that few runs are open at once
+  size_t num_runs = build->runs.size();
+  while (num_runs >= EXTERNAL_MERGE_FAN_IN && build->levels[num_runs-EXTERNAL_MERGE_FAN_IN] == build->levels[num_runs-1]) {
+    std::vector<FILE*> group(build->runs.end() - EXTERNAL_MERGE_FAN_IN, build->runs.end());
+    FILE* merged = open_external_file(build->directory);
+    merge_external_files(build, group, merged, NULL);
+    int level = build->levels[num_runs-1] + 1;
+    build->runs.resize(num_runs - EXTERNAL_MERGE_FAN_IN);
+    build->levels.resize(num_runs - EXTERNAL_MERGE_FAN_IN);
+    build->runs.push_back(merged);
+    build->levels.push_back(level);
+    num_runs = build->runs.size();
+  }
+}
+
+/**
+ * @brief Adds the record of a combination to the buffer, writing a run first if the buffer is full
+ *
+ * @param build The build state
+ * @param key The tare sum of the combination
+ * @param combination The combination
+ * @param combination_len The combination length
+ */
+void add_external_record(external_build* build, double key, const uint16_t* combination, int combination_len) {
+  if (build->count == build->capacity)
+    flush_external_run(build);
+  char*    record = build->buffer + build->count*build->record_size;
+  double   bin    = bin_value(key, bin_scale(build->dp));
+  uint16_t len    = (uint16_t)combination_len;
+  memset(record, 0, build->record_size);
+  memcpy(record, &bin, sizeof(double));
+  memcpy(record + sizeof(double), &len, sizeof(uint16_t));
+  memcpy(record + sizeof(double) + sizeof(uint16_t), combination, sizeof(uint16_t)*combination_len);
+  ++build->count;
+}
+
+/**
+ * @brief The enumerate_combinations() visitor of an out-of-core build: every combination is streamed into the build
+ */
+struct external_writer {
+  external_build* build;
+
+  int prefix(int /* len */, int /* pos */, double /* smallest */, double /* largest */) {
+    return COMBINATION_EXTEND;
+  }
+
+  void combination(double key, const uint16_t* combination, int len) {
+    add_external_record(build, key, combination, len);
+  }
+};
+
+/**
+ * @brief Merges the runs of a build into the board file, and writes the index of the board. While more than EXTERNAL_MERGE_FAN_IN runs are
+ * left, groups of runs are first merged into longer runs, one pass over the records at a time.
+ *
+ * @param build The build state
+ * @param board The board to write
+ */
+void merge_external_runs(external_build* build, external_board* board) {
+  while (build->runs.size() > EXTERNAL_MERGE_FAN_IN) {
+    std::vector<FILE*> merged;
+    for (size_t first=0; first<build->runs.size(); first+=EXTERNAL_MERGE_FAN_IN) {
+      size_t last = std::min(first + EXTERNAL_MERGE_FAN_IN, build->runs.size());
+      std::vector<FILE*> group(build->runs.begin() + first, build->runs.begin() + last);
+      // A group of one run is carried into the next pass as it is
+      if (group.size() == 1) {
+        merged.push_back(group[0]);
+        continue;
+      }
+      FILE* run = open_external_file(build->directory);
+      merge_external_files(build, group, run, NULL);
+      merged.push_back(run);
+    }
+    build->runs.swap(merged);
+  }
+  merge_external_files(build, build->runs, board->file, board);
+  build->runs.clear();
+}
+
+/**
+ * @brief Writes an out-of-core zeroboard: every combination of every length up to the zeroboard combination length, as records in a board file
+ * ordered by bin. At most memory_bytes are used to sort records, so lengths whose zeroboard would not fit in memory can be written.
+ *
+ * @param board The board to write; free it with free_external_board()
+ * @param input_set The processed input set
+ * @param n The number of values in the input set
+ * @param search_space_comb_len The zeroboard combination length
+ * @param dp The order of magnitude of epsilon
+ * @param directory The directory for the runs and the board file, e.g. a local disk with room for the board; files are removed when closed
+ * @param memory_bytes The memory used to sort records into runs
+ */
+void writeExternalZeroBoard(
+  external_board* board,
+  double* input_set,
+  int n,
+  int search_space_comb_len,
+  double dp,
+  const char* directory,
+  size_t memory_bytes )
+{
+  external_build build;
+  build.directory   = directory;
+  // a record is its bin, its length and its indexes, padded so that the bins of records in a buffer are aligned
+  build.record_size = (sizeof(double) + sizeof(uint16_t)*(search_space_comb_len+1) + sizeof(double)-1) / sizeof(double) * sizeof(double);
+  build.capacity    = memory_bytes / (build.record_size + sizeof(size_t));
+  if (build.capacity < 1)
+    build.capacity = 1;
+  build.count       = 0;
+  build.num_runs    = 0;
+  build.dp          = dp;
+  build.buffer      = (char*)malloc(build.capacity*build.record_size);
+  build.order       = (size_t*)malloc(sizeof(size_t)*build.capacity);
+  if (build.buffer == NULL || build.order == NULL) {
+    printf("Error: unable to allocate %zu bytes to sort the zeroboard\n", memory_bytes);
+    exit(EXIT_FAILURE);
+  }
+
+  double tare[n];
+  for (int i=0; i<n; ++i)
+    tare[i] = input_set[n-1] - input_set[i];
+  uint16_t        combination[search_space_comb_len];
+  external_writer writer = { &build };
+  for (int len=search_space_comb_len; len>=1; --len)
+    enumerate_combinations(tare, n, combination, len, 0, 0.0, writer);
+  flush_external_run(&build);
+  free(build.buffer);
+  free(build.order);
+
+  board->file                  = open_external_file(directory);
+  board->search_space_comb_len = search_space_comb_len;
+  board->record_size           = build.record_size;
+  board->num_runs              = build.num_runs;
+  merge_external_runs(&build, board);
+
+  // Map the board file, so a probe reads its bin without a system call
+  board->records = NULL;
+  if (board->num_records > 0) {
+    void* records = mmap(NULL, board->num_records*board->record_size, PROT_READ, MAP_SHARED, fileno(board->file), 0);
+    if (records == MAP_FAILED) {
+      printf("Error: unable to map the zeroboard file in %s\n", directory);
+      exit(EXIT_FAILURE);
+    }
+    board->records = (const char*)records;
+  }
+}
+
+/**
+ * @brief Prints the size of an out-of-core zeroboard
+ *
+ * @param board The board
+ */
+void print_external_board(external_board* board) {
+  printf("Out-of-core zeroboard: %lu combinations, %.1f MiB on disk, %lu index entries, merged from %d run(s)\n",
+         board->num_records, board->num_records*(double)board->record_size/(1 << 20), board->index_len, board->num_runs);
+}
+
+/**
+ * @brief Unmaps and closes, and so removes, the board file of an out-of-core zeroboard and frees its index
+ *
+ * @param board The board
+ */
+void free_external_board(external_board* board) {
+  if (board->records != NULL)
+    munmap((void*)board->records, board->num_records*board->record_size);
+  fclose(board->file);
+  free(board->index);
+  board->records   = NULL;
+  board->file      = NULL;
+  board->index     = NULL;
+  board->index_len = 0;
+}
+
+/**
+ * @brief Runs the algorithm like unboundedSubsetSum(), but writes the zeroboard to disk and reads its bins from there. The zeroboard combination
+ * length can be set beyond the in-memory maximum of 7. Multiplicity constrained, subset and length-incremental queries are supported; ranked
+ * queries and the fixed-point engine are not, and batched probing is ignored.
+ *
+ * @param input_set The input set: a pointer to the first item in an array of double type values
+ * @param input_set_size The number of items in the input set
+ * @param query_value The target value to which combinations must sum
+ * @param epsilon The value that the target value can vary by
+ * @param search_space_comb_len The zeroboard combination length; 0 to choose it as unboundedSubsetSum() does
+ * @param directory The directory for the board file
+ * @param memory_bytes The memory used to sort the zeroboard
+ * @param print_times Require printing of runtimes for writing the zeroboard and querying it
+ * @param print_comb Require printing of all commbinations summing to the target value
+ * @param print_details Require printing of details about the algorithm run, including the size of the zeroboard
+ * @param options Optional query settings, as for unboundedSubsetSum()
+ */
+void unboundedSubsetSumExternal(
+  double* input_set,
+  int input_set_size,
+  double query_value,
+  double epsilon,
+  int search_space_comb_len,
+  const char* directory,
+  size_t memory_bytes,
+  int print_times,
+  int print_comb,
+  int print_details,
+  query_options* options = NULL )
+{
+  if (options != NULL && (options->ranked != NULL || options->fixed_point_scale > 0)) {
+    printf("\nERROR: Ranked queries and the fixed-point engine cannot use an out-of-core zeroboard\n\n");
+    exit(EXIT_FAILURE);
+  }
+  int     search_space_min = SEARCH_SPACE_MIN,
+          search_space_max = (search_space_comb_len == 0) ? SEARCH_SPACE_MAX : 0;
+  double  dp_precision     = 0.0;
+  process_inputs(input_set, input_set_size, query_value, epsilon, &dp_precision, &search_space_comb_len, search_space_min, search_space_max, dp_precision, 0, print_details);
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  trace_span build_span;
+  begin_trace_span(&build_span, query_tracer(options), "build", "comb_len", search_space_comb_len);
+  external_board board;
+  writeExternalZeroBoard(&board, input_set, input_set_size, search_space_comb_len, dp_precision, directory, memory_bytes);
+  end_trace_span(&build_span);
+  reachability_cache reachability;
+  init_reachability_cache(&reachability);
+  const reachability_table* reachability_ptr = NULL;
+  if (options != NULL)
+    reachability_ptr = cached_reachability_table(&reachability, input_set, input_set_size, query_value, epsilon + 1.0/bin_scale(dp_precision), options->reachability_scale);
+  std::chrono::steady_clock::time_point written = std::chrono::steady_clock::now();
+  if (print_details)
+    print_external_board(&board);
+
+  // the query reads every bin from the board file, so it runs against an empty in-memory zeroboard
+  query_options external_options;
+  if (options != NULL)
+    external_options = *options;
+  else
+    init_query_options(&external_options, input_set_size);
+  external_options.external = &board;
+  Board zeroboard;
+  queryZeroBoard(input_set, input_set_size, &zeroboard, search_space_comb_len, search_space_min, dp_precision, query_value, epsilon, 0, print_details, print_comb, &external_options, reachability_ptr);
+  std::chrono::steady_clock::time_point queried = std::chrono::steady_clock::now();
+
+  free_external_board(&board);
+  free_reachability_cache(&reachability);
+
+  if (print_times) {
+    printf("%f seconds to create out-of-core zeroboard\n", std::chrono::duration<double>(written - start).count());
+    printf("%f seconds to query zeroboard\n\n", std::chrono::duration<double>(queried - written).count());
+  }
+}
+
+#endif /* EXTERNALBOARD_H */
@@ -0,0 +1,439 @@
+//
+// fixedPoint.h
+// The fixed-point engine: the input set is converted once to 64-bit integers at a chosen resolution, and from then on keys, tare values,
+// bounds and comparisons all use integer arithmetic. Results are exact at that resolution and do not depend on floating point rounding.
+// Used by UnboundedSubsetSum.
+//
+
+#ifndef FIXEDPOINT_H
+#define FIXEDPOINT_H
+
+#include "zeroboard.h"
+#include "queryDeadline.h"
+#include "queryTrace.h"
+
+// Scaled values must stay well inside the range of a 64-bit integer so that sums of a combination's values cannot overflow
+#define FIXED_POINT_LIMIT 1e18
+
+// A zeroboard keyed by bin number rather than by bin value. Each bin holds the tare sums from bin*width to bin*width + width - 1,
+// with one item per distinct tare sum, ordered from smallest to largest.
+typedef boost::unordered_map< long long, combination_set_list* > FixedBoard;
+
+/**
+ * @brief An input set converted to fixed-point integers
+ *
+ * @param n The number of values in the input set
+ * @param scale The resolution: each value is rounded to the nearest multiple of 1/scale and stored as that multiple
+ * @param value The scaled input set values
+ * @param tare The scaled tare value of each input set value, i.e. max - value
+ * @param max The scaled input set maximum
+ * @param bin_width The number of tare sums held by each zeroboard bin
+ */
+struct fixed_point_input {
+  int        n;
+  double     scale;
+  long long* value;
+  long long* tare;
+  long long  max;
+  long long  bin_width;
+};
+
+
+/**
+ * @brief Converts a value to fixed point
+ *
+ * @param value The value
+ * @param scale The resolution
+ * @return long long: the value rounded to the nearest multiple of 1/scale, as that multiple
+ */
+long long to_fixed_point(double value, double scale) {
+  return llround(value*scale);
+}
+
+/**
+ * @brief Finds the bin of a scaled tare sum, rounding towards negative infinity
+ *
+ * @param key The scaled tare sum
+ * @param bin_width The number of tare sums held by each bin
+ * @return long long: the bin number
+ */
+long long fixed_bin(long long key, long long bin_width) {
+  long long bin = key / bin_width;
+  return (key % bin_width < 0) ? bin-1 : bin;
+}
+
+/**
+ * @brief Converts a sorted input set to fixed point
+ *
+ * @param input The fixed-point input set to initialise
+ * @param input_set The sorted input set
+ * @param n The number of values in the input set
+ * @param query_value The largest query value that will be searched for
+ * @param epsilon The amount by which query values can vary; its scaled value is the zeroboard bin width
+ * @param scale The resolution, e.g. 1e5 for values with five decimal places
+ *
+ * @throws Exits if a scaled value is not positive or sums of scaled values could overflow
+ */
+void init_fixed_point_input(
+  fixed_point_input* input,
+  double* input_set,
+  int n,
+  double query_value,
+  double epsilon,
+  double scale )
+{
+  if ((query_value + epsilon)*scale >= FIXED_POINT_LIMIT) {
+    printf("\nERROR: Query value is too large for fixed point at this scale\n\tQuery value: %f\n\tScale: %f\n\n", query_value, scale);
+    exit(EXIT_FAILURE);
+  }
+  input->n         = n;
+  input->scale     = scale;
+  input->value     = (long long*)malloc(sizeof(long long)*n);
+  input->tare      = (long long*)malloc(sizeof(long long)*n);
+  for (int i=0; i<n; ++i)
+    input->value[i] = to_fixed_point(input_set[i], scale);
+  if (input->value[0] <= 0) {
+    printf("\nERROR: Input set values must be at least 1/scale in fixed point\n\tSmallest value: %f\n\tScale: %f\n\n", input_set[0], scale);
+    exit(EXIT_FAILURE);
+  }
+  input->max       = input->value[n-1];
+  for (int i=0; i<n; ++i)
+    input->tare[i] = input->max - input->value[i];
+  input->bin_width = to_fixed_point(epsilon, scale);
+  if (input->bin_width < 1)
+    input->bin_width = 1;
+}
+
+/**
+ * @brief Frees the scaled values of a fixed-point input set
+ *
+ * @param input The fixed-point input set
+ */
+void free_fixed_point_input(fixed_point_input* input) {
+  free(input->value);
+  free(input->tare);
+}
+
+/**
+ * @brief Inserts a combination into a fixed-point zeroboard. Combinations with the same tare sum share an item, and new combinations are added to the head of the item.
+ *
+ * @param zeroboard The zeroboard
+ * @param key The scaled tare sum of the combination
+ * @param bin_width The number of tare sums held by each bin
+ * @param combination The combination of input set indexes; it is copied into the zeroboard
+ * @param combination_len Number of indexes in the combination
+ */
+void fixed_board_insert(
+  FixedBoard* zeroboard,
+  long long key,
+  long long bin_width,
+  const uint16_t* combination,
+  int combination_len )
+{
+  combination_set* new_set = new_combination_set(combination, combination_len);
+  FixedBoard::iterator bucket = zeroboard->find(fixed_bin(key, bin_width));
+  combination_set_list* set_list;
+  if (bucket == zeroboard->end()) {
+    set_list = (combination_set_list*)malloc(sizeof(combination_set_list));
+    set_list->head        = NULL;
+    set_list->tail        = NULL;
+    set_list->summary     = NULL;
+    set_list->index_masks = NULL;
+    zeroboard->emplace(fixed_bin(key, bin_width), set_list);
+  } else
+    set_list = bucket->second;
+
+  // Find the item for this tare sum, or the item it goes before; item keys hold the scaled tare sums, which doubles represent exactly
+  combination_set_item* item = set_list->head;
+  while (item != NULL && (long long)item->key < key)
+    item = item->next;
+  if (item != NULL && (long long)item->key == key) {
+    new_set->next = item->head;
+    item->head    = new_set;
+    return;
+  }
+  combination_set_item* new_item = (combination_set_item*)malloc(sizeof(combination_set_item));
+  new_item->key  = (double)key;
+  new_item->head = new_set;
+  new_item->next = item;
+  new_item->prev = (item != NULL) ? item->prev : set_list->tail;
+  if (new_item->prev != NULL)
+    new_item->prev->next = new_item;
+  else
+    set_list->head = new_item;
+  if (item != NULL)
+    item->prev = new_item;
+  else
+    set_list->tail = new_item;
+}
+
+/**
+ * @brief Writes every combination of lengths 1 up to the zeroboard combination length into a fixed-point zeroboard.
+ * As with writeZeroBoard(), the longest combinations are written first so that every item ends up ordered from shortest to longest combination,
+ * and within a length from the largest first index to the smallest.
+ *
+ * @param input The fixed-point input set
+ * @param zeroboard The zeroboard to write
+ * @param search_space_comb_len The zeroboard combination length
+ */
+void writeFixedZeroBoard(
+  fixed_point_input* input,
+  FixedBoard* zeroboard,
+  int search_space_comb_len )
+{
+  int       n = input->n;
+  uint16_t  combination[search_space_comb_len];
+  long long sums[search_space_comb_len];
+
+  for (int len=search_space_comb_len; len>=1; --len) {
+    // Generate combinations in ascending order with the first index changing slowest, keeping the tare sum of every leading part of the combination
+    for (int i=0; i<len; ++i) {
+      combination[i] = 0;
+      sums[i]        = ((i > 0) ? sums[i-1] : 0) + input->tare[0];
+    }
+    while (true) {
+      fixed_board_insert(zeroboard, sums[len-1], input->bin_width, combination, len);
+      int position = len-1;
+      while (position >= 0 && combination[position] == n-1)
+        --position;
+      if (position < 0)
+        break;
+      ++combination[position];
+      sums[position] = ((position > 0) ? sums[position-1] : 0) + input->tare[combination[position]];
+      for (int i=position+1; i<len; ++i) {
+        combination[i] = combination[position];
+        sums[i]        = sums[i-1] + input->tare[combination[i]];
+      }
+    }
+  }
+}
+
+/**
+ * @brief Counts, and prints if required, the combinations in a fixed-point zeroboard that complete a prefix to a sum within the query window
+ *
+ * @param input_set The input dataset
+ * @param input The fixed-point input set
+ * @param zeroboard The zeroboard
+ * @param tare_lo The smallest tare sum that completes the prefix
+ * @param tare_hi The largest tare sum that completes the prefix
+ * @param num_results The counter maintaining the number of combinations summing to the target query value
+ * @param array The prefix of input set indexes
+ * @param prefix_len The number of indexes in the prefix
+ * @param suffix_len The length of the zeroboard combinations to include
+ * @param print_comb Require printing of all combinations summing to target value
+ * @param options The query options; NULL for an unconstrained query
+ */
+void get_fixed_combinations(
+  double* input_set,
+  fixed_point_input* input,
+  const FixedBoard* zeroboard,
+  long long tare_lo,
+  long long tare_hi,
+  unsigned long* num_results,
+  int* array,
+  int prefix_len,
+  int suffix_len,
+  int print_comb,
+  query_options* options )
+{
+  bool bounded = has_multiplicity_bounds(options),
+       masked  = has_index_mask(options);
+  for (long long bin=fixed_bin(tare_lo, input->bin_width); bin<=fixed_bin(tare_hi, input->bin_width); ++bin) {
+    FixedBoard::const_iterator bucket = zeroboard->find(bin);
+    if (bucket == zeroboard->end())
+      continue;
+    // Items are ordered by tare sum, so stop at the first one past the window
+    for (combination_set_item* item = bucket->second->head; item != NULL && (long long)item->key <= tare_hi; item = item->next) {
+      if ((long long)item->key < tare_lo)
+        continue;
+      for (combination_set* set = item->head; set != NULL; set = set->next) {
+        // Sets are ordered from shortest to longest combination, then from the largest first index to the smallest
+        if (set->combination_len < suffix_len)
+          continue;
+        if (set->combination_len > suffix_len || (prefix_len > 0 && set->combination[0] < array[prefix_len-1]))
+          break;
+        if ((masked && !combination_within_index_mask(options, set->combination, set->combination_len))
+            || (bounded && !within_multiplicity_bounds(options, array, prefix_len, set->combination, set->combination_len)))
+          continue;
+        if (print_comb)
+          print_query_combination(options, query_output(options), input_set, array, prefix_len, set->combination, set->combination_len);
+        ++(*num_results);
+      }
+    }
+  }
+}
+
+/**
+ * @brief The fixed-point version of queryZeroBoard(). Finds every combination whose scaled sum lies within the scaled epsilon of the scaled query value.
+ * Prefixes are searched depth first with integer bounds: the remaining values of a combination lie between the current value and the input set maximum.
+ *
+ * @param input_set The input dataset
+ * @param input The fixed-point input set
+ * @param zeroboard The fixed-point zeroboard
+ * @param search_space_comb_len The zeroboard combination length
+ * @param query_val The target query value
+ * @param epsilon The amount by which the target query value can vary
+ * @param combination_length The user-defined value that determines a specific combination length to search; 0 by default searches all lengths
+ * @param print_details Requirement to print details about the algorithm run
+ * @param print_comb Requirement to print all combinations summing to the target value
+ * @param options Optional query settings; multiplicity constraints, the allowed index mask, the output stream and the deadline are supported
+ */
+void queryFixedZeroBoard(
+  double* input_set,
+  fixed_point_input* input,
+  const FixedBoard* zeroboard,
+  int search_space_comb_len,
+  double query_val,
+  double epsilon,
+  int combination_length,
+  int print_details,
+  int print_comb,
+  query_options* options )
+{
+  if (options != NULL && options->ranked != NULL) {
+    printf("\nERROR: Ranked queries cannot be run by the fixed-point engine\n\n");
+    exit(EXIT_FAILURE);
+  }
+  trace_span query_span;
+  begin_trace_span(&query_span, query_tracer(options), "query", "value", query_val);
+
+  // ** Function Variables **
+    FILE*     output        = query_output(options);
+    bool      bounded       = has_multiplicity_bounds(options),
+              masked        = has_index_mask(options);
+    long long query_fixed   = to_fixed_point(query_val, input->scale),
+              epsilon_fixed = to_fixed_point(epsilon, input->scale),
+              lo            = query_fixed - epsilon_fixed,
+              hi            = query_fixed + epsilon_fixed,
+              max           = input->max,
+             *value         = input->value;
+    int       n             = input->n,
+              max_comb_len  = (int)(hi/value[0]),
+              end_length    = search_space_comb_len;
+    unsigned long
+              resultsCounter = 0,
+              totalResults   = 0;
+    // if combination length set, only search that length
+    if (combination_length != 0) {
+      max_comb_len = combination_length;
+      end_length   = combination_length-1;
+    }
+    // tracking arrays
+    int       array_size    = (max_comb_len > search_space_comb_len) ? max_comb_len-search_space_comb_len : 1,
+              array[array_size];
+    long long sums[array_size];
+    // the query stops early, keeping the results found so far, if it runs out of time or is cancelled
+    query_deadline deadline;
+    start_query_deadline(&deadline, options);
+    int       stopped_length = 0;
+  // *** End Function Variables ***
+
+  if (print_details) fprintf(output, "Combination length : Num Results\n");
+
+  // iterate through valid combination lengths above the zeroboard combination length
+  for (int curr_comb_len=max_comb_len; curr_comb_len>end_length && curr_comb_len>search_space_comb_len; --curr_comb_len) {
+    if (stopped_length != 0 || query_must_stop(&deadline)) {
+      if (stopped_length == 0)
+        stopped_length = curr_comb_len;
+      break;
+    }
+    if (curr_comb_len*max < lo)
+      break;
+    trace_span length_span;
+    begin_trace_span(&length_span, query_tracer(options), "combination length", "length", curr_comb_len);
+    int prefix_len = curr_comb_len-search_space_comb_len,
+        dim        = 0;
+    array[0] = 0;
+
+    while (dim >= 0) {
+      if (query_should_stop(&deadline)) {
+        stopped_length = curr_comb_len;
+        break;
+      }
+      // Every value at this position has been tried, so move back to the previous position
+      if (array[dim] > n-1) {
+        if (--dim >= 0)
+          ++array[dim];
+        continue;
+      }
+      sums[dim] = ((dim > 0) ? sums[dim-1] : 0) + value[array[dim]];
+      int       remaining = curr_comb_len-(dim+1);
+      long long mins      = sums[dim] + value[array[dim]]*remaining,
+                maxs      = sums[dim] + max*remaining;
+
+      // Every later value at this position gives an even larger minimum, so move back to the previous position
+      if (mins > hi) {
+        if (--dim >= 0)
+          ++array[dim];
+      // Move along while the maximum for this position cannot reach the window or the value is not allowed
+      } else if (maxs < lo || (masked && !mask_has_index(options->allowed, array[dim]))) {
+        ++array[dim];
+      // The prefix is complete: the suffix must bring the sum into the window, i.e. its tare sum lies between k*max - (hi - sums) and k*max - (lo - sums)
+      } else if (dim == prefix_len-1) {
+        long long suffix_max = search_space_comb_len*max;
+        get_fixed_combinations(input_set, input, zeroboard, suffix_max - (hi - sums[dim]), suffix_max - (lo - sums[dim]), &resultsCounter, &array[0], prefix_len, search_space_comb_len, print_comb, options);
+        ++array[dim];
+      // Move to the next position in the prefix
+      } else {
+        ++dim;
+        array[dim] = array[dim-1];
+      }
+    }
+
+    if (print_details) fprintf(output, "\t%d\t\t%lu\n", curr_comb_len, resultsCounter);
+    totalResults  += resultsCounter;
+    resultsCounter = 0;
+    end_trace_span(&length_span);
+  }
+
+  // Check the combination lengths stored in the zeroboard, from the zeroboard combination length down to 1
+  for (int len=search_space_comb_len; len>=1; --len) {
+    if (len*max < lo)
+      break;
+    if (combination_length != 0 && combination_length != len)
+      continue;
+    if (stopped_length != 0 || query_must_stop(&deadline)) {
+      if (stopped_length == 0)
+        stopped_length = len;
+      break;
+    }
+    trace_span length_span;
+    begin_trace_span(&length_span, query_tracer(options), "combination length", "length", len);
+    resultsCounter = 0;
+    if (!bounded || bounded_prefix_can_reach(options, input_set, NULL, 0, len, query_val, epsilon))
+      get_fixed_combinations(input_set, input, zeroboard, len*max - hi, len*max - lo, &resultsCounter, &array[0], 0, len, print_comb, options);
+    if (print_details) fprintf(output, "\t%d\t\t%lu\n", len, resultsCounter);
+    totalResults += resultsCounter;
+    end_trace_span(&length_span);
+  }
+
+  if (print_details) fprintf(output, "\nTotal results: %lu\n\n", totalResults);
+  report_query_status(&deadline, options, stopped_length, totalResults, print_details);
+  end_trace_span(&query_span);
+}
+
+/**
+ * @brief Frees the memory used by a fixed-point zeroboard
+ *
+ * @param zeroboard The zeroboard
+ */
+void delete_fixed_zeroboard(FixedBoard* zeroboard) {
+  for (auto bucket : (*zeroboard) ) {
+    combination_set_item* item = bucket.second->head;
+    while (item != NULL) {
+      combination_set* set = item->head;
+      while (set != NULL) {
+        combination_set* next_set = set->next;
+        free(set);
+        set = next_set;
+      }
+      combination_set_item* next_item = item->next;
+      free(item);
+      item = next_item;
+    }
+    free(bucket.second);
+  }
+  zeroboard->clear();
+}
+
+#endif /* FIXEDPOINT_H */
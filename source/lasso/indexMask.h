@@ -0,0 +1,88 @@
+//
+// indexMask.h
+// Bitmasks over input set indexes, used to restrict a query to a subset of the input set (e.g. an alphabet of elements without sulfur)
+// so that one zeroboard, written for the whole input set, can serve queries over any subset of it.
+// Used by zeroboard, subsetSummer and queryCursor.
+//
+
+#ifndef INDEXMASK_H
+#define INDEXMASK_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "queryOptions.h"
+
+/**
+ * @brief The number of 64 bit words in a mask over n input set indexes
+ *
+ * @param n The number of values in the input set
+ * @return int: the number of words
+ */
+int index_mask_words(int n) {
+  return (n + 63) / 64;
+}
+
+/**
+ * @brief Allocates a mask over n input set indexes with no index set
+ *
+ * @param n The number of values in the input set
+ * @return uint64_t*: the mask, to be released with free()
+ */
+uint64_t* new_index_mask(int n) {
+  uint64_t* mask = (uint64_t*)calloc(index_mask_words(n), sizeof(uint64_t));
+  if (mask == NULL) {
+    printf("Error: unable to allocate an index mask for %d values\n", n);
+    exit(EXIT_FAILURE);
+  }
+  return mask;
+}
+
+/**
+ * @brief Sets an index in a mask
+ *
+ * @param mask The mask
+ * @param index The input set index
+ */
+void set_mask_index(uint64_t* mask, int index) {
+  mask[index >> 6] |= (uint64_t)1 << (index & 63);
+}
+
+/**
+ * @brief Checks whether an index is set in a mask
+ *
+ * @param mask The mask
+ * @param index The input set index
+ * @return true if the index is set
+ */
+bool mask_has_index(const uint64_t* mask, int index) {
+  return (mask[index >> 6] >> (index & 63)) & 1;
+}
+
+/**
+ * @brief Checks whether a query is restricted to a subset of the input set
+ *
+ * @param options The query options, may be NULL
+ * @return true if an allowed index mask is set
+ */
+bool has_index_mask(query_options* options) {
+  return options != NULL && options->allowed != NULL;
+}
+
+/**
+ * @brief Checks that every index of a combination stored in the zeroboard may be used
+ *
+ * @param options The query options holding the allowed index mask
+ * @param combination The indexes
+ * @param combination_len The number of indexes
+ * @return true if every index is allowed
+ */
+bool combination_within_index_mask(query_options* options, const uint16_t* combination, int combination_len) {
+  for (int i=0; i<combination_len; ++i)
+    if (!mask_has_index(options->allowed, combination[i]))
+      return false;
+  return true;
+}
+
+#endif /* INDEXMASK_H */
@@ -0,0 +1,193 @@
+//
+// lockFreeQueue.h
+// A bounded, lock-free, multi-producer multi-consumer queue of pointers. Items move through the queue without locks; a pair of counting semaphores
+// lets a producer sleep while the queue is full and a consumer sleep while it is empty, rather than spinning.
+// Used by the pipeline to connect its stages.
+//
+
+#ifndef LOCKFREEQUEUE_H
+#define LOCKFREEQUEUE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <semaphore.h>
+#include <atomic>
+#include <thread>
+
+/**
+ * @brief A cell of the queue. The sequence number tells producers and consumers whose turn it is to use the cell:
+ * it equals the position of the next push into the cell while empty, and that position + 1 once an item has been pushed.
+ *
+ * @param sequence The sequence number of the cell
+ * @param item The item held in the cell
+ */
+struct queue_cell {
+  std::atomic<size_t> sequence;
+  void* item;
+};
+
+/**
+ * @brief A bounded queue in which producers and consumers claim positions with compare-and-swap rather than locks.
+ * The capacity is a power of two so that positions map to cells with a mask.
+ *
+ * @param mask The capacity - 1
+ * @param cells The ring of cells
+ * @param items Counts the items in the queue that no consumer has claimed
+ * @param slots Counts the cells that no producer has claimed
+ * @param push_pos The position of the next push
+ * @param pop_pos The position of the next pop
+ */
+struct lockfree_queue {
+  size_t mask;
+  queue_cell* cells;
+  sem_t  items;
+  sem_t  slots;
+  alignas(64) std::atomic<size_t> push_pos;
+  alignas(64) std::atomic<size_t> pop_pos;
+};
+
+
+/**
+ * @brief Allocates an empty queue
+ *
+ * @param queue The queue to initialise
+ * @param capacity The minimum number of items the queue can hold; rounded up to a power of two
+ */
+void init_lockfree_queue(lockfree_queue* queue, size_t capacity) {
+  size_t size = 2;
+  while (size < capacity)
+    size *= 2;
+  queue->mask  = size-1;
+  queue->cells = new queue_cell[size];
+  for (size_t i=0; i<size; ++i)
+    queue->cells[i].sequence.store(i, std::memory_order_relaxed);
+  queue->push_pos.store(0, std::memory_order_relaxed);
+  queue->pop_pos.store(0, std::memory_order_relaxed);
+  if (sem_init(&queue->items, 0, 0) != 0 || sem_init(&queue->slots, 0, (unsigned int)size) != 0) {
+    printf("Error: unable to create the semaphores of a queue of %zu items\n", size);
+    exit(EXIT_FAILURE);
+  }
+}
+
+/**
+ * @brief Puts an item into a cell once a slot has been claimed from the semaphore. A consumer that has claimed the cell's last item may not yet
+ * have released the cell, so the push is retried until it has.
+ *
+ * @param queue The queue
+ * @param item The item to push
+ */
+void lockfree_queue_place(lockfree_queue* queue, void* item) {
+  size_t pos = queue->push_pos.load(std::memory_order_relaxed);
+  while (true) {
+    queue_cell* cell = &queue->cells[pos & queue->mask];
+    intptr_t diff    = (intptr_t)cell->sequence.load(std::memory_order_acquire) - (intptr_t)pos;
+    if (diff == 0) {
+      // The cell is empty: claim the position, or retry from wherever another producer has moved it to
+      if (queue->push_pos.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed)) {
+        cell->item = item;
+        cell->sequence.store(pos+1, std::memory_order_release);
+        sem_post(&queue->items);
+        return;
+      }
+    } else if (diff < 0) {
+      std::this_thread::yield();   // the cell still holds the item pushed one lap ago, which is being popped
+      pos = queue->push_pos.load(std::memory_order_relaxed);
+    } else
+      pos = queue->push_pos.load(std::memory_order_relaxed);
+  }
+}
+
+/**
+ * @brief Takes an item from a cell once an item has been claimed from the semaphore. The producer of the cell's item may not yet have published it,
+ * so the pop is retried until it has.
+ *
+ * @param queue The queue
+ * @return void*: the popped item
+ */
+void* lockfree_queue_take(lockfree_queue* queue) {
+  size_t pos = queue->pop_pos.load(std::memory_order_relaxed);
+  while (true) {
+    queue_cell* cell = &queue->cells[pos & queue->mask];
+    intptr_t diff    = (intptr_t)cell->sequence.load(std::memory_order_acquire) - (intptr_t)(pos+1);
+    if (diff == 0) {
+      // The cell is full: claim the position, or retry from wherever another consumer has moved it to
+      if (queue->pop_pos.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed)) {
+        void* item = cell->item;
+        cell->sequence.store(pos + queue->mask + 1, std::memory_order_release);
+        sem_post(&queue->slots);
+        return item;
+      }
+    } else if (diff < 0) {
+      std::this_thread::yield();   // the item has been counted but is still being pushed into the cell
+      pos = queue->pop_pos.load(std::memory_order_relaxed);
+    } else
+      pos = queue->pop_pos.load(std::memory_order_relaxed);
+  }
+}
+
+/**
+ * @brief Tries to push an item onto the queue
+ *
+ * @param queue The queue
+ * @param item The item to push
+ * @return true if the item was pushed, false if the queue is full
+ */
+bool lockfree_queue_try_push(lockfree_queue* queue, void* item) {
+  if (sem_trywait(&queue->slots) != 0)
+    return false;
+  lockfree_queue_place(queue, item);
+  return true;
+}
+
+/**
+ * @brief Tries to pop an item from the queue
+ *
+ * @param queue The queue
+ * @param item Set to the popped item
+ * @return true if an item was popped, false if the queue is empty
+ */
+bool lockfree_queue_try_pop(lockfree_queue* queue, void** item) {
+  if (sem_trywait(&queue->items) != 0)
+    return false;
+  *item = lockfree_queue_take(queue);
+  return true;
+}
+
+/**
+ * @brief Pushes an item onto the queue, sleeping while it is full. This is the backpressure on a producer that runs ahead of its consumers.
+ *
+ * @param queue The queue
+ * @param item The item to push
+ */
+void lockfree_queue_push(lockfree_queue* queue, void* item) {
+  while (sem_wait(&queue->slots) != 0)
+    ;   // interrupted by a signal, so wait again
+  lockfree_queue_place(queue, item);
+}
+
+/**
+ * @brief Pops an item from the queue, sleeping while it is empty
+ *
+ * @param queue The queue
+ * @return void*: the popped item
+ */
+void* lockfree_queue_pop(lockfree_queue* queue) {
+  while (sem_wait(&queue->items) != 0)
+    ;   // interrupted by a signal, so wait again
+  return lockfree_queue_take(queue);
+}
+
+/**
+ * @brief Frees the memory used by a queue. Any items still in the queue are not freed.
+ *
+ * @param queue The queue
+ */
+void free_lockfree_queue(lockfree_queue* queue) {
+  sem_destroy(&queue->items);
+  sem_destroy(&queue->slots);
+  delete[] queue->cells;
+  queue->cells = NULL;
+}
+
+#endif /* LOCKFREEQUEUE_H */
@@ -0,0 +1,224 @@
+//
+// multiplicityBounds.h
+// Functions that apply per-index minimum and maximum multiplicity constraints to combinations and partial combinations.
+// Used by zeroboard and subsetSummer.
+//
+
+#ifndef MULTIPLICITYBOUNDS_H
+#define MULTIPLICITYBOUNDS_H
+
+#include <stdint.h>
+
+#include "queryOptions.h"
+
+// Slack used when comparing bounded sums against the query value, so that floating point noise does not exclude valid combinations
+#define BOUND_SLACK 1e-9
+
+
+/**
+ * @brief Checks whether a query requires multiplicity constraints to be applied
+ *
+ * @param options The query options, may be NULL
+ * @return true if minimum or maximum multiplicities are set
+ */
+bool has_multiplicity_bounds(query_options* options) {
+  return options != NULL && (options->min_multiplicity != NULL || options->max_multiplicity != NULL);
+}
+
+/**
+ * @brief Checks a complete combination against the multiplicity constraints. The combination is made up of a prefix and a suffix, both sorted, where the suffix starts at or after the last index of the prefix.
+ *
+ * @param options The query options holding the multiplicity constraints
+ * @param prefix The prefix indexes, may be NULL if prefix_len is 0
+ * @param prefix_len The number of indexes in the prefix
+ * @param suffix The suffix indexes, may be NULL if suffix_len is 0
+ * @param suffix_len The number of indexes in the suffix
+ * @return true if every index appears between its minimum and maximum number of times
+ */
+bool within_multiplicity_bounds(
+  query_options* options,
+  int* prefix,
+  int prefix_len,
+  const uint16_t* suffix,
+  int suffix_len )
+{
+  int *min_mult = options->min_multiplicity,
+      *max_mult = options->max_multiplicity,
+      total     = prefix_len + suffix_len,
+      unchecked = 0,    // The next index whose minimum has not been checked
+      i         = 0;
+
+  // Walk the runs of equal indexes; prefix followed by suffix is sorted so each index forms a single run
+  while (i < total) {
+    int index = (i < prefix_len) ? prefix[i] : suffix[i-prefix_len],
+        count = 0;
+    while (i < total && ((i < prefix_len) ? prefix[i] : suffix[i-prefix_len]) == index) {
+      ++count;
+      ++i;
+    }
+    if (max_mult != NULL && max_mult[index] >= 0 && count > max_mult[index])
+      return false;
+    if (min_mult != NULL) {
+      // Indexes skipped over by the walk appear zero times
+      for (; unchecked < index; ++unchecked)
+        if (min_mult[unchecked] > 0)
+          return false;
+      if (count < min_mult[index])
+        return false;
+      unchecked = index+1;
+    }
+  }
+  if (min_mult != NULL)
+    for (; unchecked < options->input_set_size; ++unchecked)
+      if (min_mult[unchecked] > 0)
+        return false;
+
+  return true;
+}
+
+/**
+ * @brief Checks a combination made up of a single input set index repeated count times against the multiplicity constraints
+ *
+ * @param options The query options holding the multiplicity constraints
+ * @param index The repeated index
+ * @param count The number of repetitions
+ * @return true if the combination satisfies the constraints
+ */
+bool uniform_within_multiplicity_bounds(query_options* options, int index, int count) {
+  if (options->max_multiplicity != NULL && options->max_multiplicity[index] >= 0 && count > options->max_multiplicity[index])
+    return false;
+  if (options->min_multiplicity != NULL)
+    for (int i=0; i<options->input_set_size; ++i)
+      if (options->min_multiplicity[i] > (i == index ? count : 0))
+        return false;
+  return true;
+}
+
+/**
+ * @brief Checks whether a sorted prefix has passed an index whose minimum it does not meet.
+ * Because the rest of a combination only uses indexes >= the last prefix index, such a prefix, and every prefix after it in the search, can never be completed.
+ *
+ * @param options The query options holding the multiplicity constraints
+ * @param prefix The sorted prefix
+ * @param prefix_len The number of indexes in the prefix
+ * @return true if a minimum can no longer be met
+ */
+bool prefix_misses_minimum(query_options* options, int* prefix, int prefix_len) {
+  if (options->min_multiplicity == NULL || prefix_len == 0)
+    return false;
+  int last = prefix[prefix_len-1],
+      i    = 0;
+  for (int index=0; index<last; ++index) {
+    int count = 0;
+    while (i < prefix_len && prefix[i] == index) {
+      ++count;
+      ++i;
+    }
+    if (count < options->min_multiplicity[index])
+      return true;
+  }
+  return false;
+}
+
+/**
+ * @brief Decides whether a sorted prefix can be completed to a combination within the multiplicity constraints whose sum could reach the target.
+ * The smallest and largest completions are built greedily from the indexes >= the last prefix index, first placing the copies required by the minimums
+ * and then filling the remaining positions with the smallest (or largest) values whose maximums allow it.
+ *
+ * @param options The query options holding the multiplicity constraints
+ * @param input_set The input set
+ * @param prefix The sorted prefix
+ * @param prefix_len The number of indexes in the prefix
+ * @param remaining The number of values still to be added to the prefix
+ * @param target The target value
+ * @param tolerance The amount by which a sum can differ from the target
+ * @return true if the bounded range of completed sums includes the target
+ */
+bool bounded_prefix_can_reach(
+  query_options* options,
+  double* input_set,
+  int* prefix,
+  int prefix_len,
+  int remaining,
+  double target,
+  double tolerance )
+{
+  int *min_mult = options->min_multiplicity,
+      *max_mult = options->max_multiplicity,
+      n         = options->input_set_size,
+      first     = (prefix_len > 0) ? prefix[prefix_len-1] : 0;
+
+  // Sum the prefix and reject it if a run already breaks a maximum
+  double prefix_sum = 0.0;
+  int    last_run   = 0;
+  for (int i=0; i<prefix_len; ++i) {
+    prefix_sum += input_set[prefix[i]];
+    last_run = (i > 0 && prefix[i] == prefix[i-1]) ? last_run+1 : 1;
+    if (max_mult != NULL && max_mult[prefix[i]] >= 0 && last_run > max_mult[prefix[i]])
+      return false;
+  }
+  if (prefix_misses_minimum(options, prefix, prefix_len))
+    return false;
+
+  // Place the copies that the minimums require
+  double required_sum = 0.0;
+  int    required     = 0;
+  if (min_mult != NULL) {
+    for (int i=first; i<n; ++i) {
+      int used  = (prefix_len > 0 && i == first) ? last_run : 0,
+          extra = min_mult[i] - used;
+      if (extra > 0) {
+        if (max_mult != NULL && max_mult[i] >= 0 && min_mult[i] > max_mult[i])
+          return false;
+        required     += extra;
+        required_sum += extra*input_set[i];
+      }
+    }
+  }
+  if (required > remaining)
+    return false;
+
+  // Fill the positions that are left with the smallest, then the largest, values allowed
+  double bound_sums[2];
+  for (int side=0; side<2; ++side) {
+    int    left = remaining - required;
+    double sum  = required_sum;
+    for (int step=0; step<n-first && left>0; ++step) {
+      int i    = (side == 0) ? first+step : n-1-step,
+          used = (prefix_len > 0 && i == first) ? last_run : 0;
+      if (min_mult != NULL && min_mult[i] > used)
+        used = min_mult[i];
+      int capacity = (max_mult == NULL || max_mult[i] < 0) ? left : max_mult[i] - used;
+      if (capacity > left)
+        capacity = left;
+      if (capacity > 0) {
+        sum  += capacity*input_set[i];
+        left -= capacity;
+      }
+    }
+    if (left > 0)
+      return false;
+    bound_sums[side] = sum;
+  }
+
+  return prefix_sum + bound_sums[0] <= target + tolerance + BOUND_SLACK
+      && prefix_sum + bound_sums[1] >= target - tolerance - BOUND_SLACK;
+}
+
+/**
+ * @brief Counts the indexes that have a positive minimum multiplicity, and records the count in the query options
+ *
+ * @param options The query options holding the multiplicity constraints
+ * @return int: the number of indexes that every combination must use
+ */
+int count_required_indexes(query_options* options) {
+  int required = 0;
+  if (options->min_multiplicity != NULL)
+    for (int i=0; i<options->input_set_size; ++i)
+      if (options->min_multiplicity[i] > 0)
+        ++required;
+  options->required_indexes = required;
+  return required;
+}
+
+#endif /* MULTIPLICITYBOUNDS_H */
@@ -0,0 +1,312 @@
+//
+// partialBoard.h
+// Query-directed partial zeroboards. When the query values are known before the zeroboard is written, only combinations whose tare sums can be
+// probed by one of those queries need to be stored: a combination of length k is only read as the suffix of a longer combination, so its sum is at
+// most the query value less the smallest input set value, and a shorter combination is only read when its own sum matches a query value.
+// The reachable tare sums of each length form a few windows, and enumeration skips every part of the search space that cannot land in one.
+// Used alongside UnboundedSubsetSum.
+//
+
+#ifndef PARTIALBOARD_H
+#define PARTIALBOARD_H
+
+#include <algorithm>
+
+#include "unboundedSubsetSum.h"
+
+/**
+ * @brief A range of tare sums that queries can probe
+ *
+ * @param lo The smallest tare sum
+ * @param hi The largest tare sum
+ */
+struct tare_window {
+  double lo;
+  double hi;
+};
+
+/**
+ * @brief The tare sums that a batch of queries can probe, for each combination length stored in the zeroboard
+ *
+ * @param search_space_comb_len The zeroboard combination length
+ * @param num_windows The number of windows for each length, indexed by length
+ * @param windows The windows for each length, indexed by length, sorted and not overlapping
+ */
+struct board_windows {
+  int search_space_comb_len;
+  int* num_windows;
+  tare_window** windows;
+};
+
+
+/**
+ * @brief Sorts windows and merges those that overlap
+ *
+ * @param windows The windows
+ * @param count The number of windows
+ * @return int: the number of windows once merged
+ */
+int merge_tare_windows(tare_window* windows, int count) {
+  if (count == 0)
+    return 0;
+  std::sort(windows, windows + count, [](const tare_window& a, const tare_window& b) { return a.lo < b.lo; });
+  int merged = 0;
+  for (int i=1; i<count; ++i) {
+    if (windows[i].lo <= windows[merged].hi) {
+      if (windows[i].hi > windows[merged].hi)
+        windows[merged].hi = windows[i].hi;
+    } else
+      windows[++merged] = windows[i];
+  }
+  return merged+1;
+}
+
+/**
+ * @brief Calculates the tare sums that a batch of queries can probe. A query value q probes the combinations of each length whose sum is within
+ * the tolerance of q; and, if it has combinations longer than the zeroboard combination length, the combinations of that length whose sum is
+ * at most q less the smallest input set value, as they are the suffixes that complete a prefix.
+ *
+ * @param windows The windows to calculate
+ * @param input_set The processed input set
+ * @param n The number of values in the input set
+ * @param search_space_comb_len The zeroboard combination length
+ * @param query_values The query values of the batch
+ * @param num_queries The number of query values
+ * @param epsilon The amount by which query values can vary
+ */
+void init_board_windows(
+  board_windows* windows,
+  double* input_set,
+  int n,
+  int search_space_comb_len,
+  double* query_values,
+  int num_queries,
+  double epsilon )
+{
+  double input_set_min = input_set[0],
+         input_set_max = input_set[n-1],
+         // probes read every bin within epsilon of the probed tare value but report only the combinations within epsilon, so the tolerance covers epsilon and rounding
+         tolerance     = epsilon + BOUND_SLACK;
+  windows->search_space_comb_len = search_space_comb_len;
+  windows->num_windows = (int*)malloc(sizeof(int)*(search_space_comb_len+1));
+  windows->windows     = (tare_window**)malloc(sizeof(tare_window*)*(search_space_comb_len+1));
+  if (windows->num_windows == NULL || windows->windows == NULL) {
+    printf("Error: unable to allocate the tare windows of %d queries\n", num_queries);
+    exit(EXIT_FAILURE);
+  }
+  windows->num_windows[0] = 0;
+  windows->windows[0]     = NULL;
+
+  for (int len=1; len<=search_space_comb_len; ++len) {
+    tare_window* list  = (tare_window*)malloc(sizeof(tare_window)*2*num_queries);
+    int          count = 0;
+    if (list == NULL) {
+      printf("Error: unable to allocate the tare windows of %d queries\n", num_queries);
+      exit(EXIT_FAILURE);
+    }
+    double len_max = len*input_set_max;
+    for (int q=0; q<num_queries; ++q) {
+      // the combinations of this length that sum to the query value
+      list[count].lo   = len_max - (query_values[q] + tolerance);
+      list[count++].hi = len_max - (query_values[q] - tolerance);
+      // the suffixes of longer combinations, which follow a prefix of at least one value
+      if (len == search_space_comb_len && query_values[q] + tolerance >= (len+1)*input_set_min) {
+        list[count].lo   = len_max - (query_values[q] + tolerance - input_set_min);
+        list[count++].hi = HUGE_VAL;
+      }
+    }
+    windows->num_windows[len] = merge_tare_windows(list, count);
+    windows->windows[len]     = list;
+  }
+}
+
+/**
+ * @brief Checks whether a range of tare sums overlaps any window of a combination length
+ *
+ * @param windows The windows
+ * @param len The combination length
+ * @param lo The smallest tare sum of the range
+ * @param hi The largest tare sum of the range
+ * @return true if some tare sum in the range can be probed
+ */
+bool tare_range_probed(board_windows* windows, int len, double lo, double hi) {
+  tare_window* list  = windows->windows[len];
+  int          count = windows->num_windows[len];
+  // find the first window that ends at or after lo; the range is probed if that window starts at or before hi
+  int first = 0,
+      last  = count;
+  while (first < last) {
+    int mid = (first + last) / 2;
+    if (list[mid].hi < lo)
+      first = mid+1;
+    else
+      last = mid;
+  }
+  return first < count && list[first].lo <= hi;
+}
+
+/**
+ * @brief The enumerate_combinations() visitor of a partial zeroboard: a value is skipped when no completion of the partial combination can land in
+ * a window of its length, the enumeration of a length stops once the largest completion falls below every window, and only combinations that land
+ * in a window are written
+ *
+ * @param zeroboard The zeroboard to write into
+ * @param dp The order of magnitude of epsilon
+ * @param windows The windows of the batch
+ * @param written The number of combinations written
+ */
+struct partial_writer {
+  Board*         zeroboard;
+  double         dp;
+  board_windows* windows;
+  unsigned long  written;
+
+  int prefix(int len, int /* pos */, double smallest, double largest) {
+    if (largest < windows->windows[len][0].lo)
+      return COMBINATION_STOP;
+    return tare_range_probed(windows, len, smallest, largest) ? COMBINATION_EXTEND : COMBINATION_SKIP;
+  }
+
+  void combination(double key, uint16_t* combination, int len) {
+    if (tare_range_probed(windows, len, key, key)) {
+      board_insert(zeroboard, key, dp, combination, len);
+      ++written;
+    }
+  }
+};
+
+/**
+ * @brief Writes the combinations that a batch of queries can probe into the zeroboard; the zeroboard then answers any query of the batch, and
+ * only those, in the same way as the full zeroboard written by writeZeroBoard()
+ *
+ * @param input_set The processed input set
+ * @param zeroboard The zeroboard to write combinations and sums into
+ * @param n The number of values in the input set
+ * @param windows The windows of the batch, see init_board_windows()
+ * @param dp The order of magnitude of epsilon
+ * @return unsigned long: the number of combinations written
+ */
+unsigned long writePartialZeroBoard(
+  double* input_set,
+  Board* zeroboard,
+  int n,
+  board_windows* windows,
+  double dp )
+{
+  double tare[n];
+  for (int i=0; i<n; ++i)
+    tare[i] = input_set[n-1] - input_set[i];
+  uint16_t       combination[windows->search_space_comb_len];
+  partial_writer writer = { zeroboard, dp, windows, 0 };
+  // Longest combinations first, as in writeZeroBoard(), so every list is ordered from shortest to longest combination
+  for (int len=windows->search_space_comb_len; len>=1; --len)
+    if (windows->num_windows[len] > 0)
+      enumerate_combinations(tare, n, combination, len, 0, 0.0, writer);
+  return writer.written;
+}
+
+/**
+ * @brief Frees the memory used by the windows of a batch
+ *
+ * @param windows The windows
+ */
+void free_board_windows(board_windows* windows) {
+  for (int len=0; len<=windows->search_space_comb_len; ++len)
+    free(windows->windows[len]);
+  free(windows->windows);
+  free(windows->num_windows);
+}
+
+/**
+ * @brief Counts the combinations that the full zeroboard holds, i.e. the multisets of every length up to the zeroboard combination length
+ *
+ * @param n The number of values in the input set
+ * @param search_space_comb_len The zeroboard combination length
+ * @return double: the number of combinations
+ */
+double full_zeroboard_combinations(int n, int search_space_comb_len) {
+  double total = 0.0,
+         count = 1.0;
+  for (int len=1; len<=search_space_comb_len; ++len) {
+    count  = count*(n+len-1)/len;
+    total += count;
+  }
+  return total;
+}
+
+/**
+ * @brief Runs the algorithm for a batch of query values over one zeroboard that holds only the combinations those queries can probe.
+ * The zeroboard combination length is chosen for the largest query value. Ranked, multiplicity constrained and subset queries are supported;
+ * the fixed-point engine is not.
+ *
+ * @param input_set The input set: a pointer to the first item in an array of double type values
+ * @param input_set_size The number of items in the input set
+ * @param query_values The target values to which combinations must sum
+ * @param num_queries The number of target values
+ * @param epsilon The value that each target value can vary by
+ * @param print_times Require printing of runtimes for writing the partial zeroboard and querying it
+ * @param print_comb Require printing of all commbinations summing to each target value
+ * @param print_details Require printing of details about the algorithm run, including how much of the full zeroboard was written
+ * @param options Optional query settings applied to every query, as for unboundedSubsetSum()
+ */
+void unboundedSubsetSumBatch(
+  double* input_set,
+  int input_set_size,
+  double* query_values,
+  int num_queries,
+  double epsilon,
+  int print_times,
+  int print_comb,
+  int print_details,
+  query_options* options = NULL )
+{
+  if (num_queries <= 0)
+    return;
+  if (options != NULL && options->fixed_point_scale > 0) {
+    printf("\nERROR: Partial zeroboards cannot be used by the fixed-point engine\n\n");
+    exit(EXIT_FAILURE);
+  }
+  int     search_space_comb_len = 0,
+          search_space_min      = SEARCH_SPACE_MIN;
+  double  dp_precision          = 0.0,
+          largest               = process_query_values(input_set, input_set_size, query_values, num_queries, epsilon, &dp_precision, &search_space_comb_len,
+                                                       search_space_min, SEARCH_SPACE_MAX, print_details);
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  trace_span build_span;
+  begin_trace_span(&build_span, query_tracer(options), "build", "comb_len", search_space_comb_len);
+  board_windows windows;
+  init_board_windows(&windows, input_set, input_set_size, search_space_comb_len, query_values, num_queries, epsilon);
+  Board zeroboard;
+  unsigned long written = writePartialZeroBoard(input_set, &zeroboard, input_set_size, &windows, dp_precision);
+  if (has_multiplicity_bounds(options))
+    summarise_multiplicities(&zeroboard, input_set_size);
+  if (has_index_mask(options))
+    summarise_index_masks(&zeroboard, input_set_size);
+  end_trace_span(&build_span);
+  std::chrono::steady_clock::time_point built = std::chrono::steady_clock::now();
+  if (print_details)
+    printf("Partial zeroboard: %lu of %.0f combinations written\n", written, full_zeroboard_combinations(input_set_size, search_space_comb_len));
+
+  // the reachability table built for the largest query value covers every other query
+  reachability_cache reachability;
+  init_reachability_cache(&reachability);
+  for (int q=0; q<num_queries; ++q) {
+    const reachability_table* reachability_ptr = NULL;
+    if (options != NULL)
+      reachability_ptr = cached_reachability_table(&reachability, input_set, input_set_size, largest, epsilon + 1.0/bin_scale(dp_precision), options->reachability_scale);
+    queryZeroBoard(input_set, input_set_size, &zeroboard, search_space_comb_len, search_space_min, dp_precision, query_values[q], epsilon, 0, print_details, print_comb, options, reachability_ptr);
+  }
+  free_reachability_cache(&reachability);
+  std::chrono::steady_clock::time_point queried = std::chrono::steady_clock::now();
+
+  delete_zeroboard(&zeroboard);
+  free_board_windows(&windows);
+
+  if (print_times) {
+    printf("%f seconds to create partial zeroboard\n", std::chrono::duration<double>(built - start).count());
+    printf("%f seconds to query zeroboard %d times\n\n", std::chrono::duration<double>(queried - built).count(), num_queries);
+  }
+}
+
+#endif /* PARTIALBOARD_H */
@@ -0,0 +1,299 @@
+//
+// perfCounters.h
+// Hardware performance counters, read through Linux perf_event_open, for profiling the write, query and delete phases of the algorithm.
+// The counters are opened as one group led by the cycle counter, so that the kernel schedules them onto the hardware together; a counter that
+// cannot join the group is counted on its own. When the kernel has to multiplex counters, each count is scaled up by the time it was enabled over
+// the time it was counting, and the fraction of the time it was counting is reported with it.
+// Where the counters cannot be opened (other operating systems, restricted perf_event_paranoid settings, containers), they are reported as not available.
+// Used by UnboundedSubsetSum.
+//
+
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// The counters collected for each phase
+#define PERF_CYCLES         0
+#define PERF_INSTRUCTIONS   1
+#define PERF_LLC_MISSES     2
+#define PERF_DTLB_MISSES    3
+#define PERF_BRANCH_MISSES  4
+#define NUM_PERF_COUNTERS   5
+
+// The phases of an algorithm run
+#define PHASE_WRITE   0
+#define PHASE_QUERY   1
+#define PHASE_DELETE  2
+#define NUM_PHASES    3
+
+const char* perf_counter_names[NUM_PERF_COUNTERS] = { "cycles", "instructions", "LLC misses", "dTLB misses", "branch mispredicts" };
+const char* phase_names[NUM_PHASES] = { "write", "query", "delete" };
+
+/**
+ * @brief The open counters of the calling thread
+ *
+ * @param fd File descriptor of each counter; -1 if the counter is not available
+ * @param grouped Whether each counter belongs to the group led by the cycle counter, and so is reset, started and stopped with it
+ * @param start_enabled The time each counter had been enabled when counting started; resetting a counter does not reset its times
+ * @param start_running The time each counter had been counting when counting started
+ */
+struct perf_counters {
+  int      fd[NUM_PERF_COUNTERS];
+  bool     grouped[NUM_PERF_COUNTERS];
+  uint64_t start_enabled[NUM_PERF_COUNTERS];
+  uint64_t start_running[NUM_PERF_COUNTERS];
+};
+
+/**
+ * @brief Counter values for each phase, summed over every algorithm run the profile is passed to
+ *
+ * @param runs Number of algorithm runs profiled
+ * @param value The summed value of each counter in each phase, as counted; see scale_perf_count()
+ * @param time_enabled The summed time, in nanoseconds, that each counter was enabled in each phase
+ * @param time_running The summed time, in nanoseconds, that each counter was counting in each phase; less than time_enabled if it was multiplexed
+ * @param available Whether each counter could be read; false if it was not available in any run
+ */
+struct perf_profile {
+  int       runs;
+  long long value[NUM_PHASES][NUM_PERF_COUNTERS];
+  long long time_enabled[NUM_PHASES][NUM_PERF_COUNTERS];
+  long long time_running[NUM_PHASES][NUM_PERF_COUNTERS];
+  bool      available[NUM_PERF_COUNTERS];
+};
+
+
+/**
+ * @brief Sets a profile to zero runs, with every counter available until a run shows otherwise
+ *
+ * @param profile The profile to initialise
+ */
+void init_perf_profile(perf_profile* profile) {
+  memset(profile, 0, sizeof(perf_profile));
+  for (int i=0; i<NUM_PERF_COUNTERS; ++i)
+    profile->available[i] = true;
+}
+
+/**
+ * @brief Opens the counters for the calling thread, user space only, as one group led by the cycle counter. A counter that cannot join the group,
+ * or every counter if the cycle counter cannot be opened, is opened on its own. They start disabled; see start_perf_counters().
+ *
+ * @param counters The counters to open
+ */
+void open_perf_counters(perf_counters* counters) {
+  for (int i=0; i<NUM_PERF_COUNTERS; ++i) {
+    counters->fd[i]            = -1;
+    counters->grouped[i]       = false;
+    counters->start_enabled[i] = 0;
+    counters->start_running[i] = 0;
+  }
+#ifdef __linux__
+  const unsigned int types[NUM_PERF_COUNTERS] = { PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE };
+  const unsigned long long configs[NUM_PERF_COUNTERS] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+    PERF_COUNT_HW_BRANCH_MISSES
+  };
+  int leader = -1;
+  for (int i=0; i<NUM_PERF_COUNTERS; ++i) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size           = sizeof(attr);
+    attr.type           = types[i];
+    attr.config         = configs[i];
+    attr.read_format    = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+    // members of the group follow the leader, which starts disabled
+    if (leader >= 0) {
+      attr.disabled   = 0;
+      counters->fd[i] = (int)syscall(__NR_perf_event_open, &attr, 0, -1, leader, 0);
+      if (counters->fd[i] >= 0) {
+        counters->grouped[i] = true;
+        continue;
+      }
+    }
+    attr.disabled   = 1;
+    counters->fd[i] = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    if (i == PERF_CYCLES && counters->fd[i] >= 0) {
+      leader               = counters->fd[i];
+      counters->grouped[i] = true;
+    }
+  }
+#endif
+}
+
+/**
+ * @brief Reads a counter: its count, the time it has been enabled and the time it has been counting
+ *
+ * @param fd The file descriptor of the counter
+ * @param values Set to the count, the time enabled and the time running
+ * @return true if the counter could be read
+ */
+bool read_perf_counter(int fd, uint64_t* values) {
+#ifdef __linux__
+  return fd >= 0 && read(fd, values, 3*sizeof(uint64_t)) == (ssize_t)(3*sizeof(uint64_t));
+#else
+  (void)fd;
+  (void)values;
+  return false;
+#endif
+}
+
+/**
+ * @brief Resets the counters to zero and starts counting
+ *
+ * @param counters The open counters
+ */
+void start_perf_counters(perf_counters* counters) {
+#ifdef __linux__
+  for (int i=0; i<NUM_PERF_COUNTERS; ++i) {
+    if (counters->fd[i] < 0 || (counters->grouped[i] && i != PERF_CYCLES))
+      continue;
+    // the leader resets its whole group
+    ioctl(counters->fd[i], PERF_EVENT_IOC_RESET, counters->grouped[i] ? PERF_IOC_FLAG_GROUP : 0);
+  }
+  for (int i=0; i<NUM_PERF_COUNTERS; ++i) {
+    uint64_t values[3] = { 0, 0, 0 };
+    read_perf_counter(counters->fd[i], values);
+    counters->start_enabled[i] = values[1];
+    counters->start_running[i] = values[2];
+  }
+  // and enables its whole group
+  for (int i=0; i<NUM_PERF_COUNTERS; ++i)
+    if (counters->fd[i] >= 0 && (!counters->grouped[i] || i == PERF_CYCLES))
+      ioctl(counters->fd[i], PERF_EVENT_IOC_ENABLE, counters->grouped[i] ? PERF_IOC_FLAG_GROUP : 0);
+#endif
+}
+
+/**
+ * @brief Scales a count up to the whole time its counter was enabled, for counters that the kernel multiplexed with others
+ *
+ * @param count The count
+ * @param enabled The time the counter was enabled
+ * @param running The time the counter was counting
+ * @return long long: the scaled count, or -1 if the counter was enabled but never counted
+ */
+long long scale_perf_count(long long count, long long enabled, long long running) {
+  if (running >= enabled)
+    return count;
+  if (running <= 0)
+    return -1;
+  return (long long)((double)count*enabled/running);
+}
+
+/**
+ * @brief Stops counting and adds the counts, and the times the counters were enabled and counting, to a phase of the profile
+ *
+ * @param counters The open counters
+ * @param profile The profile to add the counts to
+ * @param phase The phase that was counted
+ * @param counts If not NULL, set to the scaled counts of this phase alone, or -1 for counters that are not available or did not count
+ * @param coverage If not NULL, set to the fraction of this phase that each counter was counting
+ */
+void stop_perf_counters(perf_counters* counters, perf_profile* profile, int phase, long long* counts, double* coverage) {
+#ifdef __linux__
+  for (int i=0; i<NUM_PERF_COUNTERS; ++i)
+    if (counters->fd[i] >= 0 && (!counters->grouped[i] || i == PERF_CYCLES))
+      ioctl(counters->fd[i], PERF_EVENT_IOC_DISABLE, counters->grouped[i] ? PERF_IOC_FLAG_GROUP : 0);
+#endif
+  for (int i=0; i<NUM_PERF_COUNTERS; ++i) {
+    long long count   = -1,
+              enabled = 0,
+              running = 0;
+    // value, time enabled, time running
+    uint64_t values[3];
+    if (read_perf_counter(counters->fd[i], values)) {
+      count   = (long long)values[0];
+      enabled = (long long)(values[1] - counters->start_enabled[i]);
+      running = (long long)(values[2] - counters->start_running[i]);
+      profile->value[phase][i]        += count;
+      profile->time_enabled[phase][i] += enabled;
+      profile->time_running[phase][i] += running;
+      count = scale_perf_count(count, enabled, running);
+    } else
+      profile->available[i] = false;
+    if (counts != NULL)
+      counts[i] = count;
+    if (coverage != NULL)
+      coverage[i] = (enabled > 0) ? (double)running/enabled : 1.0;
+  }
+}
+
+/**
+ * @brief Closes the counters, members of the group before its leader
+ *
+ * @param counters The open counters
+ */
+void close_perf_counters(perf_counters* counters) {
+#ifdef __linux__
+  for (int i=NUM_PERF_COUNTERS-1; i>=0; --i)
+    if (counters->fd[i] >= 0)
+      close(counters->fd[i]);
+#endif
+  for (int i=0; i<NUM_PERF_COUNTERS; ++i) {
+    counters->fd[i]      = -1;
+    counters->grouped[i] = false;
+  }
+}
+
+/**
+ * @brief Prints the counts of one phase, with instructions per cycle when both are available. Counts that were scaled because the counter was
+ * multiplexed are followed by the percentage of the phase that the counter was counting.
+ *
+ * @param phase The phase that was counted
+ * @param counts The counts, where -1 means the counter was not available or never counted
+ * @param coverage The fraction of the phase that each counter was counting; NULL if not known
+ */
+void print_phase_counts(int phase, long long* counts, double* coverage) {
+  printf("%s phase:", phase_names[phase]);
+  for (int i=0; i<NUM_PERF_COUNTERS; ++i) {
+    if (counts[i] < 0)
+      printf("  %s n/a", perf_counter_names[i]);
+    else if (coverage != NULL && coverage[i] < 1.0)
+      printf("  %s %lld (scaled, counted %.0f%%)", perf_counter_names[i], counts[i], 100.0*coverage[i]);
+    else
+      printf("  %s %lld", perf_counter_names[i], counts[i]);
+  }
+  if (counts[PERF_CYCLES] > 0 && counts[PERF_INSTRUCTIONS] >= 0)
+    printf("  IPC %.2f", (double)counts[PERF_INSTRUCTIONS]/counts[PERF_CYCLES]);
+  printf("\n");
+}
+
+/**
+ * @brief Prints the counts of every phase summed over the runs in a profile, and the average per run
+ *
+ * @param profile The profile
+ */
+void print_perf_profile(perf_profile* profile) {
+  printf("Hardware counters over %d run(s):\n", profile->runs);
+  for (int phase=0; phase<NUM_PHASES; ++phase) {
+    long long counts[NUM_PERF_COUNTERS];
+    double    coverage[NUM_PERF_COUNTERS];
+    for (int i=0; i<NUM_PERF_COUNTERS; ++i) {
+      counts[i]   = profile->available[i] ? scale_perf_count(profile->value[phase][i], profile->time_enabled[phase][i], profile->time_running[phase][i]) : -1;
+      coverage[i] = (profile->time_enabled[phase][i] > 0) ? (double)profile->time_running[phase][i]/profile->time_enabled[phase][i] : 1.0;
+    }
+    print_phase_counts(phase, counts, coverage);
+    if (profile->runs > 1) {
+      for (int i=0; i<NUM_PERF_COUNTERS; ++i)
+        if (counts[i] >= 0)
+          counts[i] /= profile->runs;
+      printf("  per run, ");
+      print_phase_counts(phase, counts, coverage);
+    }
+  }
+}
+
+#endif /* PERFCOUNTERS_H */
@@ -0,0 +1,379 @@
+//
+// pipeline.h
+// Runs the algorithm over a peak-list file as a pipeline: a parser stage, a pool of query workers sharing one zeroboard, and an ordered writer stage,
+// connected by bounded lock-free queues so that reading, querying and writing overlap. A stage with nothing to do sleeps on a semaphore.
+//
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <fcntl.h>
+#include <semaphore.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <chrono>
+
+#include "unboundedSubsetSum.h"
+#include "lockFreeQueue.h"
+
+/**
+ * @brief A spectrum from the peak list, passed from stage to stage
+ *
+ * @param seq The position of the spectrum in the peak list, used by the writer to keep the output in order
+ * @param num_peaks Number of peaks in the spectrum
+ * @param peaks The peak values, each of which is queried
+ * @param output The query output for every peak, written by a query worker
+ * @param output_len Length of the output
+ */
+struct pipeline_job {
+  long    seq;
+  int     num_peaks;
+  double* peaks;
+  char*   output;
+  size_t  output_len;
+};
+
+/**
+ * @brief The state shared by the stages of the pipeline
+ *
+ * @param input_set The processed input set
+ * @param input_set_size The number of values in the processed input set
+ * @param zeroboard The zeroboard shared by every query worker; it is only read once the pipeline starts
+ * @param search_space_comb_len The zeroboard combination length
+ * @param search_space_min The minimum combination length of the search space
+ * @param dp The order of magnitude of epsilon
+ * @param epsilon The amount by which each peak value can vary
+ * @param print_comb Require printing of all combinations summing to each peak value
+ * @param print_details Require printing of the number of combinations of each length
+ * @param options Query options applied to every peak; each worker queries through its own copy, with its own output and status
+ * @param worker_status The status of each worker's queries, combined once every worker has finished
+ * @param parsed Queue of parsed spectra waiting for a query worker
+ * @param queried Queue of queried spectra waiting for the writer
+ * @param window The most spectra that can be in the pipeline at once, i.e. parsed but not yet written
+ * @param window_slots Counts the spectra that can still enter the pipeline; the parser waits on it and the writer posts it
+ * @param jobs_parsed Number of spectra read by the parser
+ * @param workers_running Number of query workers that have not yet finished; the last to finish tells the writer there is no more input
+ * @param output The stream that the writer writes to
+ */
+struct pipeline_state {
+  double* input_set;
+  int     input_set_size;
+  const Board* zeroboard;
+  int     search_space_comb_len;
+  int     search_space_min;
+  double  dp;
+  double  epsilon;
+  int     print_comb;
+  int     print_details;
+  query_options* options;
+  query_status*  worker_status;
+  lockfree_queue parsed;
+  lockfree_queue queried;
+  long    window;
+  sem_t   window_slots;
+  std::atomic<long> jobs_parsed;
+  std::atomic<int>  workers_running;
+  FILE*   output;
+};
+
+
+/**
+ * @brief The parser stage. Memory-maps the peak list and passes each spectrum on to the query workers, sleeping whenever the pipeline already holds its window of spectra.
+ * Each non-empty line of the peak list is one spectrum: its peak values separated by whitespace or commas. Lines starting with '#' are skipped.
+ *
+ * @param state The pipeline state
+ * @param peak_file Path to the peak list
+ * @param num_workers Number of query workers, each of which is sent an end-of-input marker
+ */
+void pipeline_parse(pipeline_state* state, const char* peak_file, int num_workers) {
+  int fd = open(peak_file, O_RDONLY);
+  struct stat file_stat;
+  if (fd < 0 || fstat(fd, &file_stat) != 0) {
+    printf("Error: cannot open peak list %s\n", peak_file);
+    exit(EXIT_FAILURE);
+  }
+  size_t size = (size_t)file_stat.st_size;
+  const char* data = NULL;
+  if (size > 0) {
+    data = (const char*)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      printf("Error: cannot memory-map peak list %s\n", peak_file);
+      exit(EXIT_FAILURE);
+    }
+    madvise((void*)data, size, MADV_SEQUENTIAL);
+  }
+
+  long   seq = 0;
+  size_t pos = 0;
+  while (pos < size) {
+    // Find the end of the line
+    size_t end = pos;
+    while (end < size && data[end] != '\n')
+      ++end;
+
+    if (data[pos] != '#') {
+      // Read the peaks; each number is copied out first since the mapped file is not null terminated
+      int     num_peaks = 0,
+              capacity  = 16;
+      double* peaks     = (double*)malloc(sizeof(double)*capacity);
+      size_t  i         = pos;
+      while (i < end) {
+        while (i < end && (data[i] == ' ' || data[i] == '\t' || data[i] == ',' || data[i] == '\r'))
+          ++i;
+        char   number[64];
+        size_t len = 0;
+        while (i < end && data[i] != ' ' && data[i] != '\t' && data[i] != ',' && data[i] != '\r') {
+          if (len < sizeof(number)-1)
+            number[len++] = data[i];
+          ++i;
+        }
+        if (len == 0)
+          continue;
+        number[len] = '\0';
+        if (num_peaks == capacity) {
+          capacity *= 2;
+          peaks = (double*)realloc(peaks, sizeof(double)*capacity);
+        }
+        peaks[num_peaks++] = strtod(number, NULL);
+      }
+
+      if (num_peaks == 0)
+        free(peaks);
+      else {
+        // Backpressure: wait until the writer has made room in the window
+        while (sem_wait(&state->window_slots) != 0)
+          ;   // interrupted by a signal, so wait again
+        pipeline_job* job = (pipeline_job*)malloc(sizeof(pipeline_job));
+        job->seq        = seq++;
+        job->num_peaks  = num_peaks;
+        job->peaks      = peaks;
+        job->output     = NULL;
+        job->output_len = 0;
+        lockfree_queue_push(&state->parsed, job);
+        state->jobs_parsed.store(seq, std::memory_order_release);
+      }
+    }
+    pos = end+1;
+  }
+
+  if (data != NULL)
+    munmap((void*)data, size);
+  close(fd);
+
+  // A NULL job tells a query worker that there is no more input
+  for (int i=0; i<num_workers; ++i)
+    lockfree_queue_push(&state->parsed, NULL);
+}
+
+/**
+ * @brief A query worker. Queries every peak of each spectrum against the shared zeroboard, capturing the output in memory so that the writer can write it in order.
+ * Each worker records the status of its queries in its own entry of worker_status: the results found, and the first query that stopped early.
+ *
+ * @param state The pipeline state
+ * @param worker The worker's index into worker_status
+ */
+void pipeline_query_worker(pipeline_state* state, int worker) {
+  query_options options;
+  if (state->options != NULL)
+    options = *state->options;
+  else
+    init_query_options(&options, state->input_set_size);
+  query_status  status,
+               *summary = &state->worker_status[worker];
+  options.status          = &status;
+  summary->state          = QUERY_COMPLETE;
+  summary->stopped_length = 0;
+  summary->results        = 0;
+
+  while (true) {
+    pipeline_job* job = (pipeline_job*)lockfree_queue_pop(&state->parsed);
+    if (job == NULL)
+      break;
+
+    FILE* stream = open_memstream(&job->output, &job->output_len);
+    if (stream == NULL) {
+      printf("Error: cannot capture the query output\n");
+      exit(EXIT_FAILURE);
+    }
+    options.output = stream;
+    trace_span spectrum_span;
+    begin_trace_span(&spectrum_span, query_tracer(&options), "spectrum", "seq", job->seq);
+    for (int i=0; i<job->num_peaks; ++i) {
+      fprintf(stream, "Peak: %.5f\n", job->peaks[i]);
+      queryZeroBoard(state->input_set, state->input_set_size, state->zeroboard, state->search_space_comb_len, state->search_space_min, state->dp,
+                     job->peaks[i], state->epsilon, 0, state->print_details, state->print_comb, &options);
+      summary->results += status.results;
+      if (summary->state == QUERY_COMPLETE && status.state != QUERY_COMPLETE) {
+        summary->state          = status.state;
+        summary->stopped_length = status.stopped_length;
+      }
+    }
+    end_trace_span(&spectrum_span);
+    fclose(stream);
+    free(job->peaks);
+    job->peaks = NULL;
+
+    lockfree_queue_push(&state->queried, job);
+  }
+  // The last worker to finish tells the writer, with a NULL job, that there is no more input
+  if (state->workers_running.fetch_sub(1) == 1)
+    lockfree_queue_push(&state->queried, NULL);
+}
+
+/**
+ * @brief The writer stage. Holds back spectra that finish out of order until every spectrum before them has been written.
+ *
+ * @param state The pipeline state
+ */
+void pipeline_write(pipeline_state* state) {
+  // A spectrum is at most 'window' places ahead of the next one to write, so each has its own slot
+  pipeline_job** pending = (pipeline_job**)calloc(state->window, sizeof(pipeline_job*));
+  long next = 0;
+
+  while (true) {
+    pipeline_job* job = (pipeline_job*)lockfree_queue_pop(&state->queried);
+    if (job == NULL)
+      break;
+    pending[job->seq % state->window] = job;
+
+    // Write every spectrum that is now next in order
+    while (pending[next % state->window] != NULL) {
+      pipeline_job* ready = pending[next % state->window];
+      fprintf(state->output, "Spectrum: %ld\n", ready->seq);
+      fwrite(ready->output, 1, ready->output_len, state->output);
+      free(ready->output);
+      free(ready);
+      pending[next % state->window] = NULL;
+      ++next;
+      sem_post(&state->window_slots);
+    }
+  }
+  fflush(state->output);
+  free(pending);
+}
+
+/**
+ * @brief Runs the algorithm for every peak in a peak list. One zeroboard is written for the input set and shared by a pool of query workers, while
+ * the peak list is parsed and the results are written concurrently. Results are written in the order of the peak list.
+ * Ranked queries are not supported, since the result heap would be shared between workers, and reachability pruning is not applied since it depends on the query value.
+ *
+ * @param input_set The input set: a pointer to the first item in an array of double type values
+ * @param input_set_size The number of items in the input set
+ * @param peak_file Path to the peak list: one spectrum per line, each a list of peak values separated by whitespace or commas
+ * @param output The stream to write the results to
+ * @param epsilon The value that each peak value can vary by
+ * @param search_space_comb_len The zeroboard combination length; 0 for the minimum
+ * @param num_workers The number of query workers
+ * @param queue_capacity The number of spectra that can wait between stages; together with num_workers this bounds how many spectra are held in memory
+ * @param print_times Require printing of the time taken to write the zeroboard and to process the peak list
+ * @param print_comb Require printing of all combinations summing to each peak value
+ * @param print_details Require printing of the number of combinations of each length for each peak value
+ * @param options Optional query settings applied to every peak, e.g. per-index multiplicity constraints; NULL for unconstrained queries
+ */
+void unboundedSubsetSumPipeline(
+  double* input_set,
+  int input_set_size,
+  const char* peak_file,
+  FILE* output,
+  double epsilon,
+  int search_space_comb_len,
+  int num_workers,
+  int queue_capacity,
+  int print_times,
+  int print_comb,
+  int print_details,
+  query_options* options = NULL )
+{
+  if (num_workers < 1 || queue_capacity < 1) {
+    printf("\nERROR: The pipeline needs at least one query worker and a queue capacity of at least one\n\tWorkers: %d\n\tQueue capacity: %d\n\n", num_workers, queue_capacity);
+    exit(EXIT_FAILURE);
+  }
+  if (options != NULL && options->ranked != NULL) {
+    printf("\nERROR: Ranked queries cannot be run by the pipeline\n\n");
+    exit(EXIT_FAILURE);
+  }
+
+  // Process the input set as for a single query, using its largest value as the query value
+  double input_set_max = input_set[0],
+         dp_precision  = 0.0;
+  for (int i=1; i<input_set_size; ++i)
+    if (input_set[i] > input_set_max)
+      input_set_max = input_set[i];
+  int search_space_min = SEARCH_SPACE_MIN;
+  process_inputs(input_set, input_set_size, input_set_max, epsilon, &dp_precision, &search_space_comb_len, search_space_min, SEARCH_SPACE_MAX, dp_precision, 0, 0);
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  trace_span build_span;
+  begin_trace_span(&build_span, query_tracer(options), "build", "comb_len", search_space_comb_len);
+  Board zeroboard;
+  writeZeroBoard(input_set, &zeroboard, input_set_size, search_space_comb_len, epsilon, dp_precision, options);
+  if (has_multiplicity_bounds(options))
+    summarise_multiplicities(&zeroboard, input_set_size);
+  if (has_index_mask(options))
+    summarise_index_masks(&zeroboard, input_set_size);
+  end_trace_span(&build_span);
+  std::chrono::steady_clock::time_point written = std::chrono::steady_clock::now();
+
+  pipeline_state state;
+  state.input_set             = input_set;
+  state.input_set_size        = input_set_size;
+  state.zeroboard             = &zeroboard;
+  state.search_space_comb_len = search_space_comb_len;
+  state.search_space_min      = search_space_min;
+  state.dp                    = dp_precision;
+  state.epsilon               = epsilon;
+  state.print_comb            = print_comb;
+  state.print_details         = print_details;
+  state.options               = options;
+  state.worker_status         = (query_status*)malloc(sizeof(query_status)*num_workers);
+  state.window                = 2*queue_capacity + num_workers;
+  state.output                = output;
+  state.jobs_parsed.store(0);
+  state.workers_running.store(num_workers);
+  if (state.worker_status == NULL || sem_init(&state.window_slots, 0, (unsigned int)state.window) != 0) {
+    printf("Error: unable to set up a pipeline of %d workers\n", num_workers);
+    exit(EXIT_FAILURE);
+  }
+  init_lockfree_queue(&state.parsed, queue_capacity);
+  // the writer's queue also holds the end-of-input marker
+  init_lockfree_queue(&state.queried, state.window+1);
+
+  // The writer and the query workers run on their own threads while this thread parses
+  std::thread writer(pipeline_write, &state);
+  std::vector<std::thread> workers;
+  for (int i=0; i<num_workers; ++i)
+    workers.push_back(std::thread(pipeline_query_worker, &state, i));
+  pipeline_parse(&state, peak_file, num_workers);
+  for (int i=0; i<num_workers; ++i)
+    workers[i].join();
+  writer.join();
+  std::chrono::steady_clock::time_point finished = std::chrono::steady_clock::now();
+
+  // Combine the status of every worker: the results of every peak, and the first worker's early stop, if any
+  if (options != NULL && options->status != NULL) {
+    options->status->state          = QUERY_COMPLETE;
+    options->status->stopped_length = 0;
+    options->status->results        = 0;
+    for (int i=0; i<num_workers; ++i) {
+      options->status->results += state.worker_status[i].results;
+      if (options->status->state == QUERY_COMPLETE && state.worker_status[i].state != QUERY_COMPLETE) {
+        options->status->state          = state.worker_status[i].state;
+        options->status->stopped_length = state.worker_status[i].stopped_length;
+      }
+    }
+  }
+
+  free_lockfree_queue(&state.parsed);
+  free_lockfree_queue(&state.queried);
+  sem_destroy(&state.window_slots);
+  free(state.worker_status);
+  delete_zeroboard(&zeroboard);
+
+  if (print_times) {
+    printf("%f seconds to create zeroboard\n", std::chrono::duration<double>(written - start).count());
+    printf("%f seconds to process %ld spectra\n", std::chrono::duration<double>(finished - written).count(), state.jobs_parsed.load());
+  }
+}
+
+#endif /* PIPELINE_H */
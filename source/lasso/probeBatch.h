@@ -0,0 +1,255 @@
+//
+// probeBatch.h
+// Batched zeroboard probing. Rather than looking up each tare value as soon as it is calculated, a min-finding sweep collects its tare values
+// and resolves them together: every bin within epsilon of every tare value is hashed and its hash-table bucket prefetched first, then every bin
+// is found in its bucket, then the bins are prefetched, and only then are they read. The lookups do not depend on one another, so their cache misses overlap instead of
+// stalling the search one at a time.
+// Used by subsetSummer.
+//
+
+#ifndef PROBEBATCH_H
+#define PROBEBATCH_H
+
+#include <algorithm>
+
+#include "zeroboard.h"
+#include "queryTrace.h"
+
+// Hint that a line of memory will be read soon; does nothing on compilers without the builtin
+#if defined(__GNUC__) || defined(__clang__)
+#define PROBE_PREFETCH(address) __builtin_prefetch((address), 0, 1)
+#else
+#define PROBE_PREFETCH(address) ((void)(address))
+#endif
+
+/**
+ * @brief The zeroboard probes of one min-finding sweep that are waiting to be resolved. Within a sweep only one position of the tracking array
+ * changes, so each probe is its tare value and the input set index held at that position. A probe reads every bin that a key within epsilon
+ * of its tare value can be stored in, as get_stored_length_combinations() does.
+ *
+ * @param capacity The most probes held before the batch is resolved
+ * @param size The number of probes held
+ * @param sorted Whether bins are read in hash-table bucket order rather than the order their probes were added
+ * @param position The position of the tracking array that changes between the probes
+ * @param scale The bin scale the zeroboard was written with, see bin_scale()
+ * @param epsilon The amount by which the target query value can vary
+ * @param suffix_sum The kernel that sums a combination of the zeroboard combination length; NULL to sum with a general loop
+ * @param bins_per_probe The most bins that one probe reads
+ * @param tare The tare value of each probe
+ * @param index The input set index at 'position' for each probe
+ * @param num_bins The number of bins that the probes read
+ * @param key The key of each bin
+ * @param probe The probe that reads each bin
+ * @param bucket The hash-table bucket of each bin
+ * @param order The order in which the bins are read
+ * @param bin The bin found for each key; NULL if the key is not in the zeroboard
+ */
+struct probe_batch {
+  int     capacity;
+  int     size;
+  bool    sorted;
+  int     position;
+  double  scale;
+  double  epsilon;
+  double  (*suffix_sum)(const double*, const uint16_t*);
+  int     bins_per_probe;
+  double* tare;
+  int*    index;
+  int     num_bins;
+  double* key;
+  int*    probe;
+  size_t* bucket;
+  int*    order;
+  combination_set_list** bin;
+};
+
+
+/**
+ * @brief Allocates an empty batch of probes
+ *
+ * @param batch The batch to initialise
+ * @param capacity The most probes held before the batch is resolved
+ * @param sorted Read bins in hash-table bucket order, so that the bucket array is walked in one direction
+ * @param scale The bin scale the zeroboard was written with, see bin_scale()
+ * @param epsilon The amount by which the target query value can vary
+ * @param suffix_sum The kernel that sums a combination of the zeroboard combination length, see select_combination_sum(); NULL to sum with a general loop
+ */
+void init_probe_batch(probe_batch* batch, int capacity, bool sorted, double scale, double epsilon, double (*suffix_sum)(const double*, const uint16_t*)) {
+  batch->capacity       = (capacity > 0) ? capacity : 1;
+  batch->size           = 0;
+  batch->sorted         = sorted;
+  batch->position       = 0;
+  batch->scale          = scale;
+  batch->epsilon        = epsilon;
+  batch->suffix_sum     = suffix_sum;
+  // the bins from ceil((tare-epsilon)*scale) to ceil((tare+epsilon)*scale), with a bin to spare for rounding
+  batch->bins_per_probe = (int)(2*(epsilon + BOUND_SLACK)*scale) + 3;
+  batch->num_bins       = 0;
+  int bins              = batch->capacity*batch->bins_per_probe;
+  batch->tare   = (double*)malloc(sizeof(double)*batch->capacity);
+  batch->index  = (int*)malloc(sizeof(int)*batch->capacity);
+  batch->key    = (double*)malloc(sizeof(double)*bins);
+  batch->probe  = (int*)malloc(sizeof(int)*bins);
+  batch->bucket = (size_t*)malloc(sizeof(size_t)*bins);
+  batch->order  = (int*)malloc(sizeof(int)*bins);
+  batch->bin    = (combination_set_list**)malloc(sizeof(combination_set_list*)*bins);
+  if (batch->tare == NULL || batch->index == NULL || batch->key == NULL || batch->probe == NULL || batch->bucket == NULL || batch->order == NULL || batch->bin == NULL) {
+    printf("Error: unable to allocate a batch of %d zeroboard probes\n", batch->capacity);
+    exit(EXIT_FAILURE);
+  }
+}
+
+/**
+ * @brief Resolves every probe in a batch, adding the combinations found to the results, and empties the batch. Each pass over the bins starts
+ * the memory accesses that the next pass needs: the keys are hashed and the first node of each bucket prefetched, then each bin is found
+ * in its bucket and its list header prefetched, then the first item of each list is prefetched, before any bin is read. Each bin is read with
+ * get_bin_combinations(), so only combinations within epsilon of the query value are reported.
+ *
+ * @param batch The batch of probes
+ * @param input_set The input dataset
+ * @param zeroboard The zeroboard to query
+ * @param query_val The target query value
+ * @param num_results The counter maintaining the number of combinations summing to the target query value
+ * @param array The tracking array of the query; the batch's position is restored once the batch is resolved
+ * @param prefix_len Number of indexes to include from the 'array'
+ * @param suffix_len Length of the zeroboard combinations to include
+ * @param print_comb Require printing of all combinations summing to target value
+ * @param options The query options; NULL for an unconstrained query
+ */
+void resolve_probe_batch(
+  probe_batch* batch,
+  double* input_set,
+  const Board* zeroboard,
+  double query_val,
+  unsigned long* num_results,
+  int* array,
+  int prefix_len,
+  int suffix_len,
+  int print_comb,
+  query_options* options )
+{
+  if (batch->size == 0)
+    return;
+  trace_span span;
+  begin_trace_span(&span, query_tracer(options), "probe batch", "probes", batch->size);
+
+  // List the bins that keys within epsilon of each tare value can be stored in
+  batch->num_bins = 0;
+  for (int i=0; i<batch->size; ++i) {
+    long long first_bin = (long long)ceil((batch->tare[i] - batch->epsilon - BOUND_SLACK)*batch->scale),
+              last_bin  = (long long)ceil((batch->tare[i] + batch->epsilon + BOUND_SLACK)*batch->scale);
+    for (long long bin=first_bin; bin<=last_bin && bin-first_bin<batch->bins_per_probe; ++bin) {
+      batch->key[batch->num_bins]   = bin/batch->scale;
+      batch->probe[batch->num_bins] = i;
+      ++batch->num_bins;
+    }
+  }
+
+  // Hash every key before finding any of them, and prefetch the first node of each bucket; the bucket array is read here, and these
+  // reads do not depend on each other
+  for (int i=0; i<batch->num_bins; ++i) {
+    batch->order[i]  = i;
+    batch->bucket[i] = zeroboard->bucket(batch->key[i]);
+    Board::const_local_iterator first = zeroboard->begin(batch->bucket[i]);
+    if (first != zeroboard->end(batch->bucket[i]))
+      PROBE_PREFETCH(&*first);
+  }
+  if (batch->sorted) {
+    size_t* bucket = batch->bucket;
+    std::stable_sort(batch->order, batch->order + batch->num_bins, [bucket](int a, int b) { return bucket[a] < bucket[b]; });
+  }
+
+  // Find every bin in its bucket, which is already on its way, before reading any of them
+  for (int i=0; i<batch->num_bins; ++i) {
+    int bin = batch->order[i];
+    batch->bin[bin] = NULL;
+    for (Board::const_local_iterator node = zeroboard->begin(batch->bucket[bin]); node != zeroboard->end(batch->bucket[bin]); ++node)
+      if (node->first == batch->key[bin]) {
+        batch->bin[bin] = node->second;
+        PROBE_PREFETCH(node->second);
+        break;
+      }
+  }
+  // The list headers are now on their way, so fetch the first item of each list
+  for (int i=0; i<batch->num_bins; ++i) {
+    combination_set_list* bin = batch->bin[batch->order[i]];
+    if (bin != NULL && bin->head != NULL) {
+      PROBE_PREFETCH(bin->head);
+      PROBE_PREFETCH(bin->head->head);
+    }
+  }
+
+  // Read the bins, with the tracking array as it was when each probe was added; only the value at the batch's position differs between them
+  int    current  = array[batch->position];
+  double rest_sum = 0.0;
+  for (int i=0; i<prefix_len; ++i)
+    if (i != batch->position)
+      rest_sum += input_set[array[i]];
+  for (int i=0; i<batch->num_bins; ++i) {
+    int bin = batch->order[i];
+    if (batch->bin[bin] == NULL)
+      continue;
+    array[batch->position] = batch->index[batch->probe[bin]];
+    get_bin_combinations(input_set, batch->bin[bin], suffix_len, rest_sum + input_set[array[batch->position]], query_val, batch->epsilon, batch->suffix_sum, num_results,
+                         print_comb, options, array, prefix_len);
+  }
+  array[batch->position] = current;
+  batch->size     = 0;
+  batch->num_bins = 0;
+  end_trace_span(&span);
+}
+
+/**
+ * @brief Adds a probe to a batch, resolving the batch first if it is full
+ *
+ * @param batch The batch of probes
+ * @param tare_value The tare value to look up
+ * @param position The position of the tracking array that changes between the probes of the batch
+ * @param input_set The input dataset
+ * @param zeroboard The zeroboard to query
+ * @param query_val The target query value
+ * @param num_results The counter maintaining the number of combinations summing to the target query value
+ * @param array The tracking array of the query
+ * @param prefix_len Number of indexes to include from the 'array'
+ * @param suffix_len Length of the zeroboard combinations to include
+ * @param print_comb Require printing of all combinations summing to target value
+ * @param options The query options; NULL for an unconstrained query
+ */
+void add_probe(
+  probe_batch* batch,
+  double tare_value,
+  int position,
+  double* input_set,
+  const Board* zeroboard,
+  double query_val,
+  unsigned long* num_results,
+  int* array,
+  int prefix_len,
+  int suffix_len,
+  int print_comb,
+  query_options* options )
+{
+  if (batch->size == batch->capacity || (batch->size > 0 && batch->position != position))
+    resolve_probe_batch(batch, input_set, zeroboard, query_val, num_results, array, prefix_len, suffix_len, print_comb, options);
+  batch->position            = position;
+  batch->tare[batch->size]   = tare_value;
+  batch->index[batch->size]  = array[position];
+  ++batch->size;
+}
+
+/**
+ * @brief Frees the memory used by a batch of probes
+ *
+ * @param batch The batch; it must have been resolved
+ */
+void free_probe_batch(probe_batch* batch) {
+  free(batch->tare);
+  free(batch->index);
+  free(batch->key);
+  free(batch->probe);
+  free(batch->bucket);
+  free(batch->order);
+  free(batch->bin);
+}
+
+#endif /* PROBEBATCH_H */
@@ -6,6 +6,10 @@
 #ifndef PROCESSINPUTS_H
 #define PROCESSINPUTS_H
 
+// The shortest and longest zeroboard combination lengths that the front ends let process_inputs() choose
+#define SEARCH_SPACE_MIN 3
+#define SEARCH_SPACE_MAX 7
+
 /**
  * @brief Runs a quicksort algorithm where the pivot is the first element in the array portion, sorting the input values because the algorithm requires a sorted input set
  * 
@@ -130,6 +134,12 @@ void process_inputs(
       }
       exit(EXIT_FAILURE);
     }
+  // Error check input set size: zeroboard combinations store input set indexes as 16-bit values
+    if (input_set_size > 65536) {
+      if (print_details)
+        printf("\nERROR: Input set size cannot be greater than 65536\n\tInput set size: %d\n\n", input_set_size);
+      exit(EXIT_FAILURE);
+    }
   // Error check query value
   if (query_value < input_set[0]) {
       if (print_details) printf("\nERROR: Query value cannot be less than input_set minimum\n\tQuery value: %f\n\tinput_set min: %f\n\n", query_value, input_set[0]);
@@ -181,11 +191,55 @@ void process_inputs(
     while (val < 1.0) {
       (*dp) *= 10.0;
       val = epsilon * (*dp);
-      printf(" DP = %f | %f = %f = %f * %f\n", *dp, val, epsilon * (*dp), epsilon, (*dp));
+      if (print_details) printf(" DP = %f | %f = %f = %f * %f\n", *dp, val, epsilon * (*dp), epsilon, (*dp));
     }
     (*dp) /= 10.0;
   }
 } // end process_inputs()
 
 
+/**
+ * @brief Processes the input parameters of a run that answers several query values from one zeroboard. process_inputs() is given the largest
+ * query value, so the zeroboard serves every query value, and then every query value is checked against the input set minimum.
+ * 
+ * @param input_set A pointer to the first item in an array of double type values
+ * @param input_set_size The number of items in the input_set
+ * @param query_values The target values to which combinations must sum
+ * @param num_queries The number of query values
+ * @param epsilon The amount by which each query value can vary
+ * @param dp Set to the order of magnitude of epsilon
+ * @param search_space_comb_len Combination length of the search space; 0 to have it calculated
+ * @param search_space_min Minimum combination length of search space
+ * @param search_space_max Maximum search space combination length, as for process_inputs()
+ * @param print_details Require printing of details about the algorithm run
+ * @return double: the largest query value
+ * 
+ * @throws Exits on failure. If print_details==0 no error is printed.
+ */
+double process_query_values(
+  double* input_set,
+  int input_set_size,
+  const double* query_values,
+  int num_queries,
+  double epsilon,
+  double* dp,
+  int* search_space_comb_len,
+  int search_space_min,
+  int search_space_max,
+  int print_details )
+{
+  double largest = query_values[0];
+  for (int q=1; q<num_queries; ++q)
+    if (query_values[q] > largest)
+      largest = query_values[q];
+  process_inputs(input_set, input_set_size, largest, epsilon, dp, search_space_comb_len, search_space_min, search_space_max, (int)*dp, 0, print_details);
+  for (int q=0; q<num_queries; ++q)
+    if (query_values[q] < input_set[0]) {
+      if (print_details) printf("\nERROR: Query value cannot be less than input_set minimum\n\tQuery value: %f\n\tinput_set min: %f\n\n", query_values[q], input_set[0]);
+      exit(EXIT_FAILURE);
+    }
+  return largest;
+}
+
+
 #endif /* PROCESSINPUTS_H */
\ No newline at end of file
@@ -0,0 +1,459 @@
+//
+// queryCursor.h
+// A pull-based cursor over the combinations summing to a query value. Results are returned one at a time, so a caller can stop after a page of results,
+// save a resume token, and continue from the same place later without searching the earlier part of the search space again.
+// Used by UnboundedSubsetSum.
+//
+
+#ifndef QUERYCURSOR_H
+#define QUERYCURSOR_H
+
+#include <boost/functional/hash.hpp>
+
+#include "zeroboard.h"
+
+// The phases of a cursor: combination lengths above the zeroboard combination length (a prefix followed by a zeroboard combination),
+// then the combination lengths stored in the zeroboard, then finished
+#define CURSOR_PREFIXED   0
+#define CURSOR_ZEROBOARD  1
+#define CURSOR_DONE       2
+
+/**
+ * @brief The state of a query that is part way through. The search position is held in the same way as queryZeroBoard() holds it: the prefix 'array' of input set indexes
+ * and the current position 'dim' in it, for the combination length being searched. While a zeroboard bucket is being read, the bin being read and the position within it
+ * are held as well.
+ *
+ * @param input_set The processed input set
+ * @param n The number of values in the input set
+ * @param zeroboard The zeroboard being queried
+ * @param search_space_comb_len The zeroboard combination length
+ * @param query_val The target query value
+ * @param epsilon The amount by which the sum of a returned combination can differ from the query value
+ * @param scale The bin scale the zeroboard was written with, see bin_scale()
+ * @param combination_length If not 0, only this combination length is searched
+ * @param options Optional query settings; only the multiplicity constraints, allowed index mask and composition output are used
+ * @param max_comb_len The longest combination length searched
+ * @param phase The phase of the cursor
+ * @param curr_comb_len The combination length being searched
+ * @param dim The current position in the prefix
+ * @param array The prefix of input set indexes
+ * @param sums The running sums of the prefix
+ * @param probing Whether a zeroboard bucket is being read
+ * @param bin The bin being read, as a multiple of 1/scale
+ * @param last_bin The last bin that keys within epsilon of the tare value can be stored in
+ * @param item The item of the bucket being read
+ * @param set The next combination set of the item to read
+ * @param item_pos Number of items of the bucket already read
+ * @param set_pos Number of combination sets of the item already read
+ * @param returned Number of combinations returned so far
+ */
+struct query_cursor {
+  double* input_set;
+  int     n;
+  const Board* zeroboard;
+  int     search_space_comb_len;
+  double  query_val;
+  double  epsilon;
+  double  scale;
+  int     combination_length;
+  query_options* options;
+  int     max_comb_len;
+  int     phase;
+  int     curr_comb_len;
+  int     dim;
+  int*    array;
+  double* sums;
+  bool    probing;
+  long long bin;
+  long long last_bin;
+  combination_set_item* item;
+  combination_set*      set;
+  int     item_pos;
+  int     set_pos;
+  unsigned long returned;
+};
+
+
+/**
+ * @brief Sets up a cursor at the start of a query
+ *
+ * @param cursor The cursor to initialise
+ * @param input_set The processed input set
+ * @param n The number of values in the input set
+ * @param zeroboard The zeroboard to query, written with writeZeroBoard()
+ * @param search_space_comb_len The zeroboard combination length
+ * @param dp The order of magnitude of epsilon that the zeroboard was written with
+ * @param query_val The target query value
+ * @param epsilon The amount by which the target query value can vary
+ * @param combination_length If not 0, only this combination length is searched
+ * @param options Optional query settings; NULL for an unconstrained query. Ranked queries are not supported by cursors.
+ */
+void init_query_cursor(
+  query_cursor* cursor,
+  double* input_set,
+  int n,
+  const Board* zeroboard,
+  int search_space_comb_len,
+  double dp,
+  double query_val,
+  double epsilon,
+  int combination_length,
+  query_options* options )
+{
+  cursor->input_set             = input_set;
+  cursor->n                     = n;
+  cursor->zeroboard             = zeroboard;
+  cursor->search_space_comb_len = search_space_comb_len;
+  cursor->query_val             = query_val;
+  cursor->epsilon               = epsilon;
+  cursor->scale                 = bin_scale(dp);
+  cursor->combination_length    = combination_length;
+  cursor->options               = options;
+  cursor->max_comb_len          = (combination_length != 0) ? combination_length : (int)((query_val+epsilon)/input_set[0]);
+  int array_size                = (cursor->max_comb_len > search_space_comb_len) ? cursor->max_comb_len-search_space_comb_len : 1;
+  cursor->array                 = (int*)malloc(sizeof(int)*array_size);
+  cursor->sums                  = (double*)malloc(sizeof(double)*array_size);
+  cursor->phase                 = CURSOR_PREFIXED;
+  cursor->curr_comb_len         = cursor->max_comb_len;
+  cursor->dim                   = 0;
+  cursor->array[0]              = 0;
+  cursor->probing               = false;
+  cursor->bin                   = 0;
+  cursor->last_bin              = 0;
+  cursor->item                  = NULL;
+  cursor->set                   = NULL;
+  cursor->item_pos              = 0;
+  cursor->set_pos               = 0;
+  cursor->returned              = 0;
+}
+
+/**
+ * @brief Calculates the tare value to query the zeroboard with for the current prefix or zeroboard combination length.
+ * The prefix is summed in the same order as in queryZeroBoard() so that the cursor looks up exactly the same keys.
+ *
+ * @param cursor The cursor
+ * @return double: the tare value
+ */
+double cursor_tare_value(query_cursor* cursor) {
+  double input_set_max = cursor->input_set[cursor->n-1];
+  if (cursor->phase == CURSOR_ZEROBOARD)
+    return cursor->curr_comb_len*input_set_max - cursor->query_val;
+  double tare_value = 0.0;
+  for (int u=0; u<cursor->curr_comb_len-cursor->search_space_comb_len; ++u)
+    tare_value -= (input_set_max-cursor->input_set[cursor->array[u]]);
+  return tare_value + (cursor->curr_comb_len*input_set_max - cursor->query_val);
+}
+
+/**
+ * @brief Starts reading the first bin, from a given bin up to the last bin of the current prefix or zeroboard combination length, that holds any combinations
+ *
+ * @param cursor The cursor
+ * @param bin The first bin to try
+ * @return true if a bin was opened, false if there is nothing left to read
+ */
+bool cursor_open_bin(query_cursor* cursor, long long bin) {
+  for (; bin<=cursor->last_bin; ++bin) {
+    Board::const_iterator bucket = cursor->zeroboard->find(bin/cursor->scale);
+    if (bucket == cursor->zeroboard->end() || bucket->second->head == NULL)
+      continue;
+    cursor->probing  = true;
+    cursor->bin      = bin;
+    cursor->item     = bucket->second->head;
+    cursor->set      = cursor->item->head;
+    cursor->item_pos = 0;
+    cursor->set_pos  = 0;
+    return true;
+  }
+  return false;
+}
+
+/**
+ * @brief Starts reading the bins for the current prefix or zeroboard combination length: every bin that a key within epsilon of the tare value can be
+ * stored in, as get_stored_length_combinations() reads them
+ *
+ * @param cursor The cursor
+ * @return true if one of the bins holds combinations, false if there is nothing to read
+ */
+bool cursor_open_bucket(query_cursor* cursor) {
+  double tare_value = cursor_tare_value(cursor);
+  cursor->last_bin  = (long long)ceil((tare_value + cursor->epsilon + BOUND_SLACK)*cursor->scale);
+  return cursor_open_bin(cursor, (long long)ceil((tare_value - cursor->epsilon - BOUND_SLACK)*cursor->scale));
+}
+
+/**
+ * @brief Finishes reading a bin, and moves on to the next bin for the same prefix or zeroboard combination length if there is one, otherwise
+ * to the next prefix or zeroboard combination length
+ *
+ * @param cursor The cursor
+ */
+void cursor_close_bucket(query_cursor* cursor) {
+  cursor->probing = false;
+  cursor->item    = NULL;
+  cursor->set     = NULL;
+  if (cursor_open_bin(cursor, cursor->bin+1))
+    return;
+  if (cursor->phase == CURSOR_PREFIXED)
+    ++cursor->array[cursor->dim];
+  else
+    --cursor->curr_comb_len;
+}
+
+/**
+ * @brief Moves the search on to the next zeroboard bucket that could hold results, using the same branch and bound as queryZeroBoard()
+ *
+ * @param cursor The cursor
+ * @return true if a bucket is ready to be read, false if the query is finished
+ */
+bool cursor_find_bucket(query_cursor* cursor) {
+  double* input_set     = cursor->input_set;
+  double  input_set_max = input_set[cursor->n-1],
+          query_val     = cursor->query_val,
+          tolerance     = cursor->epsilon;
+  int     k             = cursor->search_space_comb_len;
+  bool    bounded       = has_multiplicity_bounds(cursor->options),
+          masked        = has_index_mask(cursor->options);
+
+  // Combination lengths above the zeroboard combination length: search the prefixes
+  while (cursor->phase == CURSOR_PREFIXED) {
+    if (cursor->curr_comb_len <= k
+        || (cursor->combination_length != 0 && cursor->curr_comb_len != cursor->combination_length)
+        || cursor->curr_comb_len*input_set_max < query_val - tolerance) {
+      cursor->phase         = CURSOR_ZEROBOARD;
+      cursor->curr_comb_len = (cursor->max_comb_len < k) ? cursor->max_comb_len : k;
+      break;
+    }
+    // Every prefix of this length has been searched, so move to the next length
+    if (cursor->dim < 0) {
+      --cursor->curr_comb_len;
+      cursor->dim      = 0;
+      cursor->array[0] = 0;
+      continue;
+    }
+    int  dim        = cursor->dim,
+         prefix_len = cursor->curr_comb_len-k,
+        *array      = cursor->array;
+    // Every value at this position has been tried, so move back to the previous position
+    if (array[dim] > cursor->n-1) {
+      if (--cursor->dim >= 0)
+        ++array[cursor->dim];
+      continue;
+    }
+    cursor->sums[dim] = ((dim > 0) ? cursor->sums[dim-1] : 0.0) + input_set[array[dim]];
+    int    remaining  = cursor->curr_comb_len-(dim+1);
+    double mins       = cursor->sums[dim] + input_set[array[dim]]*remaining,
+           maxs       = cursor->sums[dim] + input_set_max*remaining;
+
+    if (mins > query_val + tolerance) {
+      if (--cursor->dim >= 0)
+        ++array[cursor->dim];
+    } else if (maxs < query_val - tolerance
+               || (masked && !mask_has_index(cursor->options->allowed, array[dim]))
+               || (bounded && !bounded_prefix_can_reach(cursor->options, input_set, array, dim+1, remaining, query_val, tolerance))) {
+      ++array[dim];
+    } else if (dim == prefix_len-1) {
+      if (cursor_open_bucket(cursor))
+        return true;
+      ++array[dim];
+    } else {
+      ++cursor->dim;
+      array[cursor->dim] = array[dim];
+    }
+  }
+
+  // Combination lengths stored in the zeroboard: one bucket per length
+  while (cursor->phase == CURSOR_ZEROBOARD) {
+    int len = cursor->curr_comb_len;
+    if (len < 1 || len*input_set_max < query_val - tolerance) {
+      cursor->phase = CURSOR_DONE;
+      break;
+    }
+    if ((cursor->combination_length == 0 || cursor->combination_length == len)
+        && (!bounded || bounded_prefix_can_reach(cursor->options, input_set, NULL, 0, len, query_val, tolerance))
+        && cursor_open_bucket(cursor))
+      return true;
+    --cursor->curr_comb_len;
+  }
+  return false;
+}
+
+/**
+ * @brief Returns the next combination whose sum is within epsilon of the query value
+ *
+ * @param cursor The cursor
+ * @param combination Set to the input set indexes of the combination, in ascending order; must have room for max_comb_len indexes
+ * @return int: the length of the combination, or 0 once every combination has been returned
+ */
+int cursor_next(query_cursor* cursor, int* combination) {
+  bool bounded = has_multiplicity_bounds(cursor->options),
+       masked  = has_index_mask(cursor->options);
+  while (true) {
+    if (!cursor->probing && !cursor_find_bucket(cursor))
+      return 0;
+
+    int prefix_len = (cursor->phase == CURSOR_PREFIXED) ? cursor->curr_comb_len-cursor->search_space_comb_len : 0,
+        suffix_len = (cursor->phase == CURSOR_PREFIXED) ? cursor->search_space_comb_len : cursor->curr_comb_len;
+    // Read the bin from where the cursor left off, in the same way as get_bin_combinations() does
+    double prefix_sum = (prefix_len > 0) ? cursor->sums[prefix_len-1] : 0.0;
+    while (cursor->item != NULL) {
+      while (cursor->set != NULL) {
+        combination_set* set = cursor->set;
+        cursor->set = set->next;
+        ++cursor->set_pos;
+        // Lists are ordered from shortest to longest combination: skip shorter combinations and stop at longer ones
+        if (set->combination_len < suffix_len)
+          continue;
+        if (set->combination_len > suffix_len || (prefix_len > 0 && set->combination[0] < cursor->array[prefix_len-1])) {
+          cursor->set = NULL;
+          break;
+        }
+        if (masked && !combination_within_index_mask(cursor->options, set->combination, set->combination_len))
+          continue;
+        if (bounded && !within_multiplicity_bounds(cursor->options, cursor->array, prefix_len, set->combination, set->combination_len))
+          continue;
+        // A bin also holds keys just outside epsilon of the tare value
+        double sum = prefix_sum;
+        for (int i=0; i<suffix_len; ++i)
+          sum += cursor->input_set[set->combination[i]];
+        if (fabs(sum - cursor->query_val) > cursor->epsilon + BOUND_SLACK)
+          continue;
+        for (int i=0; i<prefix_len; ++i)
+          combination[i] = cursor->array[i];
+        for (int i=0; i<suffix_len; ++i)
+          combination[prefix_len+i] = set->combination[i];
+        ++cursor->returned;
+        return prefix_len+suffix_len;
+      }
+      cursor->item = cursor->item->next;
+      ++cursor->item_pos;
+      cursor->set     = (cursor->item != NULL) ? cursor->item->head : NULL;
+      cursor->set_pos = 0;
+    }
+    cursor_close_bucket(cursor);
+  }
+}
+
+/**
+ * @brief Prints the next page of combinations, as compositions if the cursor's options ask for them
+ *
+ * @param cursor The cursor
+ * @param page_size The most combinations to print
+ * @param output The stream to print to
+ * @return int: the number of combinations printed; fewer than page_size once the query is finished
+ */
+int cursor_print_page(query_cursor* cursor, int page_size, FILE* output) {
+  int* combination = (int*)malloc(sizeof(int)*(cursor->max_comb_len+1));
+  int  printed     = 0;
+  while (printed < page_size) {
+    int len = cursor_next(cursor, combination);
+    if (len == 0)
+      break;
+    print_combination(output, cursor->input_set, combination, len, NULL, 0, composition_output(cursor->options));
+    ++printed;
+  }
+  free(combination);
+  return printed;
+}
+
+/**
+ * @brief Calculates the hash of a cursor's processed input set that is held in its resume token, so that a token is not resumed against a different input set
+ *
+ * @param cursor The cursor
+ * @return std::size_t: the hash
+ */
+std::size_t cursor_input_set_hash(query_cursor* cursor) {
+  std::size_t seed = 0;
+  boost::hash_combine(seed, cursor->n);
+  for (int i=0; i<cursor->n; ++i)
+    boost::hash_combine(seed, cursor->input_set[i]);
+  return seed;
+}
+
+/**
+ * @brief Writes a resume token holding the position of the cursor, along with the query value, epsilon and a hash of the input set it was saved for.
+ * A cursor set up for the same query and zeroboard can continue from the token with cursor_resume().
+ *
+ * @param cursor The cursor
+ * @param token The buffer to write the token to
+ * @param size The size of the buffer
+ * @return int: the length of the token; if this is not less than size the token did not fit
+ */
+int cursor_save_token(query_cursor* cursor, char* token, size_t size) {
+  int len = snprintf(token, size, "LASSO3 %.17g %.17g %zx %d %d %d %d %d %lld %d %d %d %lu",
+                     cursor->query_val, cursor->epsilon, cursor_input_set_hash(cursor), cursor->search_space_comb_len, cursor->phase, cursor->curr_comb_len, cursor->dim,
+                     (int)cursor->probing, cursor->bin, cursor->item_pos, cursor->set_pos, cursor->dim+1, cursor->returned);
+  for (int i=0; i<=cursor->dim && cursor->phase == CURSOR_PREFIXED; ++i)
+    len += snprintf(token + ((size_t)len < size ? len : size), (size_t)len < size ? size-len : 0, " %d", cursor->array[i]);
+  return len;
+}
+
+/**
+ * @brief Moves a cursor to the position held in a resume token
+ *
+ * @param cursor A cursor set up with init_query_cursor() for the same query and zeroboard that the token was saved from
+ * @param token The resume token
+ * @return true if the cursor was moved, false if the token is not valid for this query, e.g. it was saved for a different query value, epsilon or input set
+ */
+bool cursor_resume(query_cursor* cursor, const char* token) {
+  double query_val, epsilon;
+  std::size_t input_set_hash;
+  int    comb_len, phase, curr_comb_len, dim, probing, item_pos, set_pos, prefix_count, read;
+  long long bin;
+  unsigned long returned;
+  if (sscanf(token, "LASSO3 %lg %lg %zx %d %d %d %d %d %lld %d %d %d %lu%n", &query_val, &epsilon, &input_set_hash, &comb_len, &phase, &curr_comb_len,
+             &dim, &probing, &bin, &item_pos, &set_pos, &prefix_count, &returned, &read) != 13)
+    return false;
+  if (query_val != cursor->query_val || epsilon != cursor->epsilon || input_set_hash != cursor_input_set_hash(cursor) || comb_len != cursor->search_space_comb_len || phase < CURSOR_PREFIXED || phase > CURSOR_DONE
+      || curr_comb_len > cursor->max_comb_len || dim < -1 || prefix_count != dim+1
+      || (phase == CURSOR_PREFIXED && curr_comb_len > comb_len && dim >= curr_comb_len-comb_len))
+    return false;
+
+  // Restore the prefix and its running sums
+  const char* pos = token + read;
+  if (phase == CURSOR_PREFIXED) {
+    for (int i=0; i<prefix_count; ++i) {
+      int value, used;
+      if (sscanf(pos, " %d%n", &value, &used) != 1 || value < 0 || value > cursor->n)
+        return false;
+      cursor->array[i] = value;
+      cursor->sums[i]  = ((i > 0) ? cursor->sums[i-1] : 0.0) + ((value < cursor->n) ? cursor->input_set[value] : 0.0);
+      pos += used;
+    }
+  }
+  cursor->phase         = phase;
+  cursor->curr_comb_len = curr_comb_len;
+  cursor->dim           = dim;
+  cursor->returned      = returned;
+  cursor->probing       = false;
+  cursor->item          = NULL;
+  cursor->set           = NULL;
+
+  // Reopen the bin being read and move to the same place in it
+  if (probing) {
+    double tare_value = cursor_tare_value(cursor);
+    cursor->last_bin  = (long long)ceil((tare_value + cursor->epsilon + BOUND_SLACK)*cursor->scale);
+    if (bin < (long long)ceil((tare_value - cursor->epsilon - BOUND_SLACK)*cursor->scale) || !cursor_open_bin(cursor, bin) || cursor->bin != bin)
+      return false;
+    for (int i=0; i<item_pos && cursor->item != NULL; ++i)
+      cursor->item = cursor->item->next;
+    cursor->item_pos = item_pos;
+    cursor->set      = (cursor->item != NULL) ? cursor->item->head : NULL;
+    for (int i=0; i<set_pos && cursor->set != NULL; ++i)
+      cursor->set = cursor->set->next;
+    cursor->set_pos  = set_pos;
+  }
+  return true;
+}
+
+/**
+ * @brief Frees the memory used by a cursor. The zeroboard is not freed.
+ *
+ * @param cursor The cursor
+ */
+void free_query_cursor(query_cursor* cursor) {
+  free(cursor->array);
+  free(cursor->sums);
+  cursor->array = NULL;
+  cursor->sums  = NULL;
+}
+
+#endif /* QUERYCURSOR_H */
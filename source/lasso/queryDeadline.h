@@ -0,0 +1,122 @@
+//
+// queryDeadline.h
+// Time limits and cooperative cancellation for queries. The search checks the deadline as it goes and stops early, keeping the results found so far.
+// Used by subsetSummer.
+//
+
+#ifndef QUERYDEADLINE_H
+#define QUERYDEADLINE_H
+
+#include <atomic>
+#include <chrono>
+
+#include "queryOptions.h"
+
+// How a query finished
+#define QUERY_COMPLETE   0
+#define QUERY_TIMED_OUT  1
+#define QUERY_CANCELLED  2
+
+// The search loops only look at the clock once every this many checks, so that checking costs almost nothing
+#define DEADLINE_CHECK_INTERVAL 1024
+
+/**
+ * @brief How a query finished. Combination lengths are searched from longest to shortest, so when a query stops early every length longer than
+ * stopped_length was searched completely, stopped_length was searched in part, and shorter lengths were not searched.
+ *
+ * @param state QUERY_COMPLETE, QUERY_TIMED_OUT or QUERY_CANCELLED
+ * @param stopped_length The combination length being searched when the query stopped; 0 if the query completed
+ * @param results The number of results found, including those found before the query stopped
+ */
+struct query_status {
+  int state;
+  int stopped_length;
+  unsigned long results;
+};
+
+/**
+ * @brief The deadline and cancellation flag of a running query
+ *
+ * @param end The time at which the query must stop
+ * @param timed Whether the query has a time limit
+ * @param cancel The cancellation flag; NULL if the query cannot be cancelled
+ * @param ticks Number of checks since the clock was last read
+ * @param state QUERY_COMPLETE while the query may continue, otherwise the reason it must stop
+ */
+struct query_deadline {
+  std::chrono::steady_clock::time_point end;
+  bool  timed;
+  const std::atomic<bool>* cancel;
+  unsigned int ticks;
+  int   state;
+};
+
+
+/**
+ * @brief Starts the clock for a query
+ *
+ * @param deadline The deadline to start
+ * @param options The query options holding the time limit and cancellation flag, may be NULL
+ */
+void start_query_deadline(query_deadline* deadline, query_options* options) {
+  deadline->timed  = options != NULL && options->time_limit > 0.0;
+  deadline->cancel = (options != NULL) ? options->cancel : NULL;
+  deadline->ticks  = 0;
+  deadline->state  = QUERY_COMPLETE;
+  if (deadline->timed)
+    deadline->end = std::chrono::steady_clock::now()
+                  + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(options->time_limit));
+}
+
+/**
+ * @brief Checks straight away whether a query must stop, i.e. it has been cancelled or has run past its deadline
+ *
+ * @param deadline The deadline of the query
+ * @return true if the query must stop
+ */
+bool query_must_stop(query_deadline* deadline) {
+  if (deadline->state != QUERY_COMPLETE)
+    return true;
+  deadline->ticks = 0;
+  if (deadline->cancel != NULL && deadline->cancel->load(std::memory_order_relaxed))
+    deadline->state = QUERY_CANCELLED;
+  else if (deadline->timed && std::chrono::steady_clock::now() >= deadline->end)
+    deadline->state = QUERY_TIMED_OUT;
+  return deadline->state != QUERY_COMPLETE;
+}
+
+/**
+ * @brief The cheap check used inside the search loops: only every DEADLINE_CHECK_INTERVAL calls look at the cancellation flag and the clock
+ *
+ * @param deadline The deadline of the query
+ * @return true if the query must stop
+ */
+bool query_should_stop(query_deadline* deadline) {
+  if (deadline->state != QUERY_COMPLETE)
+    return true;
+  if ((deadline->cancel == NULL && !deadline->timed) || ++deadline->ticks < DEADLINE_CHECK_INTERVAL)
+    return false;
+  return query_must_stop(deadline);
+}
+
+/**
+ * @brief Records how a query finished in the status requested by the query options, and prints it if required
+ *
+ * @param deadline The deadline of the query
+ * @param options The query options, may be NULL
+ * @param stopped_length The combination length being searched when the query stopped
+ * @param results The number of results found
+ * @param print_details Require printing of the status if the query stopped early
+ */
+void report_query_status(query_deadline* deadline, query_options* options, int stopped_length, unsigned long results, int print_details) {
+  if (deadline->state != QUERY_COMPLETE && print_details)
+    fprintf(query_output(options), "Query %s while searching combination length %d; longer combination lengths are complete\n",
+            (deadline->state == QUERY_CANCELLED) ? "cancelled" : "timed out", stopped_length);
+  if (options == NULL || options->status == NULL)
+    return;
+  options->status->state          = deadline->state;
+  options->status->stopped_length = (deadline->state == QUERY_COMPLETE) ? 0 : stopped_length;
+  options->status->results        = results;
+}
+
+#endif /* QUERYDEADLINE_H */
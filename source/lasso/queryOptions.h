@@ -0,0 +1,120 @@
+//
+// queryOptions.h
+// Optional settings that refine how a zeroboard is queried.
+// Used by UnboundedSubsetSum, subsetSummer and zeroboard.
+//
+
+#ifndef QUERYOPTIONS_H
+#define QUERYOPTIONS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+struct result_heap;
+struct perf_profile;
+struct query_status;
+struct query_trace;
+struct external_board;
+struct result_cache;
+struct composition_aggregator;
+
+/**
+ * @brief Optional settings passed to queryZeroBoard(). A NULL pointer in place of this struct runs the standard, unconstrained query.
+ *
+ * @param input_set_size Number of entries in each per-index array below (the size of the processed input set)
+ * @param min_multiplicity Per-index minimum number of times an input set value must appear in a combination; NULL if there are no minimums
+ * @param max_multiplicity Per-index maximum number of times an input set value may appear in a combination, where a negative entry means no maximum; NULL if there are no maximums
+ * @param required_indexes The number of indexes with a positive minimum multiplicity, counted by queryZeroBoard() when negative so that bins can be checked against the minimums without scanning the input set
+ * @param ranked If not NULL, only the heap's capacity of combinations closest to the query value (within epsilon) are kept, in this heap, sorted by error once the query returns
+ * @param reachability_scale If greater than 0, a table of reachable sums at this resolution (1/scale wide) is built before the query and used to prune the search; 0 for no table
+ * @param output The stream that query results and details are printed to; NULL for stdout
+ * @param profile If not NULL, hardware performance counters are collected for the write, query and delete phases of each run and added to this profile
+ * @param time_limit If greater than 0, the query stops after this many seconds, keeping the results found so far
+ * @param cancel If not NULL, the query stops soon after this flag is set, e.g. by another thread, keeping the results found so far
+ * @param status If not NULL, set to how the query finished and which combination lengths were searched completely (see queryDeadline.h)
+ * @param probe_batch_size If greater than 0, zeroboard lookups are collected in batches of up to this many and resolved together with prefetching (see probeBatch.h); 0 to look up each tare value as it is calculated
+ * @param sort_probes Resolve each batch of lookups in hash-table bucket order rather than the order they were calculated; results are the same but may be printed in a different order
+ * @param allowed If not NULL, a mask of the input set indexes that combinations may use (see indexMask.h), restricting the query to a subset of the input set; NULL to allow every index
+ * @param fixed_point_scale If greater than 0, unboundedSubsetSum() runs the fixed-point engine (see fixedPoint.h): values are rounded once to multiples of 1/scale and every sum and comparison uses integers; 0 for the standard engine
+ * @param length_incremental Search the prefixes of every combination length in one traversal rather than one traversal per length (see queryZeroBoardIncremental()); results are printed in prefix order rather than by length
+ * @param compositions Print each combination as its composition, i.e. input set index:multiplicity pairs (see compositionOutput.h), rather than as a list of values
+ * @param trace If not NULL, spans for the zeroboard build, each query, each combination length and each batch of probes are recorded in this trace (see queryTrace.h)
+ * @param external If not NULL, bins are read from this out-of-core zeroboard (see externalBoard.h) rather than the in-memory zeroboard; ranked queries, batched probing and cursors are not supported
+ * @param memo If not NULL, queryZeroBoard() first looks the query up in this result cache (see resultCache.h), and stores the result of a completed search in it; ranked queries, queries that print details and queries that aggregate compositions are not cached
+ * @param bulk_load Write the zeroboard with the bulk loader (see bulkLoad.h), which sorts every combination by key in one buffer rather than inserting them one at a time; zeroboards whose buffer would exceed BULK_LOAD_MAX_BYTES are still written one at a time
+ * @param aggregate If not NULL, each combination the query prints is added to this aggregator as its composition (see compositionOutput.h) rather than printed, so that
+ *                  identical compositions found by several queries are grouped; the caller prints them with flush_composition_aggregator(). Ranked results and cursors print as usual,
+ *                  and queries that aggregate are not cached
+ * @param printed_combinations If not NULL, every combination the query prints is also added to this list, as its length followed by its input set indexes; set by the result cache to store what a search printed
+ */
+struct query_options {
+  int  input_set_size;
+  int* min_multiplicity;
+  int* max_multiplicity;
+  int  required_indexes;
+  result_heap* ranked;
+  double reachability_scale;
+  FILE*  output;
+  perf_profile* profile;
+  double time_limit;
+  const std::atomic<bool>* cancel;
+  query_status* status;
+  int    probe_batch_size;
+  bool   sort_probes;
+  const uint64_t* allowed;
+  double fixed_point_scale;
+  bool   length_incremental;
+  bool   compositions;
+  query_trace* trace;
+  external_board* external;
+  result_cache* memo;
+  bool   bulk_load;
+  composition_aggregator* aggregate;
+  std::vector<uint16_t>* printed_combinations;
+};
+
+/**
+ * @brief Sets all query options to their defaults, i.e. a query with no additional constraints
+ *
+ * @param options The options to initialise
+ * @param input_set_size The number of values in the (processed) input set
+ */
+void init_query_options(query_options* options, int input_set_size) {
+  options->input_set_size     = input_set_size;
+  options->min_multiplicity   = NULL;
+  options->max_multiplicity   = NULL;
+  options->required_indexes   = -1;
+  options->ranked             = NULL;
+  options->reachability_scale = 0.0;
+  options->output             = NULL;
+  options->profile            = NULL;
+  options->time_limit         = 0.0;
+  options->cancel             = NULL;
+  options->status             = NULL;
+  options->probe_batch_size   = 0;
+  options->sort_probes        = false;
+  options->allowed            = NULL;
+  options->fixed_point_scale  = 0.0;
+  options->length_incremental = false;
+  options->compositions       = false;
+  options->trace              = NULL;
+  options->external           = NULL;
+  options->memo               = NULL;
+  options->bulk_load          = false;
+  options->aggregate          = NULL;
+  options->printed_combinations = NULL;
+}
+
+/**
+ * @brief Finds the stream that query results and details are printed to
+ *
+ * @param options The query options, may be NULL
+ * @return FILE*: the output stream set in the options, or stdout
+ */
+FILE* query_output(query_options* options) {
+  return (options != NULL && options->output != NULL) ? options->output : stdout;
+}
+
+#endif /* QUERYOPTIONS_H */
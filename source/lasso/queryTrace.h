@@ -0,0 +1,253 @@
+//
+// queryTrace.h
+// Timeline tracing of zeroboard builds and queries, written out in the Chrome trace-event format so that a run can be loaded into a trace viewer
+// (chrome://tracing or Perfetto) and load imbalance and stalls between threads seen directly. Each thread records its spans into its own ring buffer,
+// so recording takes no lock and costs two clock reads per span; once a ring is full the oldest spans are overwritten.
+// Used by UnboundedSubsetSum, subsetSummer, probeBatch, fixedPoint, boardCache and pipeline.
+//
+
+#ifndef QUERYTRACE_H
+#define QUERYTRACE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+#include "queryOptions.h"
+
+// The number of traces whose rings each thread remembers; a thread recording in more traces than this finds its ring under the trace's lock
+#define TRACE_RING_CACHE_SIZE 8
+
+/**
+ * @brief A span recorded in a trace
+ *
+ * @param name The name of the span, e.g. "build" or "query"; must be a string literal or otherwise outlive the trace
+ * @param arg_name The name of the value recorded with the span, e.g. "length"; NULL if there is none
+ * @param arg The value recorded with the span
+ * @param start When the span began, in nanoseconds since the trace was started
+ * @param duration The length of the span in nanoseconds
+ */
+struct trace_event {
+  const char* name;
+  const char* arg_name;
+  double      arg;
+  long long   start;
+  long long   duration;
+};
+
+/**
+ * @brief The ring buffer of spans recorded by one thread. Only its own thread writes to it.
+ *
+ * @param tid The number given to the thread in the trace, from 1 in the order threads first recorded a span
+ * @param owner The thread that records into the ring; a later thread given the same id by the system continues the ring of one that has exited
+ * @param capacity The number of spans the ring holds
+ * @param recorded The number of spans recorded; once more than capacity, the oldest have been overwritten
+ * @param events The spans
+ * @param next The ring of the thread that started recording before this one
+ */
+struct trace_ring {
+  int          tid;
+  std::thread::id owner;
+  int          capacity;
+  unsigned long recorded;
+  trace_event* events;
+  trace_ring*  next;
+};
+
+/**
+ * @brief A trace shared by every thread of a run
+ *
+ * @param id A number unique to the trace, used by each thread to find its ring
+ * @param origin The time the trace was started; span times are relative to it
+ * @param capacity The number of spans each thread's ring holds
+ * @param lock Guards the list of rings while a thread adds its ring
+ * @param rings The ring of every thread that has recorded a span
+ * @param threads The number of rings
+ */
+struct query_trace {
+  unsigned long id;
+  std::chrono::steady_clock::time_point origin;
+  int          capacity;
+  std::mutex   lock;
+  trace_ring*  rings;
+  int          threads;
+};
+
+/**
+ * @brief A span being timed. Spans are begun and ended on the same thread.
+ *
+ * @param trace The trace the span is recorded in; NULL if tracing is off, in which case the span costs one comparison
+ * @param name The name of the span
+ * @param arg_name The name of the value recorded with the span; NULL if there is none
+ * @param arg The value recorded with the span
+ * @param start When the span began
+ */
+struct trace_span {
+  query_trace* trace;
+  const char*  name;
+  const char*  arg_name;
+  double       arg;
+  std::chrono::steady_clock::time_point start;
+};
+
+
+/**
+ * @brief Starts a trace with no spans
+ *
+ * @param trace The trace to initialise
+ * @param capacity The number of spans each thread's ring holds, e.g. 1 << 16
+ */
+void init_query_trace(query_trace* trace, int capacity) {
+  static std::atomic<unsigned long> next_id(0);
+  trace->id       = ++next_id;
+  trace->origin   = std::chrono::steady_clock::now();
+  trace->capacity = (capacity > 0) ? capacity : 1;
+  trace->rings    = NULL;
+  trace->threads  = 0;
+}
+
+/**
+ * @brief Finds the trace that queries record their spans in
+ *
+ * @param options The query options, may be NULL
+ * @return query_trace*: the trace set in the options, or NULL if tracing is off
+ */
+query_trace* query_tracer(query_options* options) {
+  return (options != NULL) ? options->trace : NULL;
+}
+
+/**
+ * @brief Finds the ring of the calling thread, adding one to the trace the first time the thread records a span
+ *
+ * @param trace The trace
+ * @return trace_ring*: the calling thread's ring
+ */
+trace_ring* trace_thread_ring(query_trace* trace) {
+  // Each thread remembers its rings for the last few traces it recorded in, keyed by trace id, so that a thread moving between traces does not
+  // take a lock for every span; trace ids are never reused, so a remembered ring is never mistaken for the ring of a later trace
+  static thread_local unsigned long cached_ids[TRACE_RING_CACHE_SIZE]   = { 0 };
+  static thread_local trace_ring*   cached_rings[TRACE_RING_CACHE_SIZE] = { NULL };
+  static thread_local int           next_slot = 0;
+  for (int i=0; i<TRACE_RING_CACHE_SIZE; ++i)
+    if (cached_ids[i] == trace->id)
+      return cached_rings[i];
+
+  // The thread may already have a ring in this trace that it has since forgotten
+  std::thread::id self = std::this_thread::get_id();
+  trace_ring*     ring = NULL;
+  {
+    std::lock_guard<std::mutex> guard(trace->lock);
+    for (ring = trace->rings; ring != NULL && ring->owner != self; ring = ring->next)
+      ;
+  }
+  if (ring == NULL) {
+    ring = (trace_ring*)malloc(sizeof(trace_ring));
+    if (ring != NULL)
+      ring->events = (trace_event*)malloc(sizeof(trace_event)*trace->capacity);
+    if (ring == NULL || ring->events == NULL) {
+      printf("Error: unable to allocate a trace ring of %d spans\n", trace->capacity);
+      exit(EXIT_FAILURE);
+    }
+    ring->owner    = self;
+    ring->capacity = trace->capacity;
+    ring->recorded = 0;
+    std::lock_guard<std::mutex> guard(trace->lock);
+    ring->tid    = ++trace->threads;
+    ring->next   = trace->rings;
+    trace->rings = ring;
+  }
+  cached_ids[next_slot]   = trace->id;
+  cached_rings[next_slot] = ring;
+  next_slot = (next_slot+1) % TRACE_RING_CACHE_SIZE;
+  return ring;
+}
+
+/**
+ * @brief Begins timing a span
+ *
+ * @param span The span
+ * @param trace The trace to record the span in; NULL if tracing is off
+ * @param name The name of the span; must outlive the trace
+ * @param arg_name The name of the value recorded with the span; NULL if there is none
+ * @param arg The value recorded with the span
+ */
+void begin_trace_span(trace_span* span, query_trace* trace, const char* name, const char* arg_name, double arg) {
+  span->trace = trace;
+  if (trace == NULL)
+    return;
+  span->name     = name;
+  span->arg_name = arg_name;
+  span->arg      = arg;
+  span->start    = std::chrono::steady_clock::now();
+}
+
+/**
+ * @brief Ends a span and records it in the calling thread's ring, overwriting the oldest span if the ring is full
+ *
+ * @param span The span, begun on the calling thread
+ */
+void end_trace_span(trace_span* span) {
+  if (span->trace == NULL)
+    return;
+  std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+  trace_ring*  ring  = trace_thread_ring(span->trace);
+  trace_event* event = &ring->events[ring->recorded % ring->capacity];
+  event->name     = span->name;
+  event->arg_name = span->arg_name;
+  event->arg      = span->arg;
+  event->start    = std::chrono::duration_cast<std::chrono::nanoseconds>(span->start - span->trace->origin).count();
+  event->duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - span->start).count();
+  ++ring->recorded;
+  span->trace = NULL;
+}
+
+/**
+ * @brief Writes every span held in the trace as Chrome trace-event JSON, one complete ("X") event per span with times in microseconds.
+ * No thread may be recording spans while the trace is written.
+ *
+ * @param trace The trace
+ * @param output The stream to write to
+ */
+void write_chrome_trace(query_trace* trace, FILE* output) {
+  unsigned long dropped = 0;
+  bool first = true;
+  fprintf(output, "{\"traceEvents\":[\n");
+  for (trace_ring* ring = trace->rings; ring != NULL; ring = ring->next) {
+    fprintf(output, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}", first ? "" : ",\n", ring->tid, ring->tid);
+    first = false;
+    unsigned long held = (ring->recorded < (unsigned long)ring->capacity) ? ring->recorded : ring->capacity;
+    dropped += ring->recorded - held;
+    // Write the spans of the ring from the oldest held to the newest
+    for (unsigned long i=ring->recorded-held; i<ring->recorded; ++i) {
+      trace_event* event = &ring->events[i % ring->capacity];
+      fprintf(output, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+              event->name, ring->tid, event->start/1000.0, event->duration/1000.0);
+      if (event->arg_name != NULL)
+        fprintf(output, ",\"args\":{\"%s\":%.10g}", event->arg_name, event->arg);
+      fprintf(output, "}");
+    }
+  }
+  fprintf(output, "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"threads\":%d,\"dropped_spans\":%lu}}\n", trace->threads, dropped);
+}
+
+/**
+ * @brief Frees the rings of a trace. No thread may be recording spans.
+ *
+ * @param trace The trace
+ */
+void free_query_trace(query_trace* trace) {
+  trace_ring* ring = trace->rings;
+  while (ring != NULL) {
+    trace_ring* next = ring->next;
+    free(ring->events);
+    free(ring);
+    ring = next;
+  }
+  trace->rings   = NULL;
+  trace->threads = 0;
+}
+
+#endif /* QUERYTRACE_H */
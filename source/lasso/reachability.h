@@ -0,0 +1,250 @@
+//
+// reachability.h
+// A table of the sums that can be reached by combinations of each length, used to prune the branch and bound search.
+// Used by UnboundedSubsetSum and subsetSummer.
+//
+
+#ifndef REACHABILITY_H
+#define REACHABILITY_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+// The most memory a reachability table may use; a table that would be larger is built at a coarser scale, or for fewer lengths, instead
+#define REACHABILITY_MAX_BYTES ((size_t)32 << 20)
+
+/**
+ * @brief For each combination length from 0 to max_len, a bitset of the sums that combinations of that length can reach.
+ * Sums are integer scaled: every value v is written as floor(v*scale), so a combination of length r whose scaled sum is L really sums to between L/scale and (L+r)/scale.
+ *
+ * @param max_len The largest combination length in the table
+ * @param max_bit The largest scaled sum covered; sums above it are not recorded
+ * @param words Number of 64-bit words in each bitset
+ * @param scale The resolution of the table, i.e. 1/scale is the width of each bit
+ * @param bits The bitsets, one after another from length 0 to max_len
+ */
+struct reachability_table {
+  int       max_len;
+  long      max_bit;
+  long      words;
+  double    scale;
+  uint64_t* bits;
+};
+
+
+/**
+ * @brief ORs a bitset, shifted up by a number of bits, into another bitset of the same size. Bits shifted past the end are dropped.
+ *
+ * @param dst The bitset to OR into
+ * @param src The bitset to shift
+ * @param words Number of 64-bit words in each bitset
+ * @param shift The number of bits to shift by
+ */
+void bitset_or_shifted(uint64_t* dst, const uint64_t* src, long words, long shift) {
+  long word_shift = shift / 64;
+  int  bit_shift  = (int)(shift % 64);
+  for (long i=words-1; i>=word_shift; --i) {
+    uint64_t word = src[i-word_shift] << bit_shift;
+    if (bit_shift != 0 && i-word_shift-1 >= 0)
+      word |= src[i-word_shift-1] >> (64-bit_shift);
+    dst[i] |= word;
+  }
+}
+
+/**
+ * @brief Checks whether any bit between two positions, inclusive, is set in a bitset
+ *
+ * @param bits The bitset
+ * @param lo The first position
+ * @param hi The last position
+ * @return true if a bit in the range is set
+ */
+bool bitset_any_in_range(const uint64_t* bits, long lo, long hi) {
+  if (lo > hi)
+    return false;
+  long first = lo / 64,
+       last  = hi / 64;
+  uint64_t first_mask = ~0ULL << (lo % 64),
+           last_mask  = ~0ULL >> (63 - hi % 64);
+  if (first == last)
+    return (bits[first] & first_mask & last_mask) != 0;
+  if (bits[first] & first_mask)
+    return true;
+  for (long i=first+1; i<last; ++i)
+    if (bits[i])
+      return true;
+  return (bits[last] & last_mask) != 0;
+}
+
+/**
+ * @brief Builds the reachability table with shift-OR over the input set: the sums of length r are the sums of length r-1 shifted by each value in turn.
+ * A table that would use more than REACHABILITY_MAX_BYTES is built at half the scale until it fits, and then for fewer lengths; a coarser table
+ * allows more sums and lengths outside the table are always allowed, so neither rules out a reachable sum.
+ *
+ * @param table The table to build
+ * @param input_set The input set, of positive values
+ * @param n The number of values in the input set
+ * @param max_len The largest combination length to record
+ * @param max_sum The largest sum to record, e.g. the query value plus epsilon
+ * @param scale The resolution of the table; a finer table prunes more but uses more memory
+ */
+void build_reachability_table(
+  reachability_table* table,
+  double* input_set,
+  int n,
+  int max_len,
+  double max_sum,
+  double scale )
+{
+  size_t max_words = REACHABILITY_MAX_BYTES/sizeof(uint64_t);
+  while ((size_t)((long)floor(max_sum*scale)/64 + 1)*(max_len+1) > max_words && (long)floor(max_sum*scale) >= 64)
+    scale /= 2.0;
+  table->scale   = scale;
+  table->max_bit = (long)floor(max_sum*scale);
+  table->words   = table->max_bit/64 + 1;
+  if ((size_t)table->words*(max_len+1) > max_words)
+    max_len = (int)(max_words/table->words) - 1;
+  table->max_len = max_len;
+  table->bits    = (uint64_t*)calloc((size_t)table->words*(max_len+1), sizeof(uint64_t));
+  if (table->bits == NULL) {
+    printf("Error: not enough memory for a reachability table of %ld sums at %d lengths.\n", table->max_bit+1, max_len+1);
+    exit(EXIT_FAILURE);
+  }
+
+  // The empty combination sums to 0
+  table->bits[0] = 1;
+  for (int len=1; len<=max_len; ++len) {
+    const uint64_t* prev = &table->bits[(len-1)*table->words];
+    uint64_t*       curr = &table->bits[len*table->words];
+    for (int i=0; i<n; ++i) {
+      long shift = (long)floor(input_set[i]*scale);
+      if (shift <= table->max_bit)
+        bitset_or_shifted(curr, prev, table->words, shift);
+    }
+  }
+}
+
+/**
+ * @brief Checks whether a combination of a specified length could sum to within a tolerance of a target value.
+ * The check never rules out a sum that can be reached, but may allow some that cannot; lengths and sums outside the table are always allowed.
+ *
+ * @param table The reachability table
+ * @param len The combination length
+ * @param target The target value
+ * @param tolerance The amount by which the sum can differ from the target
+ * @return true if the target may be reachable
+ */
+bool reachable_sum(const reachability_table* table, int len, double target, double tolerance) {
+  if (len < 0 || len > table->max_len)
+    return true;
+  // A combination whose scaled sum is L sums to between L and L+len at the table scale, so it can only be within the tolerance if L lies between lo and hi
+  double lo = (target - tolerance)*table->scale,
+         hi = floor((target + tolerance)*table->scale);
+  lo = (len == 0) ? ceil(lo) : floor(lo) - len + 1;
+  if (hi < 0)
+    return false;
+  if (hi > table->max_bit)
+    return true;
+  return bitset_any_in_range(&table->bits[len*table->words], (lo > 0) ? (long)lo : 0, (long)hi);
+}
+
+/**
+ * @brief Frees the memory used by a reachability table
+ *
+ * @param table The reachability table
+ */
+void free_reachability_table(reachability_table* table) {
+  free(table->bits);
+  table->bits = NULL;
+}
+
+/**
+ * @brief The reachability table of one input set, kept between queries. A table built for a larger sum answers every smaller query as well,
+ * so it is only rebuilt when a query needs sums beyond those it covers or asks for another scale.
+ *
+ * @param built Set once the table has been built
+ * @param scale The scale the table was asked for, before any coarsening to fit REACHABILITY_MAX_BYTES
+ * @param max_sum The largest sum the table covers
+ * @param table The table
+ */
+struct reachability_cache {
+  bool   built;
+  double scale;
+  double max_sum;
+  reachability_table table;
+};
+
+/**
+ * @brief Initialises an empty reachability cache
+ *
+ * @param cache The cache to initialise
+ */
+void init_reachability_cache(reachability_cache* cache) {
+  cache->built      = false;
+  cache->scale      = 0.0;
+  cache->max_sum    = 0.0;
+  cache->table.bits = NULL;
+}
+
+/**
+ * @brief Checks whether the table held by a reachability cache covers a query, so that it can be used without being rebuilt
+ *
+ * @param cache The cache
+ * @param query_value The query value
+ * @param tolerance The amount by which a sum found by the query can differ from the query value: epsilon plus a zeroboard bin width
+ * @param scale The resolution of the table
+ * @return true if the table has been built at this scale for sums at least as large as the query needs
+ */
+bool reachability_cache_covers(const reachability_cache* cache, double query_value, double tolerance, double scale) {
+  return cache->built && cache->scale == scale && cache->max_sum >= query_value + tolerance + 1.0;
+}
+
+/**
+ * @brief Finds the reachability table for a query, building it if the cache does not cover the query. The table covers sums up to the query value
+ * plus the tolerance, and one more so that rounding the values down to the scale cannot drop a reachable sum.
+ *
+ * @param cache The cache, which must only ever be used with the one input set
+ * @param input_set The input set, sorted
+ * @param n The number of values in the input set
+ * @param query_value The query value
+ * @param tolerance The amount by which a sum found by the query can differ from the query value: epsilon plus a zeroboard bin width
+ * @param scale The resolution of the table; 0 for no table
+ * @return const reachability_table*: the table, or NULL if the scale is 0
+ */
+const reachability_table* cached_reachability_table(
+  reachability_cache* cache,
+  double* input_set,
+  int n,
+  double query_value,
+  double tolerance,
+  double scale )
+{
+  if (scale <= 0)
+    return NULL;
+  if (!reachability_cache_covers(cache, query_value, tolerance, scale)) {
+    double max_sum = query_value + tolerance + 1.0;
+    if (cache->built)
+      free_reachability_table(&cache->table);
+    build_reachability_table(&cache->table, input_set, n, (int)(max_sum/input_set[0]), max_sum, scale);
+    cache->built   = true;
+    cache->scale   = scale;
+    cache->max_sum = max_sum;
+  }
+  return &cache->table;
+}
+
+/**
+ * @brief Frees the table held by a reachability cache
+ *
+ * @param cache The cache
+ */
+void free_reachability_cache(reachability_cache* cache) {
+  if (cache->built)
+    free_reachability_table(&cache->table);
+  cache->built = false;
+}
+
+#endif /* REACHABILITY_H */
@@ -0,0 +1,642 @@
+//
+// resultCache.h
+// A memoized cache of query results, so that query values that recur across a run (common fragments, background ions) are answered without
+// searching again. Results are keyed by the query value and epsilon, quantized to a chosen resolution, and by everything else that changes them:
+// the input set, the zeroboard and the query options. Each entry holds the number of combinations found and the input set indexes of each
+// combination the query printed, so a hit prints exactly what the query would have. Entries are kept while they fit within a memory budget, and
+// the least recently used are evicted.
+// Used by subsetSummer.
+//
+
+#ifndef RESULTCACHE_H
+#define RESULTCACHE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <boost/functional/hash.hpp>
+#include <boost/unordered_map.hpp>
+
+#include "queryOptions.h"
+#include "indexMask.h"
+#include "compositionOutput.h"
+
+/**
+ * @brief Everything other than the query value and epsilon that changes what a query finds or prints. Settings that only change how fast a
+ * query runs, e.g. batched probing and reachability pruning, are not part of it. The context of a query points at the query's own arrays; the
+ * cache keeps one copy of each distinct context, shared by all of its results.
+ *
+ * @param hash The hash of the fields below
+ * @param n The number of values in the input set
+ * @param input_set The processed input set
+ * @param search_space_comb_len The zeroboard combination length
+ * @param search_space_min The minimum combination length of the search space
+ * @param dp The bin scale of the zeroboard
+ * @param combination_length The combination length searched; 0 for every length
+ * @param print_comb Whether the combinations found are printed
+ * @param length_incremental Whether every length is searched in one traversal, which prints the combinations in another order
+ * @param compositions Whether combinations are printed as compositions
+ * @param min_multiplicity The per-index minimums; NULL if there are none
+ * @param max_multiplicity The per-index maximums; NULL if there are none
+ * @param allowed The mask of the indexes that combinations may use; NULL to allow every index
+ * @param value_text Each input set value as a combination prints it, one after another, so that a hit copies text rather than formatting values;
+ * NULL in the context of a query, or if combinations are not printed as values
+ * @param value_offsets Where the text of each value starts in value_text, and where the last ends
+ * @param results The number of cached results that share the copy; unused in the context of a query
+ * @param bytes The memory used by the copy; unused in the context of a query
+ */
+struct result_context {
+  std::size_t hash;
+  int     n;
+  double* input_set;
+  int     search_space_comb_len;
+  int     search_space_min;
+  int     dp;
+  int     combination_length;
+  int     print_comb;
+  bool    length_incremental;
+  bool    compositions;
+  int*    min_multiplicity;
+  int*    max_multiplicity;
+  uint64_t* allowed;
+  char*   value_text;
+  int*    value_offsets;
+  unsigned long results;
+  size_t  bytes;
+};
+
+/**
+ * @brief The key of a cached result
+ *
+ * @param context The context of the query
+ * @param target The query value, quantized
+ * @param tolerance Epsilon, quantized
+ */
+struct result_key {
+  result_context context;
+  long long target;
+  long long tolerance;
+};
+
+/**
+ * @brief A result held by the cache. Entries are linked from the most recently used to the least.
+ *
+ * @param context The cache's copy of the context of the result
+ * @param target The quantized query value of the result
+ * @param tolerance The quantized epsilon of the result
+ * @param results The number of combinations found
+ * @param combinations The combinations printed by the query, in the order printed, each as its length followed by its input set indexes;
+ * NULL if it printed none
+ * @param combinations_len The number of values in combinations
+ * @param bytes The memory used by the entry
+ * @param newer The entry used just after this one; NULL for the most recently used
+ * @param older The entry used just before this one; NULL for the least recently used
+ */
+struct cached_result {
+  result_context* context;
+  long long     target;
+  long long     tolerance;
+  unsigned long results;
+  uint16_t* combinations;
+  size_t    combinations_len;
+  size_t    bytes;
+  cached_result* newer;
+  cached_result* older;
+};
+
+// The results in a cache, by the hash of their key
+typedef boost::unordered_multimap< std::size_t, cached_result* > ResultRegistry;
+// The contexts of the results in a cache, by their hash
+typedef boost::unordered_multimap< std::size_t, result_context* > ContextRegistry;
+
+/**
+ * @brief A cache of query results with a memory budget
+ *
+ * @param quantum The resolution at which query values and epsilons are compared: values that round to the same multiple of it share a result;
+ * 0 to share results only between identical values
+ * @param budget The memory, in bytes, that the cached results and their contexts may use; a result larger than the budget is not cached
+ * @param used The memory used by the cached results and their contexts
+ * @param entries The cached results
+ * @param contexts The cache's copy of each distinct context of the cached results
+ * @param newest The most recently used result
+ * @param oldest The least recently used result, evicted first
+ * @param lock Guards every field of the cache
+ * @param hits Number of queries answered from the cache
+ * @param misses Number of queries that were searched
+ * @param stores Number of results added to the cache
+ * @param evictions Number of results evicted
+ * @param hit_seconds Total time taken to answer the queries that hit, including printing their combinations
+ */
+struct result_cache {
+  double  quantum;
+  size_t  budget;
+  size_t  used;
+  ResultRegistry  entries;
+  ContextRegistry contexts;
+  cached_result* newest;
+  cached_result* oldest;
+  std::mutex lock;
+  unsigned long hits;
+  unsigned long misses;
+  unsigned long stores;
+  unsigned long evictions;
+  double  hit_seconds;
+};
+
+
+/**
+ * @brief Sets up an empty cache
+ *
+ * @param cache The cache to initialise
+ * @param quantum The resolution at which query values and epsilons are compared, e.g. 1e-6 for values given to five decimal places; 0 for exact values
+ * @param budget The memory, in bytes, that the cached results may use
+ */
+void init_result_cache(result_cache* cache, double quantum, size_t budget) {
+  cache->quantum     = (quantum > 0) ? quantum : 0.0;
+  cache->budget      = budget;
+  cache->used        = 0;
+  cache->newest      = NULL;
+  cache->oldest      = NULL;
+  cache->hits        = 0;
+  cache->misses      = 0;
+  cache->stores      = 0;
+  cache->evictions   = 0;
+  cache->hit_seconds = 0.0;
+}
+
+/**
+ * @brief Quantizes a query value or epsilon for a cache key
+ *
+ * @param value The value
+ * @param quantum The resolution of the cache; 0 to keep the value exactly
+ * @return long long: the nearest multiple of the quantum, in quanta, or the bits of the value if the quantum is 0
+ */
+long long quantize_result_value(double value, double quantum) {
+  if (quantum > 0)
+    return llround(value/quantum);
+  long long bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+/**
+ * @brief Calculates the cache key of a query. Its context points at the input set and the arrays of the options, so it is valid while they are.
+ *
+ * @param cache The cache
+ * @param input_set The processed input set
+ * @param n The number of values in the input set
+ * @param search_space_comb_len The zeroboard combination length
+ * @param search_space_min The minimum combination length of the search space
+ * @param dp The order of magnitude of epsilon
+ * @param query_val The query value
+ * @param epsilon The amount by which the query value can vary
+ * @param combination_length The combination length searched; 0 for every length
+ * @param print_comb Require printing of all combinations summing to the query value
+ * @param options The query options
+ * @return result_key: the key
+ */
+result_key query_result_key(
+  result_cache* cache,
+  double* input_set,
+  int n,
+  int search_space_comb_len,
+  int search_space_min,
+  int dp,
+  double query_val,
+  double epsilon,
+  int combination_length,
+  int print_comb,
+  query_options* options )
+{
+  result_key key;
+  result_context* context = &key.context;
+  context->n                     = n;
+  context->input_set             = input_set;
+  context->search_space_comb_len = search_space_comb_len;
+  context->search_space_min      = search_space_min;
+  context->dp                    = dp;
+  context->combination_length    = combination_length;
+  context->print_comb            = print_comb;
+  context->length_incremental    = options->length_incremental;
+  context->compositions          = options->compositions;
+  context->min_multiplicity      = options->min_multiplicity;
+  context->max_multiplicity      = options->max_multiplicity;
+  context->allowed               = (uint64_t*)options->allowed;
+  context->value_text            = NULL;
+  context->value_offsets         = NULL;
+  context->results               = 0;
+  context->bytes                 = 0;
+
+  std::size_t seed = 0;
+  boost::hash_combine(seed, n);
+  for (int i=0; i<n; ++i)
+    boost::hash_combine(seed, input_set[i]);
+  boost::hash_combine(seed, search_space_comb_len);
+  boost::hash_combine(seed, search_space_min);
+  boost::hash_combine(seed, dp);
+  boost::hash_combine(seed, combination_length);
+  boost::hash_combine(seed, print_comb);
+  boost::hash_combine(seed, options->length_incremental);
+  boost::hash_combine(seed, options->compositions);
+  // absent arrays hash differently from any array, so an unconstrained query rarely shares a hash with a constrained one
+  for (int i=0; i<n; ++i) {
+    boost::hash_combine(seed, (options->min_multiplicity != NULL) ? options->min_multiplicity[i] : -2);
+    boost::hash_combine(seed, (options->max_multiplicity != NULL) ? options->max_multiplicity[i] : -2);
+  }
+  if (options->allowed != NULL)
+    for (int i=0; i<index_mask_words(n); ++i)
+      boost::hash_combine(seed, options->allowed[i]);
+  else
+    boost::hash_combine(seed, -1);
+  context->hash = seed;
+
+  key.target    = quantize_result_value(query_val, cache->quantum);
+  key.tolerance = quantize_result_value(epsilon, cache->quantum);
+  return key;
+}
+
+/**
+ * @brief Checks whether two result contexts are the same, field by field, so that results whose contexts only share a hash are kept apart
+ *
+ * @param a The first context
+ * @param b The second context
+ * @return true if every field that changes a result is the same
+ */
+bool same_result_context(const result_context* a, const result_context* b) {
+  if (a->hash != b->hash || a->n != b->n || a->search_space_comb_len != b->search_space_comb_len || a->search_space_min != b->search_space_min
+      || a->dp != b->dp || a->combination_length != b->combination_length || a->print_comb != b->print_comb
+      || a->length_incremental != b->length_incremental || a->compositions != b->compositions)
+    return false;
+  if ((a->min_multiplicity == NULL) != (b->min_multiplicity == NULL) || (a->max_multiplicity == NULL) != (b->max_multiplicity == NULL)
+      || (a->allowed == NULL) != (b->allowed == NULL))
+    return false;
+  int n = a->n;
+  return memcmp(a->input_set, b->input_set, sizeof(double)*n) == 0
+      && (a->min_multiplicity == NULL || memcmp(a->min_multiplicity, b->min_multiplicity, sizeof(int)*n) == 0)
+      && (a->max_multiplicity == NULL || memcmp(a->max_multiplicity, b->max_multiplicity, sizeof(int)*n) == 0)
+      && (a->allowed == NULL || memcmp(a->allowed, b->allowed, sizeof(uint64_t)*index_mask_words(n)) == 0);
+}
+
+/**
+ * @brief Checks whether the cache's copy of a context holds the text of each input set value
+ *
+ * @param context The context
+ * @return true if combinations are printed as values
+ */
+bool result_context_has_text(const result_context* context) {
+  return context->print_comb && !context->compositions;
+}
+
+/**
+ * @brief Calculates the memory used by the cache's copy of a context, not counting the text of the input set values
+ *
+ * @param context The context
+ * @return size_t: the bytes used
+ */
+size_t result_context_bytes(const result_context* context) {
+  int n = context->n;
+  return sizeof(result_context) + sizeof(double)*n + ((context->min_multiplicity != NULL) ? sizeof(int)*n : 0)
+       + ((context->max_multiplicity != NULL) ? sizeof(int)*n : 0) + ((context->allowed != NULL) ? sizeof(uint64_t)*index_mask_words(n) : 0)
+       + (result_context_has_text(context) ? sizeof(int)*(n+1) : 0);
+}
+
+/**
+ * @brief Copies an array for the cache's copy of a context
+ *
+ * @param array The array; may be NULL
+ * @param bytes The size of the array
+ * @return void*: the copy, or NULL if the array is NULL
+ */
+void* copy_context_array(const void* array, size_t bytes) {
+  if (array == NULL)
+    return NULL;
+  void* copy = malloc(bytes);
+  if (copy == NULL) {
+    printf("Error: unable to allocate a cached result context of %zu bytes\n", bytes);
+    exit(EXIT_FAILURE);
+  }
+  memcpy(copy, array, bytes);
+  return copy;
+}
+
+/**
+ * @brief Copies the context of a query for the cache, so that it outlives the query's arrays
+ *
+ * @param context The context of the query
+ * @return result_context*: the copy, used by no results yet
+ */
+result_context* copy_result_context(const result_context* context) {
+  result_context* copy = (result_context*)copy_context_array(context, sizeof(result_context));
+  int n = context->n;
+  copy->input_set        = (double*)copy_context_array(context->input_set, sizeof(double)*n);
+  copy->min_multiplicity = (int*)copy_context_array(context->min_multiplicity, sizeof(int)*n);
+  copy->max_multiplicity = (int*)copy_context_array(context->max_multiplicity, sizeof(int)*n);
+  copy->allowed          = (uint64_t*)copy_context_array(context->allowed, sizeof(uint64_t)*index_mask_words(n));
+  copy->value_text       = NULL;
+  copy->value_offsets    = NULL;
+  copy->results          = 0;
+  copy->bytes            = result_context_bytes(context);
+  if (result_context_has_text(context)) {
+    // each value is formatted as print_combination() formats it
+    copy->value_offsets = (int*)malloc(sizeof(int)*(n+1));
+    int text_len = 0;
+    for (int i=0; i<n; ++i)
+      text_len += snprintf(NULL, 0, "%f ", context->input_set[i]);
+    copy->value_text = (char*)malloc(text_len+1);
+    if (copy->value_offsets == NULL || copy->value_text == NULL) {
+      printf("Error: unable to allocate a cached result context of %zu bytes\n", copy->bytes + text_len);
+      exit(EXIT_FAILURE);
+    }
+    copy->value_offsets[0] = 0;
+    for (int i=0; i<n; ++i)
+      copy->value_offsets[i+1] = copy->value_offsets[i] + sprintf(copy->value_text + copy->value_offsets[i], "%f ", context->input_set[i]);
+    copy->bytes += text_len+1;
+  }
+  return copy;
+}
+
+/**
+ * @brief Frees the cache's copy of a context
+ *
+ * @param context The copy
+ */
+void free_result_context(result_context* context) {
+  free(context->input_set);
+  free(context->min_multiplicity);
+  free(context->max_multiplicity);
+  free(context->allowed);
+  free(context->value_text);
+  free(context->value_offsets);
+  free(context);
+}
+
+/**
+ * @brief Finds the cache's copy of a context. Must be called holding the cache lock.
+ *
+ * @param cache The cache
+ * @param context The context of a query
+ * @return result_context*: the copy, or NULL if no cached result has the context
+ */
+result_context* find_result_context(result_cache* cache, const result_context* context) {
+  std::pair<ContextRegistry::iterator, ContextRegistry::iterator> range = cache->contexts.equal_range(context->hash);
+  for (ContextRegistry::iterator copy=range.first; copy!=range.second; ++copy)
+    if (same_result_context(copy->second, context))
+      return copy->second;
+  return NULL;
+}
+
+/**
+ * @brief Hashes the key of a result for the registry
+ *
+ * @param context_hash The hash of the context of the result
+ * @param target The quantized query value
+ * @param tolerance The quantized epsilon
+ * @return std::size_t: the hash
+ */
+std::size_t result_key_hash(std::size_t context_hash, long long target, long long tolerance) {
+  std::size_t seed = context_hash;
+  boost::hash_combine(seed, target);
+  boost::hash_combine(seed, tolerance);
+  return seed;
+}
+
+/**
+ * @brief Unlinks an entry from the recency list. Must be called holding the cache lock.
+ *
+ * @param cache The cache
+ * @param entry The entry
+ */
+void unlink_cached_result(result_cache* cache, cached_result* entry) {
+  if (entry->newer != NULL) entry->newer->older = entry->older;
+  else                      cache->newest       = entry->older;
+  if (entry->older != NULL) entry->older->newer = entry->newer;
+  else                      cache->oldest       = entry->newer;
+  entry->newer = NULL;
+  entry->older = NULL;
+}
+
+/**
+ * @brief Links an entry into the recency list as the most recently used. Must be called holding the cache lock.
+ *
+ * @param cache The cache
+ * @param entry The entry, not in the list
+ */
+void link_cached_result(result_cache* cache, cached_result* entry) {
+  entry->newer = NULL;
+  entry->older = cache->newest;
+  if (cache->newest != NULL)
+    cache->newest->newer = entry;
+  cache->newest = entry;
+  if (cache->oldest == NULL)
+    cache->oldest = entry;
+}
+
+/**
+ * @brief Finds the entry with a key. Must be called holding the cache lock.
+ *
+ * @param cache The cache
+ * @param context The cache's copy of the context of the key
+ * @param target The quantized query value
+ * @param tolerance The quantized epsilon
+ * @return ResultRegistry::iterator: the entry, or the end of the registry if there is none
+ */
+ResultRegistry::iterator find_cached_result(result_cache* cache, const result_context* context, long long target, long long tolerance) {
+  std::pair<ResultRegistry::iterator, ResultRegistry::iterator> range = cache->entries.equal_range(result_key_hash(context->hash, target, tolerance));
+  for (ResultRegistry::iterator entry=range.first; entry!=range.second; ++entry)
+    if (entry->second->context == context && entry->second->target == target && entry->second->tolerance == tolerance)
+      return entry;
+  return cache->entries.end();
+}
+
+/**
+ * @brief Frees a cached result. Its context is not freed.
+ *
+ * @param entry The entry
+ */
+void free_cached_result(cached_result* entry) {
+  free(entry->combinations);
+  free(entry);
+}
+
+/**
+ * @brief Prints a cached combination as print_combination() would
+ *
+ * @param output The stream to print to
+ * @param context The cache's copy of the context of the result
+ * @param combination The input set indexes of the combination
+ * @param len The combination length
+ */
+void print_cached_combination(FILE* output, const result_context* context, const uint16_t* combination, int len) {
+  if (!result_context_has_text(context)) {
+    print_combination(output, context->input_set, NULL, 0, combination, len, context->compositions);
+    return;
+  }
+  for (int i=0; i<len; ++i)
+    fwrite(context->value_text + context->value_offsets[combination[i]], 1, context->value_offsets[combination[i]+1] - context->value_offsets[combination[i]], output);
+  fputc('\n', output);
+}
+
+/**
+ * @brief Answers a query from the cache if it holds the query's result: prints the stored combinations and gives the number of combinations found
+ *
+ * @param cache The cache
+ * @param key The key of the query
+ * @param output The stream to print the combinations to
+ * @param results Set to the number of combinations found, on a hit
+ * @return true on a hit; false if the query must be searched
+ */
+bool lookup_cached_result(result_cache* cache, const result_key* key, FILE* output, unsigned long* results) {
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> guard(cache->lock);
+  result_context* context = find_result_context(cache, &key->context);
+  ResultRegistry::iterator found = (context != NULL) ? find_cached_result(cache, context, key->target, key->tolerance) : cache->entries.end();
+  if (found == cache->entries.end()) {
+    ++cache->misses;
+    return false;
+  }
+  cached_result* entry = found->second;
+  unlink_cached_result(cache, entry);
+  link_cached_result(cache, entry);
+  // the combinations are printed under the lock, so the entry cannot be evicted while it is being read
+  for (size_t i=0; i<entry->combinations_len; i+=entry->combinations[i]+1)
+    print_cached_combination(output, context, entry->combinations + i+1, entry->combinations[i]);
+  *results = entry->results;
+  ++cache->hits;
+  cache->hit_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return true;
+}
+
+/**
+ * @brief Evicts the least recently used result. Must be called holding the cache lock; the entry, and its context if no other result shares
+ * it, are added to the lists to be freed once the lock is released.
+ *
+ * @param cache The cache
+ * @param evicted The entries to free
+ * @param released The contexts to free
+ */
+void evict_cached_result(result_cache* cache, std::vector<cached_result*>* evicted, std::vector<result_context*>* released) {
+  cached_result* oldest = cache->oldest;
+  unlink_cached_result(cache, oldest);
+  cache->entries.erase(find_cached_result(cache, oldest->context, oldest->target, oldest->tolerance));
+  cache->used -= oldest->bytes;
+  ++cache->evictions;
+  evicted->push_back(oldest);
+  if (--oldest->context->results == 0) {
+    std::pair<ContextRegistry::iterator, ContextRegistry::iterator> range = cache->contexts.equal_range(oldest->context->hash);
+    for (ContextRegistry::iterator copy=range.first; copy!=range.second; ++copy)
+      if (copy->second == oldest->context) {
+        cache->contexts.erase(copy);
+        break;
+      }
+    cache->used -= oldest->context->bytes;
+    released->push_back(oldest->context);
+  }
+}
+
+/**
+ * @brief Adds the result of a completed query to the cache, evicting the least recently used results until it fits within the budget.
+ * A result that is already cached, e.g. stored by another thread meanwhile, or that is larger than the whole budget, is not added.
+ *
+ * @param cache The cache
+ * @param key The key of the query
+ * @param results The number of combinations found
+ * @param combinations The combinations printed by the query, each as its length followed by its input set indexes; the cache keeps its own copy
+ * @param combinations_len The number of values in combinations
+ */
+void store_cached_result(result_cache* cache, const result_key* key, unsigned long results, const uint16_t* combinations, size_t combinations_len) {
+  // the context is copied before the lock is taken, and freed again if the cache already has a copy
+  size_t          bytes         = sizeof(cached_result) + sizeof(uint16_t)*combinations_len;
+  result_context* new_context   = copy_result_context(&key->context);
+  size_t          context_bytes = new_context->bytes;
+  if (bytes + context_bytes > cache->budget) {
+    free_result_context(new_context);
+    return;
+  }
+  cached_result* entry = (cached_result*)malloc(sizeof(cached_result));
+  uint16_t*      copy  = (combinations_len > 0) ? (uint16_t*)malloc(sizeof(uint16_t)*combinations_len) : NULL;
+  if (entry == NULL || (combinations_len > 0 && copy == NULL)) {
+    printf("Error: unable to allocate a cached result of %zu bytes\n", bytes);
+    exit(EXIT_FAILURE);
+  }
+  if (combinations_len > 0)
+    memcpy(copy, combinations, sizeof(uint16_t)*combinations_len);
+  entry->target           = key->target;
+  entry->tolerance        = key->tolerance;
+  entry->results          = results;
+  entry->combinations     = copy;
+  entry->combinations_len = combinations_len;
+  entry->bytes            = bytes;
+
+  std::vector<cached_result*>  evicted;
+  std::vector<result_context*> released;
+  {
+    std::lock_guard<std::mutex> guard(cache->lock);
+    result_context* context = find_result_context(cache, &key->context);
+    if (context != NULL && find_cached_result(cache, context, key->target, key->tolerance) != cache->entries.end()) {
+      evicted.push_back(entry);
+    }
+    else {
+      while (cache->oldest != NULL && cache->used + bytes + ((context == NULL) ? context_bytes : 0) > cache->budget) {
+        evict_cached_result(cache, &evicted, &released);
+        // the eviction may have released the copy of this result's context
+        context = find_result_context(cache, &key->context);
+      }
+      if (context == NULL) {
+        context     = new_context;
+        new_context = NULL;
+        cache->contexts.insert(ContextRegistry::value_type(context->hash, context));
+        cache->used += context->bytes;
+      }
+      ++context->results;
+      entry->context = context;
+      cache->entries.insert(ResultRegistry::value_type(result_key_hash(context->hash, entry->target, entry->tolerance), entry));
+      link_cached_result(cache, entry);
+      cache->used += bytes;
+      ++cache->stores;
+    }
+  }
+  for (size_t i=0; i<evicted.size(); ++i)
+    free_cached_result(evicted[i]);
+  for (size_t i=0; i<released.size(); ++i)
+    free_result_context(released[i]);
+  if (new_context != NULL)
+    free_result_context(new_context);
+}
+
+/**
+ * @brief Prints the number of results held, the memory they use, the hit rate and the average time taken by a hit
+ *
+ * @param cache The cache
+ * @param output The stream to print to
+ */
+void print_result_cache(result_cache* cache, FILE* output) {
+  std::lock_guard<std::mutex> guard(cache->lock);
+  unsigned long lookups = cache->hits + cache->misses;
+  fprintf(output, "Result cache: %lu result(s), %zu of %zu bytes, %lu hit(s), %lu miss(es) (%.1f%% hit rate), %lu store(s), %lu eviction(s), %.3f us per hit\n",
+          (unsigned long)cache->entries.size(), cache->used, cache->budget, cache->hits, cache->misses,
+          (lookups > 0) ? 100.0*cache->hits/lookups : 0.0, cache->stores, cache->evictions,
+          (cache->hits > 0) ? 1e6*cache->hit_seconds/cache->hits : 0.0);
+}
+
+/**
+ * @brief Frees every result in the cache. No query may be using the cache.
+ *
+ * @param cache The cache
+ */
+void free_result_cache(result_cache* cache) {
+  for (ResultRegistry::iterator entry=cache->entries.begin(); entry!=cache->entries.end(); ++entry)
+    free_cached_result(entry->second);
+  for (ContextRegistry::iterator context=cache->contexts.begin(); context!=cache->contexts.end(); ++context)
+    free_result_context(context->second);
+  cache->entries.clear();
+  cache->contexts.clear();
+  cache->newest = NULL;
+  cache->oldest = NULL;
+  cache->used   = 0;
+}
+
+#endif /* RESULTCACHE_H */
@@ -0,0 +1,214 @@
+//
+// resultHeap.h
+// A bounded max-heap that keeps the best N combinations ranked by how far their sum is from the query value.
+// Used by zeroboard and subsetSummer when a ranked query is requested through query_options.
+//
+
+#ifndef RESULTHEAP_H
+#define RESULTHEAP_H
+
+#include <stdint.h>
+
+#include "compositionOutput.h"
+
+/**
+ * @brief A combination held in the result heap
+ *
+ * @param error The absolute difference between the combination sum and the query value
+ * @param sum The combination sum
+ * @param combination Pointer to an array of input set indexes in ascending order
+ * @param combination_len Number of indexes stored in combination
+ */
+struct ranked_result {
+  double error;
+  double sum;
+  int* combination;
+  int combination_len;
+};
+
+/**
+ * @brief A bounded max-heap of ranked results keyed on error. The root is the worst result kept so far,
+ * so once the heap is full its error is the tolerance a new combination has to beat.
+ *
+ * @param capacity The number of results to keep (N)
+ * @param size The number of results currently held
+ * @param sorted Set by sort_result_heap() while the items are in order of error rather than in heap order
+ * @param items The heap array, of length capacity
+ */
+struct result_heap {
+  int capacity;
+  int size;
+  bool sorted;
+  ranked_result* items;
+};
+
+
+/**
+ * @brief Allocates an empty result heap
+ *
+ * @param heap The heap to initialise
+ * @param capacity The number of results to keep
+ */
+void init_result_heap(result_heap* heap, int capacity) {
+  heap->capacity = capacity;
+  heap->size     = 0;
+  heap->sorted   = false;
+  heap->items    = (ranked_result*)malloc(sizeof(ranked_result)*capacity);
+}
+
+/**
+ * @brief Calculates the current tolerance of a ranked query. Until the heap is full this is epsilon; after that it is the error of the worst result kept,
+ * which shrinks as better results are found.
+ *
+ * @param heap The result heap
+ * @param epsilon The amount by which the query value can vary
+ * @return double: the effective tolerance
+ */
+double result_heap_window(result_heap* heap, double epsilon) {
+  if (heap->size < heap->capacity || heap->size == 0)
+    return epsilon;
+  // a sorted heap holds its worst result last rather than at the root
+  double worst = heap->items[heap->sorted ? heap->size-1 : 0].error;
+  return (worst < epsilon) ? worst : epsilon;
+}
+
+/**
+ * @brief Restores the heap property downwards from a position in the heap
+ *
+ * @param heap The result heap
+ * @param pos The position to sift down from
+ * @param size The number of items taking part in the heap
+ */
+void result_heap_sift_down(result_heap* heap, int pos, int size) {
+  while (2*pos+1 < size) {
+    int child = 2*pos+1;
+    if (child+1 < size && heap->items[child+1].error > heap->items[child].error)
+      ++child;
+    if (heap->items[pos].error >= heap->items[child].error)
+      return;
+    ranked_result temp = heap->items[pos];
+    heap->items[pos]   = heap->items[child];
+    heap->items[child] = temp;
+    pos = child;
+  }
+}
+
+/**
+ * @brief Restores the heap property over every item, e.g. after the items have been sorted
+ *
+ * @param heap The result heap
+ */
+void rebuild_result_heap(result_heap* heap) {
+  for (int pos=heap->size/2-1; pos>=0; --pos)
+    result_heap_sift_down(heap, pos, heap->size);
+  heap->sorted = false;
+}
+
+/**
+ * @brief Offers a combination, made up of a prefix followed by a suffix, to the heap. It is kept if the heap is not full or if it beats the worst result kept,
+ * which is then discarded. A heap sorted by sort_result_heap() is rebuilt first, so the results of several queries can be ranked in one heap.
+ *
+ * @param heap The result heap
+ * @param error The absolute difference between the combination sum and the query value
+ * @param sum The combination sum
+ * @param prefix The prefix indexes, may be NULL if prefix_len is 0
+ * @param prefix_len Number of indexes in the prefix
+ * @param suffix The suffix indexes, may be NULL if suffix_len is 0
+ * @param suffix_len Number of indexes in the suffix
+ * @return true if the combination was kept
+ */
+bool result_heap_offer(
+  result_heap* heap,
+  double error,
+  double sum,
+  int* prefix,
+  int prefix_len,
+  const uint16_t* suffix,
+  int suffix_len )
+{
+  if (heap->capacity == 0)
+    return false;
+  if (heap->sorted)
+    rebuild_result_heap(heap);
+  int pos = 0;
+  if (heap->size < heap->capacity) {
+    // Not full: append and sift up
+    pos = heap->size++;
+    heap->items[pos].combination = NULL;
+  } else if (error < heap->items[0].error) {
+    // Full: replace the worst result
+    free(heap->items[0].combination);
+    heap->items[0].combination = NULL;
+  } else
+    return false;
+
+  ranked_result* result = &heap->items[pos];
+  result->error           = error;
+  result->sum             = sum;
+  result->combination_len = prefix_len + suffix_len;
+  result->combination     = (int*)malloc(sizeof(int)*result->combination_len);
+  for (int i=0; i<prefix_len; ++i)
+    result->combination[i] = prefix[i];
+  for (int i=0; i<suffix_len; ++i)
+    result->combination[prefix_len+i] = suffix[i];
+
+  if (pos == 0)
+    result_heap_sift_down(heap, 0, heap->size);
+  else {
+    while (pos > 0 && heap->items[(pos-1)/2].error < heap->items[pos].error) {
+      ranked_result temp         = heap->items[pos];
+      heap->items[pos]           = heap->items[(pos-1)/2];
+      heap->items[(pos-1)/2]     = temp;
+      pos = (pos-1)/2;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Sorts the results held in the heap from smallest to largest error, in place. The heap property no longer holds afterwards,
+ * so the heap is marked as sorted and result_heap_offer() rebuilds it before any further result is added.
+ *
+ * @param heap The result heap
+ */
+void sort_result_heap(result_heap* heap) {
+  for (int end=heap->size-1; end>0; --end) {
+    ranked_result temp = heap->items[0];
+    heap->items[0]     = heap->items[end];
+    heap->items[end]   = temp;
+    result_heap_sift_down(heap, 0, end);
+  }
+  heap->sorted = true;
+}
+
+/**
+ * @brief Prints the results held in the heap, which should have been sorted by sort_result_heap()
+ *
+ * @param heap The result heap
+ * @param input_set The input set that the combination indexes refer to
+ * @param output The stream to print to
+ * @param compositions Print each combination as its composition rather than its values
+ */
+void print_ranked_results(result_heap* heap, double* input_set, FILE* output, bool compositions) {
+  for (int i=0; i<heap->size; ++i) {
+    fprintf(output, "%e : ", heap->items[i].error);
+    print_combination(output, input_set, heap->items[i].combination, heap->items[i].combination_len, NULL, 0, compositions);
+  }
+}
+
+/**
+ * @brief Frees the memory used by a result heap and the combinations it holds
+ *
+ * @param heap The result heap
+ */
+void free_result_heap(result_heap* heap) {
+  for (int i=0; i<heap->size; ++i)
+    free(heap->items[i].combination);
+  free(heap->items);
+  heap->items    = NULL;
+  heap->size     = 0;
+  heap->capacity = 0;
+  heap->sorted   = false;
+}
+
+#endif /* RESULTHEAP_H */
@@ -0,0 +1,222 @@
+//
+// sampler.h
+// Draws combinations uniformly at random from all combinations summing to a query value, without listing them.
+// The number of combinations in each part of the search space is counted once, and each draw then walks a single path through it.
+// Used by UnboundedSubsetSum.
+//
+
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <random>
+#include <boost/functional/hash.hpp>
+
+// Slack, in scaled units, used when scaling the query window so that floating point noise does not exclude its end points
+#define SAMPLE_SLACK 1e-6
+
+/**
+ * @brief A part of the search space: the combinations of a fixed length, using input set indexes from 'first' upwards, whose scaled sum lies in [lo, lo + width]
+ *
+ * @param len The combination length
+ * @param first The smallest input set index that may be used
+ * @param lo The smallest scaled sum allowed
+ */
+struct sample_state {
+  int       len;
+  int       first;
+  long long lo;
+};
+
+bool operator==(const sample_state& a, const sample_state& b) {
+  return a.len == b.len && a.first == b.first && a.lo == b.lo;
+}
+
+std::size_t hash_value(const sample_state& state) {
+  std::size_t seed = 0;
+  boost::hash_combine(seed, state.len);
+  boost::hash_combine(seed, state.first);
+  boost::hash_combine(seed, state.lo);
+  return seed;
+}
+
+// Memo of the number of combinations in each part of the search space that has been counted
+typedef boost::unordered_map< sample_state, double > SampleCounts;
+
+/**
+ * @brief A sampler for the combinations of an input set that sum to a query value.
+ * Values and sums are compared at a resolution of 1/scale: each value is rounded to the nearest multiple of 1/scale.
+ *
+ * @param n The number of values in the input set
+ * @param input_set The input set
+ * @param scaled The input set values, scaled and rounded to integers
+ * @param lo The smallest scaled sum allowed, from the query value - epsilon
+ * @param width The range of scaled sums allowed above lo, from 2*epsilon
+ * @param max_len The longest combination length that can reach the query value
+ * @param length_counts The number of combinations of each length, from 0 to max_len
+ * @param total The number of combinations of all lengths
+ * @param counts The memo of counted parts of the search space
+ * @param rng The random number generator used for draws
+ */
+struct combination_sampler {
+  int        n;
+  double*    input_set;
+  long long* scaled;
+  long long  lo;
+  long long  width;
+  int        max_len;
+  double*    length_counts;
+  double     total;
+  SampleCounts counts;
+  std::mt19937_64 rng;
+};
+
+
+/**
+ * @brief Counts the combinations in a part of the search space, remembering the count so that each part is only counted once.
+ * Combinations are counted by their first index: a combination starting at index j is index j followed by a combination of one less length from index j upwards.
+ *
+ * @param sampler The sampler
+ * @param len The combination length
+ * @param first The smallest input set index that may be used
+ * @param lo The smallest scaled sum allowed
+ * @return double: the number of combinations
+ */
+double count_combinations(combination_sampler* sampler, int len, int first, long long lo) {
+  long long hi = lo + sampler->width;
+  if (len == 0)
+    return (lo <= 0 && hi >= 0) ? 1.0 : 0.0;
+  // Logic: the sums of this part of the search space lie between len * the smallest and len * the largest value that may be used
+  if (first >= sampler->n || len*sampler->scaled[first] > hi || len*sampler->scaled[sampler->n-1] < lo)
+    return 0.0;
+
+  sample_state state = { len, first, lo };
+  SampleCounts::iterator found = sampler->counts.find(state);
+  if (found != sampler->counts.end())
+    return found->second;
+
+  double count = 0.0;
+  for (int j=first; j<sampler->n; ++j) {
+    // Every later value gives an even larger minimum sum
+    if (len*sampler->scaled[j] > hi)
+      break;
+    count += count_combinations(sampler, len-1, j, lo - sampler->scaled[j]);
+  }
+  sampler->counts[state] = count;
+  return count;
+}
+
+/**
+ * @brief Prepares a sampler by counting the combinations of every length that sum to the query value
+ *
+ * @param sampler The sampler to initialise
+ * @param input_set The sorted input set
+ * @param n The number of values in the input set
+ * @param query_val The target query value
+ * @param epsilon The amount by which the target query value can vary
+ * @param scale The resolution at which values and sums are compared, e.g. 1e5 for values with five decimal places
+ * @param combination_length If not 0, only combinations of this length are sampled
+ * @param seed The seed for the random number generator
+ */
+void init_combination_sampler(
+  combination_sampler* sampler,
+  double* input_set,
+  int n,
+  double query_val,
+  double epsilon,
+  double scale,
+  int combination_length,
+  unsigned long long seed )
+{
+  sampler->n         = n;
+  sampler->input_set = input_set;
+  sampler->scaled    = (long long*)malloc(sizeof(long long)*n);
+  for (int i=0; i<n; ++i)
+    sampler->scaled[i] = llround(input_set[i]*scale);
+  sampler->lo        = (long long)ceil((query_val - epsilon)*scale - SAMPLE_SLACK);
+  sampler->width     = (long long)floor((query_val + epsilon)*scale + SAMPLE_SLACK) - sampler->lo;
+  sampler->max_len   = (sampler->scaled[0] > 0) ? (int)((sampler->lo + sampler->width)/sampler->scaled[0]) : 0;
+  sampler->rng.seed(seed);
+
+  sampler->length_counts = (double*)calloc(sampler->max_len+1, sizeof(double));
+  sampler->total         = 0.0;
+  for (int len=1; len<=sampler->max_len; ++len) {
+    if (combination_length != 0 && combination_length != len)
+      continue;
+    sampler->length_counts[len] = count_combinations(sampler, len, 0, sampler->lo);
+    sampler->total += sampler->length_counts[len];
+  }
+}
+
+/**
+ * @brief Picks a random number between 0 and a total
+ *
+ * @param sampler The sampler holding the random number generator
+ * @param total The total
+ * @return double: the random number, in [0, total)
+ */
+double sampler_uniform(combination_sampler* sampler, double total) {
+  std::uniform_real_distribution<double> distribution(0.0, total);
+  return distribution(sampler->rng);
+}
+
+/**
+ * @brief Draws one combination uniformly at random from all combinations summing to the query value.
+ * The length is picked in proportion to the number of combinations of each length, then each index in turn in proportion to the number of combinations that start with it.
+ *
+ * @param sampler The sampler
+ * @param combination Set to the input set indexes of the combination, in ascending order; must have room for max_len indexes
+ * @return int: the length of the combination, or 0 if no combination sums to the query value
+ */
+int sample_combination(combination_sampler* sampler, int* combination) {
+  if (sampler->total <= 0.0)
+    return 0;
+
+  // Pick the combination length
+  double pick = sampler_uniform(sampler, sampler->total);
+  int    len  = sampler->max_len;
+  for (int l=1; l<=sampler->max_len; ++l) {
+    if (pick < sampler->length_counts[l]) {
+      len = l;
+      break;
+    }
+    pick -= sampler->length_counts[l];
+  }
+  while (sampler->length_counts[len] <= 0.0)
+    --len;
+
+  // Walk one path through the search space, picking each index in proportion to the combinations that start with it
+  int       first = 0;
+  long long lo    = sampler->lo;
+  for (int dim=0; dim<len; ++dim) {
+    int    remaining = len-dim;
+    double total     = count_combinations(sampler, remaining, first, lo);
+    pick = sampler_uniform(sampler, total);
+    int chosen = -1;
+    for (int j=first; j<sampler->n; ++j) {
+      double count = count_combinations(sampler, remaining-1, j, lo - sampler->scaled[j]);
+      if (count <= 0.0)
+        continue;
+      chosen = j;
+      if (pick < count)
+        break;
+      pick -= count;
+    }
+    combination[dim] = chosen;
+    first = chosen;
+    lo   -= sampler->scaled[chosen];
+  }
+  return len;
+}
+
+/**
+ * @brief Frees the memory used by a sampler
+ *
+ * @param sampler The sampler
+ */
+void free_combination_sampler(combination_sampler* sampler) {
+  free(sampler->scaled);
+  free(sampler->length_counts);
+  sampler->counts.clear();
+}
+
+#endif /* SAMPLER_H */
@@ -7,6 +7,353 @@
 #define SUBSETSUMMER_H
 
 #include "zeroboard.h"
+#include "combinationKernels.h"
+#include "bulkLoad.h"
+#include "reachability.h"
+#include "queryDeadline.h"
+#include "probeBatch.h"
+#include "queryTrace.h"
+#include "resultCache.h"
+
+
+/**
+ * @brief The ranked version of queryZeroBoard(). Keeps the combinations closest to the target value in the result heap held by the query options. 
+ * The branch and bound works on the window [query_val - w, query_val + w], where w starts at epsilon and shrinks to the error of the worst result kept 
+ * once the heap is full, so the search space that is explored narrows as better combinations are found.
+ * 
+ * @param input_set The input dataset
+ * @param n The number of values in the input datatset
+ * @param zeroboard The hash-table data structure that stores combinations summing to a target value
+ * @param search_space_comb_len The length of the generalized solution space contained in the zeroboard
+ * @param search_space_min The user-defined minimum combination length to be searched
+ * @param dp The bin scale the zeroboard was written with, as set by process_inputs() (0 if epsilon is 0); not a number of decimal places
+ * @param query_val The target query value
+ * @param epsilon The amount by which the target query value can vary
+ * @param combination_length The user-defined value that determines a specific combination length to search; 0 by default searches all lengths
+ * @param print_details Reuirement to print details about the algorithm run
+ * @param print_comb Requirement to print the ranked combinations
+ * @param options The query options holding the result heap and any multiplicity constraints
+ * @param reachability The table of sums reachable by each combination length; NULL to prune on the minimum and maximum sums only
+ */
+void queryZeroBoardRanked(
+  double *input_set,
+  int n,
+  const Board* zeroboard,
+  int search_space_comb_len,
+  int search_space_min,
+  int dp,
+  double query_val,
+  double epsilon,
+  int combination_length,
+  int print_details,
+  int print_comb,
+  query_options* options,
+  const reachability_table* reachability )
+{
+
+  // ** Function Variables **
+    result_heap* heap       = options->ranked;
+    FILE*   output          = query_output(options);
+    bool    bounded         = has_multiplicity_bounds(options),
+            masked          = has_index_mask(options);
+    // suffix sums use the kernel specialised for the zeroboard combination length, chosen once for the whole query
+    combination_sum_kernel suffix_sum = select_combination_sum(search_space_comb_len);
+    int     n_zeroBased     = n-1,
+            max_comb_len    = (int)((query_val+epsilon)/input_set[0]),
+            end_length      = search_space_comb_len;
+    double  scale           = bin_scale(dp),
+            input_set_max   = input_set[n_zeroBased],
+            window          = epsilon;
+    // check for minimum length combination
+    if (max_comb_len < search_space_min)
+      max_comb_len          = search_space_min;
+    // if combination length set, only search that length
+    if (combination_length != 0) {
+      max_comb_len          = combination_length;
+      end_length            = combination_length-1;
+    }
+    // tracking arrays
+    int     array_size      = (max_comb_len > search_space_comb_len) ? max_comb_len-search_space_comb_len : 1,
+            array[array_size];
+    double  sums[array_size];
+    // the query stops early, keeping the closest combinations found so far, if it runs out of time or is cancelled
+    query_deadline deadline;
+    start_query_deadline(&deadline, options);
+    int     stopped_length  = 0;
+  // *** End Function Variables ***
+
+  // *** Begin Iterating Through Search Space ***
+
+  // iterate through valid combination lengths above the zeroboard combination length
+  for (int curr_comb_len=max_comb_len; curr_comb_len>end_length && curr_comb_len>search_space_comb_len; --curr_comb_len) {
+    if (stopped_length != 0 || query_must_stop(&deadline)) {
+      if (stopped_length == 0)
+        stopped_length = curr_comb_len;
+      break;
+    }
+    int     prefix_len = curr_comb_len-search_space_comb_len,
+            dim        = 0;
+    double  comb_max   = curr_comb_len*input_set_max;
+    if (comb_max < query_val - window)
+      break;
+    array[0] = 0;
+
+    while (dim >= 0) {
+      if (query_should_stop(&deadline)) {
+        stopped_length = curr_comb_len;
+        break;
+      }
+      // Every value at this position has been tried, so move back to the previous position
+      if (array[dim] > n_zeroBased) {
+        --dim;
+        if (dim >= 0)
+          ++array[dim];
+        continue;
+      }
+      // Logic: the remaining values of a combination lie between the current value and the input set maximum, 
+      //        so the current position can only hold combinations summing to between mins and maxs
+      window    = result_heap_window(heap, epsilon);
+      sums[dim] = ((dim > 0) ? sums[dim-1] : 0.0) + input_set[array[dim]];
+      int    remaining = curr_comb_len-(dim+1);
+      double mins      = sums[dim] + input_set[array[dim]]*remaining,
+             maxs      = sums[dim] + input_set_max*remaining;
+
+      // Every later value at this position gives an even larger minimum, so move back to the previous position
+      if (mins > query_val + window + BOUND_SLACK) {
+        --dim;
+        if (dim >= 0)
+          ++array[dim];
+      
+      // Move along while the maximum for this position cannot reach the window, the value is not allowed, or no combination of the remaining length can complete the prefix
+      } else if (maxs < query_val - window - BOUND_SLACK
+                 || (masked && !mask_has_index(options->allowed, array[dim]))
+                 || (bounded && !bounded_prefix_can_reach(options, input_set, &array[0], dim+1, remaining, query_val, window))
+                 || (reachability != NULL && !reachable_sum(reachability, remaining, query_val - sums[dim], window + BOUND_SLACK))) {
+        ++array[dim];
+
+      // The prefix is complete, so check the zeroboard using the calculated tare value
+      } else if (dim == prefix_len-1) {
+        double tare_value = (comb_max - query_val) - ((dim+1)*input_set_max - sums[dim]);
+        get_ranked_combinations(input_set, zeroboard, tare_value, scale, &array[0], prefix_len, search_space_comb_len, query_val, epsilon, suffix_sum, options);
+        ++array[dim];
+
+      // Move to the next position in the prefix
+      } else {
+        ++dim;
+        array[dim] = array[dim-1];
+      }
+    }
+  }
+
+  // *** END Iterating Through Search Space ***
+
+  // Check the combination lengths stored in the zeroboard, from the zeroboard combination length down to 1
+  for (int len=search_space_comb_len; len>=1; --len) {
+    if (len*input_set_max < query_val - result_heap_window(heap, epsilon) - BOUND_SLACK)
+      break;
+    if (combination_length != 0 && combination_length != len)
+      continue;
+    if (stopped_length != 0 || query_must_stop(&deadline)) {
+      if (stopped_length == 0)
+        stopped_length = len;
+      break;
+    }
+    if (!bounded || bounded_prefix_can_reach(options, input_set, NULL, 0, len, query_val, result_heap_window(heap, epsilon)))
+      get_ranked_combinations(input_set, zeroboard, len*input_set_max - query_val, scale, &array[0], 0, len, query_val, epsilon, select_combination_sum(len), options);
+  }
+
+  // Sort the kept combinations from closest to furthest and print them if required
+  sort_result_heap(heap);
+  if (print_details) fprintf(output, "Ranked results: %d of the closest %d within %f\n", heap->size, heap->capacity, epsilon);
+  if (print_comb) print_ranked_results(heap, input_set, output, composition_output(options));
+  report_query_status(&deadline, options, stopped_length, heap->size, print_details);
+  if (print_details) fprintf(output, "\n");
+}
+
+
+
+/**
+ * @brief The length-incremental version of queryZeroBoard(). Rather than searching the prefixes of every combination length from scratch, 
+ * each prefix is visited once: a prefix of length p is completed from the zeroboard to a combination of length p + search_space_comb_len, 
+ * and extended by one more value for the longer lengths. A prefix is only extended while the bounds of some longer length can still reach the query value.
+ * Each completion is read from every bin within epsilon of its key and summed, as get_stored_length_combinations() does, so only combinations
+ * within epsilon are reported. Combinations are reported in prefix order rather than by length; the number of each length is printed once the search is finished.
+ * 
+ * @param input_set The input dataset
+ * @param n The number of values in the input datatset
+ * @param zeroboard The hash-table data structure that stores combinations summing to a target value
+ * @param search_space_comb_len The length of the generalized solution space contained in the zeroboard
+ * @param search_space_min The user-defined minimum combination length to be searched
+ * @param dp The bin scale the zeroboard was written with, as set by process_inputs() (0 if epsilon is 0); not a number of decimal places
+ * @param query_val The target query value
+ * @param epsilon The amount by which the target query value can vary
+ * @param combination_length The user-defined value that determines a specific combination length to search; 0 by default searches all lengths
+ * @param print_details Reuirement to print details about the algorithm run
+ * @param print_comb Requirement to print all combinations summing to the target value
+ * @param options The query options; multiplicity constraints, the allowed index mask, the output stream and the deadline are supported. 
+ *                A query that stops early leaves every length above the zeroboard combination length incomplete.
+ * @param reachability The table of sums reachable by each combination length; NULL to prune on the minimum and maximum sums only
+ */
+void queryZeroBoardIncremental(
+  double *input_set,
+  int n,
+  const Board* zeroboard,
+  int search_space_comb_len,
+  int search_space_min,
+  int dp,
+  double query_val,
+  double epsilon,
+  int combination_length,
+  int print_details,
+  int print_comb,
+  query_options* options,
+  const reachability_table* reachability )
+{
+
+  // ** Function Variables **
+    FILE*   output          = query_output(options);
+    bool    bounded         = has_multiplicity_bounds(options),
+            masked          = has_index_mask(options);
+    // suffix sums use the kernel specialised for the zeroboard combination length, chosen once for the whole query
+    combination_sum_kernel suffix_sum = select_combination_sum(search_space_comb_len);
+    int     k               = search_space_comb_len,
+            n_zeroBased     = n-1,
+            max_comb_len    = (int)((query_val+epsilon)/input_set[0]),
+            end_length      = search_space_comb_len;
+    // zeroboard queries sum each combination and report only those within epsilon, so the bounds allow for epsilon and rounding only
+    double  input_set_max   = input_set[n_zeroBased],
+            scale           = bin_scale(dp),
+            tolerance       = epsilon + BOUND_SLACK,
+            lo              = query_val - tolerance,
+            hi              = query_val + tolerance;
+    if (max_comb_len < search_space_min)
+      max_comb_len = search_space_min;
+    // if combination length set, only search that length
+    if (combination_length != 0) {
+      max_comb_len = combination_length;
+      end_length   = combination_length-1;
+    }
+    // the longest prefix searched, and the results found for each combination length
+    int     max_prefix_len  = (max_comb_len > k) ? max_comb_len-k : 0,
+            array_size      = (max_prefix_len > 0) ? max_prefix_len : 1,
+            array[array_size];
+    double  sums[array_size];
+    unsigned long
+            results[max_comb_len+1],
+            totalResults    = 0;
+    // as in queryZeroBoard(), when epsilon is 0 a length whose maximum or minimum sum is the query value has just the one combination, which is counted directly;
+    // otherwise other combinations of that length can be within epsilon as well, so the length is searched like any other
+    bool    uniform[max_comb_len+1];
+    for (int len=0; len<=max_comb_len; ++len) {
+      results[len] = 0;
+      uniform[len] = false;
+      if (len <= k || len <= end_length)
+        continue;
+      if (epsilon == 0 && fabs(len*input_set_max - query_val) <= BOUND_SLACK) {
+        uniform[len] = true;
+        if ((!bounded || uniform_within_multiplicity_bounds(options, n_zeroBased, len)) && (!masked || mask_has_index(options->allowed, n_zeroBased))) {
+          if (print_comb)
+            print_query_uniform_combination(options, output, input_set, n_zeroBased, len);
+          results[len] = 1;
+        }
+      } else if (epsilon == 0 && fabs(len*input_set[0] - query_val) <= BOUND_SLACK) {
+        uniform[len] = true;
+        if ((!bounded || uniform_within_multiplicity_bounds(options, 0, len)) && (!masked || mask_has_index(options->allowed, 0))) {
+          if (print_comb)
+            print_query_uniform_combination(options, output, input_set, 0, len);
+          results[len] = 1;
+        }
+      }
+    }
+    // the query stops early, keeping the results found so far, if it runs out of time or is cancelled
+    query_deadline deadline;
+    start_query_deadline(&deadline, options);
+    int     stopped_length  = 0;
+  // *** End Function Variables ***
+
+  if (print_details) fprintf(output, "Combination length : Num Results\n");
+
+  // *** Begin Iterating Through Search Space ***
+
+  int dim = 0;
+  array[0] = 0;
+  while (max_prefix_len > 0 && dim >= 0) {
+    if (query_should_stop(&deadline)) {
+      stopped_length = max_comb_len;
+      break;
+    }
+    // Every value at this position has been tried, so move back to the previous position
+    if (array[dim] > n_zeroBased) {
+      if (--dim >= 0)
+        ++array[dim];
+      continue;
+    }
+    int    prefix_len = dim+1;
+    double value      = input_set[array[dim]];
+    sums[dim] = ((dim > 0) ? sums[dim-1] : 0.0) + value;
+
+    // The shortest completion is by the zeroboard combination length: if even that passes the query value, so does every later value at this position
+    if (sums[dim] + value*k > hi) {
+      if (--dim >= 0)
+        ++array[dim];
+      continue;
+    }
+    if (masked && !mask_has_index(options->allowed, array[dim])) {
+      ++array[dim];
+      continue;
+    }
+
+    // Complete the prefix from the zeroboard to a combination of length prefix_len + k
+    int curr_comb_len = prefix_len + k;
+    if (curr_comb_len > end_length && !uniform[curr_comb_len] && sums[dim] + input_set_max*k >= lo
+        && (!bounded || bounded_prefix_can_reach(options, input_set, &array[0], prefix_len, k, query_val, epsilon))
+        && (reachability == NULL || reachable_sum(reachability, k, query_val - sums[dim], tolerance))) {
+      double tare_value = (curr_comb_len*input_set_max - query_val) - (prefix_len*input_set_max - sums[dim]);
+      get_stored_length_combinations(input_set, zeroboard, tare_value, scale, k, query_val, epsilon, suffix_sum, &results[curr_comb_len], print_comb, options, &array[0], prefix_len);
+    }
+
+    // Extend the prefix while a longer combination length can still reach the query value
+    if (prefix_len < max_prefix_len
+        && sums[dim] + value*(k+1) <= hi
+        && sums[dim] + input_set_max*(max_comb_len-prefix_len) >= lo) {
+      ++dim;
+      array[dim] = array[dim-1];
+    } else
+      ++array[dim];
+  }
+
+  // Print the results of each combination length above the zeroboard combination length, longest first
+  for (int len=max_comb_len; len>end_length && len>k; --len) {
+    if (len*input_set_max < lo)
+      break;
+    if (print_details) fprintf(output, "\t%d\t\t%lu\n", len, results[len]);
+    totalResults += results[len];
+  }
+
+  // *** END Iterating Through Search Space ***
+
+  // Check the combination lengths stored in the zeroboard, from the zeroboard combination length down to 1
+  for (int len=k; len>=1; --len) {
+    if (len*input_set_max < query_val - epsilon - BOUND_SLACK)
+      break;
+    if (combination_length != 0 && combination_length != len)
+      continue;
+    if (stopped_length != 0 || query_must_stop(&deadline)) {
+      if (stopped_length == 0)
+        stopped_length = len;
+      break;
+    }
+    unsigned long resultsCounter = 0;
+    if (!bounded || bounded_prefix_can_reach(options, input_set, NULL, 0, len, query_val, epsilon))
+      get_stored_length_combinations(input_set, zeroboard, len*input_set_max - query_val, scale, len, query_val, epsilon, select_combination_sum(len), &resultsCounter, print_comb, options);
+    if (print_details) fprintf(output, "\t%d\t\t%lu\n", len, resultsCounter);
+    totalResults += resultsCounter;
+  }
+
+  if (print_details) fprintf(output, "\nTotal results: %lu\n\n", totalResults);
+  report_query_status(&deadline, options, stopped_length, totalResults, print_details);
+}
+
 
 
 /**
@@ -17,17 +364,19 @@
  * @param zeroboard The hash-table data structure that stores combinations summing to a target value
  * @param search_space_comb_len The length of the generalized solution space contained in the zeroboard
  * @param search_space_min The user-defined minimum combination length to be searched
- * @param dp The number of decimal places precision for the target query value
+ * @param dp The bin scale the zeroboard was written with, as set by process_inputs() (0 if epsilon is 0); not a number of decimal places
  * @param query_val The target query value
  * @param epsilon The amount by which the target query value can vary
  * @param combination_length The user-defined value that determines a specific combination length to search; 0 by default searches all lengths
  * @param print_details Reuirement to print details about the algorithm run
  * @param print_comb Requirement to print all combinations summing to the target value
+ * @param options Optional query settings such as per-index multiplicity constraints; NULL for an unconstrained query
+ * @param reachability The table of sums reachable by each combination length; NULL to prune on the minimum and maximum sums only
  */
 void queryZeroBoard(
   double *input_set,
   int n,
-  Board* zeroboard,
+  const Board* zeroboard,
   int search_space_comb_len,
   int search_space_min,
   int dp,
@@ -35,230 +384,256 @@ void queryZeroBoard(
   double epsilon,
   int combination_length,
   int print_details,
-  int print_comb )
+  int print_comb,
+  query_options* options = NULL,
+  const reachability_table* reachability = NULL )
 {
+  // Query values seen before are answered from the result cache; others are searched with the combinations they print recorded, so that they
+  // can be stored. Details describe the search itself, so queries that print them are always searched, as are queries that add their combinations
+  // to a composition aggregator, since a cached result is replayed as printed lines.
+  if (options != NULL && options->memo != NULL && options->ranked == NULL && options->aggregate == NULL && !print_details) {
+    result_key    key = query_result_key(options->memo, input_set, n, search_space_comb_len, search_space_min, dp, query_val, epsilon, combination_length,
+                                         print_comb, options);
+    trace_span    cached_span;
+    unsigned long cached_results;
+    // only a hit ends, and so records, this span; a miss records the span of its search instead
+    begin_trace_span(&cached_span, query_tracer(options), "cached query", "value", query_val);
+    if (lookup_cached_result(options->memo, &key, query_output(options), &cached_results)) {
+      end_trace_span(&cached_span);
+      if (options->status != NULL) {
+        options->status->state          = QUERY_COMPLETE;
+        options->status->stopped_length = 0;
+        options->status->results        = cached_results;
+      }
+      return;
+    }
+    query_options searched = *options;
+    query_status  status;
+    std::vector<uint16_t> printed;
+    searched.memo                 = NULL;
+    searched.status               = &status;
+    searched.printed_combinations = print_comb ? &printed : NULL;
+    queryZeroBoard(input_set, n, zeroboard, search_space_comb_len, search_space_min, dp, query_val, epsilon, combination_length, print_details, print_comb, &searched, reachability);
+    // a query that stopped early has only some of its results, so it is not cached
+    if (status.state == QUERY_COMPLETE)
+      store_cached_result(options->memo, &key, status.results, printed.data(), printed.size());
+    if (options->status != NULL)
+      *options->status = status;
+    return;
+  }
+
+  trace_span query_span;
+  begin_trace_span(&query_span, query_tracer(options), "query", "value", query_val);
+  // bins are checked against the minimums by counting the indexes with a minimum that they cover, so count the indexes that need covering once
+  if (has_multiplicity_bounds(options) && options->required_indexes < 0)
+    count_required_indexes(options);
+
+  // Ranked queries keep only the closest combinations and narrow the search as they are found
+  if (options != NULL && options->ranked != NULL) {
+    queryZeroBoardRanked(input_set, n, zeroboard, search_space_comb_len, search_space_min, dp, query_val, epsilon, combination_length, print_details, print_comb, options, reachability);
+    end_trace_span(&query_span);
+    return;
+  }
+  // Length-incremental queries visit each prefix once for every combination length
+  if (options != NULL && options->length_incremental) {
+    queryZeroBoardIncremental(input_set, n, zeroboard, search_space_comb_len, search_space_min, dp, query_val, epsilon, combination_length, print_details, print_comb, options, reachability);
+    end_trace_span(&query_span);
+    return;
+  }
 
   // ** Function Variables **
-    // if the user specifies the zb size, set it to that size
-    if (search_space_comb_len != 0)
-            search_space_comb_len = search_space_comb_len;
-    int     curr_comb_len   = (int)(query_val/input_set[0]), 
+    int     max_comb_len    = (int)((query_val+epsilon)/input_set[0]),
             n_zeroBased     = n-1,
             end_length      = search_space_comb_len;
     unsigned long 
             resultsCounter  = 0,
             totalResults    = 0;
     double  tare_value      = 0.0,
-            dec_places      = pow(10,dp),
-            input_set_max           = input_set[n_zeroBased],
-            query_val_dp    = query_val*dec_places;
+            scale           = bin_scale(dp),
+            input_set_max   = input_set[n_zeroBased];
+    FILE*   output          = query_output(options);
+    // multiplicity constraints are checked before each zeroboard query so that infeasible parts of the search space are never visited
+    bool    bounded         = has_multiplicity_bounds(options);
+    // queries restricted to a subset of the input set skip prefixes using indexes outside the subset
+    bool    masked          = has_index_mask(options);
+    // suffix sums use the kernel specialised for the zeroboard combination length, chosen once for the whole query
+    combination_sum_kernel suffix_sum = select_combination_sum(search_space_comb_len);
+    // zeroboard queries sum each combination and report only those within epsilon, so the search only allows for epsilon and rounding
+    double  tolerance       = epsilon + BOUND_SLACK;
+    // the query stops early, keeping the results found so far, if it runs out of time or is cancelled
+    query_deadline deadline;
+    start_query_deadline(&deadline, options);
+    int     stopped_length  = 0;
+    // the lookups of each min-finding sweep can be batched so that their cache misses overlap; out-of-core zeroboards are read a bin at a time
+    bool    batched         = options != NULL && options->probe_batch_size > 0 && options->external == NULL;
+    probe_batch batch;
+    if (batched)
+      init_probe_batch(&batch, options->probe_batch_size, options->sort_probes, scale, epsilon, suffix_sum);
     // check for minimum length combination
-    if (curr_comb_len < search_space_min)
-      curr_comb_len = search_space_min; 
+    if (max_comb_len < search_space_min)
+      max_comb_len          = search_space_min; 
     // if combination length set, only search that length
     if (combination_length != 0) {
-      curr_comb_len           = combination_length;
+      max_comb_len          = combination_length;
       end_length            = combination_length-1;
     }
     // tracking arrays
-    int     array_size      = curr_comb_len-search_space_comb_len,
+    // (at least one entry, as the arrays are still passed to the zeroboard queries when only the zeroboard combination lengths are searched)
+    int     array_size      = (max_comb_len > search_space_comb_len) ? max_comb_len-search_space_comb_len : 1,
             array[array_size];
-    double  mins[array_size],
-            maxs[array_size],
-    // set key sequences
-            keySeq[n],
-            keySeqSum[n],
-            keySeqSumFromEnd[n];
-    for (int i=0; i<n; ++i) {
-      if (i == 0) {
-        keySeq[i]     = 0.0;
-        keySeqSum[i]  = 0.0;
-      } else {
-        keySeq[i]     = input_set[i] - input_set[i-1];
-        keySeqSum[i]  = keySeqSum[i-1] + keySeq[i];
-      }
-    }
-    for (int i=0; i<n; ++i) {
-      if (i == 0)
-        keySeqSumFromEnd[i] = 0.0;
-      else
-        keySeqSumFromEnd[i] = keySeqSumFromEnd[i-1] + keySeq[n-i];
-    }
+    double  sums[array_size];
   // *** End Function Variables ***
 
-  if (print_details) printf("Combination length : Num Results\n");
+  if (print_details) fprintf(output, "Combination length : Num Results\n");
 
   // *** Begin Iterating Through Search Space ***
 
-  // iterate through valid combination lengths above minimum
-  while (curr_comb_len > end_length && curr_comb_len*input_set[n_zeroBased] >= query_val) {
-    int     dim      = 0;
-    double  comb_max = curr_comb_len*input_set[n_zeroBased],
-            comb_min = curr_comb_len*input_set[0],
-         comb_max_dp = comb_max*dec_places;
+  // iterate through valid combination lengths above the zeroboard combination length
+  for (int curr_comb_len=max_comb_len; curr_comb_len>end_length && curr_comb_len>search_space_comb_len; --curr_comb_len) {
+    int     prefix_len = curr_comb_len-search_space_comb_len,
+            dim        = 0;
+    double  comb_max   = curr_comb_len*input_set_max,
+            comb_min   = curr_comb_len*input_set[0];
+    // Logic: if combinations of this length cannot reach the query value, shorter combinations cannot either
+    if (comb_max < query_val - tolerance)
+      break;
+    if (query_must_stop(&deadline)) {
+      stopped_length = curr_comb_len;
+      break;
+    }
+    trace_span length_span;
+    begin_trace_span(&length_span, query_tracer(options), "combination length", "length", curr_comb_len);
     
-    // If the maximum value for this combination length == the query value then report/count the combination and move to next combination length
-    if ((long long)comb_max_dp == (long long)query_val_dp) {
-      if (print_comb) {
-        for (int i=0; i<curr_comb_len; ++i)
-          printf("%f ", input_set[n_zeroBased]);
-        printf("\n");
+    // If the maximum value for this combination length is exactly the query value then it is the only combination, so report/count it and move to next combination length
+    if (epsilon == 0 && fabs(comb_max - query_val) <= BOUND_SLACK) {
+      if ((!bounded || uniform_within_multiplicity_bounds(options, n_zeroBased, curr_comb_len)) && (!masked || mask_has_index(options->allowed, n_zeroBased))) {
+        if (print_comb)
+          print_query_uniform_combination(options, output, input_set, n_zeroBased, curr_comb_len);
+        ++resultsCounter;
       }
-      ++resultsCounter;
-
-    // Else if the minimum value for this combination length == the query value then report/count the combination and move to next combination length
-    } else if ((long long)(comb_min*dec_places) == (long long)query_val_dp) {
-      if (print_comb) {
-        for (int i=0; i<curr_comb_len; ++i)
-          printf("%f ", input_set[0]);
-        printf("\n");
+
+    // Else if the minimum value for this combination length is exactly the query value then report/count the combination and move to next combination length
+    } else if (epsilon == 0 && fabs(comb_min - query_val) <= BOUND_SLACK) {
+      if ((!bounded || uniform_within_multiplicity_bounds(options, 0, curr_comb_len)) && (!masked || mask_has_index(options->allowed, 0))) {
+        if (print_comb)
+          print_query_uniform_combination(options, output, input_set, 0, curr_comb_len);
+        ++resultsCounter;
       }
-      ++resultsCounter;
 
-    // Else if the query value lies somewhere between the minimum and maximum values for the current combination length, search for valid combinations
+    // Else search the prefixes of this length, completing each one from the zeroboard
     } else {
-      // set tracking arrays
-      for (int i=0; i<array_size; ++i) {
-        mins[i] = input_set[0]*curr_comb_len;
-        maxs[i] = input_set[0]*(i+1) + input_set[n-1]*(curr_comb_len-(i+1));
-        array[i] = 0;
-      } 
-
-      // Logic: As long as the minimum combination length for this section of search space is less than the query value, continue searching
-      while (mins[0] <= query_val && dim < curr_comb_len-search_space_comb_len) {
-        // Max finding
-        while (dim <= curr_comb_len-search_space_comb_len && array[dim] < n_zeroBased) {
-          // Move up along the max values till the max value is greater than the query value
-          // Logic: As long as the max value of the search space is less than the query value those sections of search space cannot contain valid combinations.
-          //        If it is equal to teh query value, there could be a valid combination there so check the zeroboard and move on.
-          while (maxs[dim] <= query_val && array[dim] < n_zeroBased) {
-            // Check zeroboard if the maxs value is the query value
-            if ((long long)maxs[dim]*(long long)dec_places == (long long)query_val*(long long)dec_places) {
-              int u = 0;
-              double tare_value = 0.0;
-              while (u < curr_comb_len - search_space_comb_len) {
-                tare_value = tare_value - ((input_set_max)-input_set[array[u]]);   // keySeqSumFromEnd[n_zeroBased-array[u]];
-                ++u;
-              }
-              tare_value = (tare_value + (comb_max - query_val));
-              
-              // Check the zeroboard using calculated tare mass
-              get_combinations(input_set, zeroboard, tare_value, &resultsCounter, &array[0], array_size, curr_comb_len-search_space_comb_len-1, print_comb);
-            
-            } // end if, ie. if its not equal, move on to the next combination
-
-            ++array[dim];
-            maxs[dim] = maxs[dim] + (input_set[array[dim]]-input_set[array[dim]-1]);   //keySeq[array[dim]];
-          }
-
-          // Reset the maxs array before moving to the next section of the search space
-          if (dim < curr_comb_len - search_space_comb_len - 1 && array[dim] < n_zeroBased) {
-            ++dim;
-            array[dim] = array[dim-1];
-            maxs[dim] = maxs[dim-1] - (input_set[n_zeroBased]-input_set[array[dim-1]]);    // keySeqSumFromEnd[n_zeroBased - array[dim-1]];
-          } else
-            break;
-        }
-        // Min finding
-        if (array[dim] <= n_zeroBased) {
-          // Reset the mins array for current position in the combination
-          mins[dim] = maxs[dim] - (input_set[n_zeroBased]-input_set[array[dim]])*search_space_comb_len;
-          // Logic: As long as the minimum combination sum for this part of the search space is less than the query value, 
-          //        the search space could contain valid combinations so we must calculate new tare values and check the zeroboard
-          while (mins[dim] <= query_val && array[dim] < n_zeroBased) {
-            // Check zeroboard
-            int u = 0;
-            double tare_value = 0.0;
-            while (u < curr_comb_len - search_space_comb_len) {
-              tare_value -= (input_set_max-input_set[array[u]]);   // keySeqSumFromEnd[n_zeroBased-array[u]];
-              ++u;
-            }
-            tare_value += (comb_max - query_val);
-
-            get_combinations(input_set, zeroboard, tare_value, &resultsCounter, &array[0], array_size, curr_comb_len-search_space_comb_len-1, print_comb);
-            
+      array[0] = 0;
+      while (dim >= 0 && !query_should_stop(&deadline)) {
+        // Every value at this position has been tried, so move back to the previous position, resolving the sweep's lookups before the rest of the tracking array moves on
+        if (array[dim] > n_zeroBased) {
+          if (batched && dim == prefix_len-1)
+            resolve_probe_batch(&batch, input_set, zeroboard, query_val, &resultsCounter, &array[0], prefix_len, search_space_comb_len, print_comb, options);
+          --dim;
+          if (dim >= 0)
             ++array[dim];
-            mins[dim] = mins[dim] + (input_set[array[dim]]-input_set[array[dim]-1])*(search_space_comb_len+1);
-          }
+          continue;
         }
-        // Maintain the combination tracking array
-        while (mins[dim] > query_val && dim > 0) {
-          if (dim > 0) {
-            --dim;
+        // Logic: the remaining values of a combination lie between the current value and the input set maximum, 
+        //        so the current position can only hold combinations summing to between mins and maxs
+        sums[dim] = ((dim > 0) ? sums[dim-1] : 0.0) + input_set[array[dim]];
+        int    remaining = curr_comb_len-(dim+1);
+        double mins      = sums[dim] + input_set[array[dim]]*remaining,
+               maxs      = sums[dim] + input_set_max*remaining;
+
+        // Every later value at this position gives an even larger minimum, or has passed the same index whose minimum multiplicity it does not meet, so move back to the previous position
+        if (mins > query_val + tolerance || (bounded && prefix_misses_minimum(options, &array[0], dim+1))) {
+          if (batched && dim == prefix_len-1)
+            resolve_probe_batch(&batch, input_set, zeroboard, query_val, &resultsCounter, &array[0], prefix_len, search_space_comb_len, print_comb, options);
+          --dim;
+          if (dim >= 0)
             ++array[dim];
-            double temp = 0;
-            int u = 0;
-            while (u < dim) {
-              temp = temp + input_set[array[u]];
-              ++u;
-            }
-            mins[dim] = temp + input_set[array[dim]]*(curr_comb_len-dim);
-          } else if (dim == 0)
-            mins[dim] = comb_min + keySeqSum[array[dim]]*curr_comb_len;
-        }
-        // Reset dimensions of combination tracking array that are less than the current combination length
-        int r = dim+1;
-        while (r < curr_comb_len-search_space_comb_len) {
-          array[r] = array[r-1];
-          ++r;
+
+        // Move along while the maximum for this position cannot reach the query value, the value is not allowed, the multiplicity constraints rule out
+        // every completion of the prefix, or no combination of the remaining length can complete the prefix to it
+        } else if (maxs < query_val - tolerance
+                   || (masked && !mask_has_index(options->allowed, array[dim]))
+                   || (bounded && !bounded_prefix_can_reach(options, input_set, &array[0], dim+1, remaining, query_val, epsilon))
+                   || (reachability != NULL && !reachable_sum(reachability, remaining, query_val - sums[dim], tolerance))) {
+          ++array[dim];
+
+        // The prefix is complete, so check the zeroboard using the calculated tare value
+        } else if (dim == prefix_len-1) {
+          tare_value = (comb_max - query_val) - (prefix_len*input_set_max - sums[dim]);
+          if (batched)
+            add_probe(&batch, tare_value, dim, input_set, zeroboard, query_val, &resultsCounter, &array[0], prefix_len, search_space_comb_len, print_comb, options);
+          else
+            get_stored_length_combinations(input_set, zeroboard, tare_value, scale, search_space_comb_len, query_val, epsilon, suffix_sum, &resultsCounter, print_comb, options, &array[0], prefix_len);
+          ++array[dim];
+
+        // Move to the next position in the prefix
+        } else {
+          ++dim;
+          array[dim] = array[dim-1];
         }
-        ++dim;
-        // Recalculate the maximum combination length for this section of search space
-        maxs[dim] = mins[dim-1] + (input_set[n_zeroBased]-input_set[array[dim]]) * (curr_comb_len-(dim+1));
-      
-      } // end  while (mins[0] <= query_val ...
+      }
+      // A query that stopped part way through a sweep still reports the lookups it has made
+      if (batched)
+        resolve_probe_batch(&batch, input_set, zeroboard, query_val, &resultsCounter, &array[0], prefix_len, search_space_comb_len, print_comb, options);
     } // end if else else block
     
-    if (print_details) printf("\t%d\t\t%lu\n", curr_comb_len, resultsCounter);
+    if (print_details) fprintf(output, "\t%d\t\t%lu\n", curr_comb_len, resultsCounter);
     totalResults = totalResults + resultsCounter;
     resultsCounter = 0;
-    --curr_comb_len;
+    end_trace_span(&length_span);
+    // a query that stopped part way through this length does not go on to the next
+    if (deadline.state != QUERY_COMPLETE) {
+      stopped_length = curr_comb_len;
+      break;
+    }
   }
 
   // *** END Iterating Through Search Space ***
 
-  // Check minimum combination length (the length of combination stored in the zeroboard)
-  if (combination_length == 0) {
-    // Calculate tare_value
-    tare_value = (curr_comb_len*input_set[n_zeroBased] - query_val);
-    // Check if there are combinations summing to the target
-    get_combinations(input_set, zeroboard, tare_value, &resultsCounter, &array[0], array_size, curr_comb_len-search_space_comb_len-1, print_comb);
+  // Check the combination lengths stored in the zeroboard, from the zeroboard combination length down to 1
+  // Each of these reads only the bins around one key: the combination of length 'len' sums to the query value when its key is len*max - query_val
+  for (int len=search_space_comb_len; len>=1; --len) {
+    // Logic: if combinations of this length cannot reach the query value, shorter combinations cannot either
+    if (len*input_set[n_zeroBased] < query_val - epsilon - BOUND_SLACK)
+      break;
+    if (combination_length != 0 && combination_length != len)
+      continue;
+    if (stopped_length != 0 || query_must_stop(&deadline)) {
+      if (stopped_length == 0)
+        stopped_length = len;
+      break;
+    }
+    trace_span length_span;
+    begin_trace_span(&length_span, query_tracer(options), "combination length", "length", len);
+    resultsCounter = 0;
+    tare_value     = len*input_set[n_zeroBased] - query_val;
+    if (!bounded || bounded_prefix_can_reach(options, input_set, NULL, 0, len, query_val, epsilon))
+      get_stored_length_combinations(input_set, zeroboard, tare_value, scale, len, query_val, epsilon, select_combination_sum(len), &resultsCounter, print_comb, options);
     // Print number of combinations summing to target if required
-    if (print_details) printf("\t%d\t\t%lu\n", curr_comb_len, resultsCounter);
-    // Add number of combinations summing to target for final combination length to the total count
-    totalResults += resultsCounter;
-  }
-
-  // If included in minimum combination size, check combination length of 2
-  resultsCounter = 0;
-  if (combination_length==0 && search_space_min==3 || combination_length==2) {
-    for (int i=0; i<n; ++i) // doubly nexted for loop to check for combinations of length 2 summing to the target query value
-      for (int j=i; j<n; ++j)
-        if (input_set[i]+input_set[j]==query_val) {
-          resultsCounter++;
-          if (print_comb) printf("%f %f\n",input_set[i],input_set[j]);
-        }
-    // end doubly nested for loop
-    if (print_details) printf("\t2\t\t%lu\n", resultsCounter);
+    if (print_details) fprintf(output, "\t%d\t\t%lu\n", len, resultsCounter);
     totalResults += resultsCounter;
+    end_trace_span(&length_span);
   }
   
   // If required, end by printing total number of combinations summing to target
-  if (print_details) printf("\nTotal results: %lu\n\n", totalResults);
+  if (print_details) fprintf(output, "\nTotal results: %lu\n\n", totalResults);
+  report_query_status(&deadline, options, stopped_length, totalResults, print_details);
+  if (batched)
+    free_probe_batch(&batch);
+  end_trace_span(&query_span);
 }
 
 
 /**
- * @brief A function to write the contents of a zeroboard, a hash-table based data structure which stores combinations from an input set that sum to the key value of each bin
+ * @brief A function to write all combinations of one length into a zeroboard
  * 
  * @param input_set The input set
  * @param zeroboard The zeroboard to write combinations and sums into
  * @param n The number of items in the input set
- * @param search_space_comb_len The length of the generalized solution space contained in the zeroboard
+ * @param search_space_comb_len The length of the combinations to write
  * @param epsilon The amount by which the query value can vary
  * @param dp The order or magnitude of epsilon; used for creating and querying zeroboard bins
  */
-void writeZeroBoard (
+void writeZeroBoardLength (
   double *input_set,
   Board* zeroboard,
   int n,
@@ -267,6 +642,17 @@ void writeZeroBoard (
   double dp )
 {
 
+  // Combination lengths used in practice have compile-time specialised kernels, see combinationKernels.h
+  switch (search_space_comb_len) {
+    case 1: writeZeroBoardKernel<1>(input_set, zeroboard, n, dp); return;
+    case 2: writeZeroBoardKernel<2>(input_set, zeroboard, n, dp); return;
+    case 3: writeZeroBoardKernel<3>(input_set, zeroboard, n, dp); return;
+    case 4: writeZeroBoardKernel<4>(input_set, zeroboard, n, dp); return;
+    case 5: writeZeroBoardKernel<5>(input_set, zeroboard, n, dp); return;
+    case 6: writeZeroBoardKernel<6>(input_set, zeroboard, n, dp); return;
+    case 7: writeZeroBoardKernel<7>(input_set, zeroboard, n, dp); return;
+  }
+
   // Function Variables: 
   //  Input set size in zero-based counting
   int n_zerobased    = n-1,
@@ -311,8 +697,8 @@ void writeZeroBoard (
             counter = 0;
             // Create new combination set
             int comb_set_size = combination_tracker_len + 2,
-                counter       = 0,
-                *combination  = (int*)malloc(sizeof(int)*comb_set_size);
+                counter       = 0;
+            uint16_t combination[comb_set_size];
             combination[comb_set_size-1] = rowCounter;
             combination[comb_set_size-2] = colCounter;
             // Iterate through the length of the combination and calculate the tare value as well as set the values 
@@ -367,8 +753,8 @@ void writeZeroBoard (
         // Create new combination set
         // Create new combination set
         int comb_set_size = combination_tracker_len + 2,
-           *combination   = (int*)malloc(sizeof(int)*comb_set_size),
             counter       = 0;
+        uint16_t combination[comb_set_size];
         combination[comb_set_size-1] = rowCounter;
         combination[comb_set_size-2] = colCounter;
         
@@ -384,7 +770,41 @@ void writeZeroBoard (
 
   // *** End Writing Zeroboard Hash-Table ***
 
-} // end function writeZeroBoard()
+} // end function writeZeroBoardLength()
+
+
+/**
+ * @brief A function to write the contents of a zeroboard, a hash-table based data structure which stores combinations from an input set that sum to the key value of each bin.
+ * The zeroboard holds every combination length from 1 up to the search space combination length; the length of each combination is stored with it.
+ * 
+ * @param input_set The input set
+ * @param zeroboard The zeroboard to write combinations and sums into
+ * @param n The number of items in the input set
+ * @param search_space_comb_len The length of the generalized solution space contained in the zeroboard
+ * @param epsilon The amount by which the query value can vary
+ * @param dp The order or magnitude of epsilon; used for creating and querying zeroboard bins
+ * @param options The query options, may be NULL; if bulk_load is set, a zeroboard small enough is written by the bulk loader (see bulkLoad.h)
+ */
+void writeZeroBoard (
+  double *input_set,
+  Board* zeroboard,
+  int n,
+  int search_space_comb_len,
+  double epsilon,
+  double dp,
+  query_options* options = NULL )
+{
+  // The bulk loader writes the same lists, but holds every combination in a buffer until the zeroboard is linked, so it is only used when asked
+  // for and while that buffer stays within BULK_LOAD_MAX_BYTES
+  if (options != NULL && options->bulk_load && bulk_load_bytes(n, search_space_comb_len) <= BULK_LOAD_MAX_BYTES) {
+    bulkWriteZeroBoard(input_set, zeroboard, n, search_space_comb_len, dp);
+    return;
+  }
+  // Write the longest combinations first and then each shorter length in turn. New combinations are added to the head of their list, so every
+  // list ends up ordered by combination length from shortest to longest, which get_bin_combinations() relies on
+  for (int len=search_space_comb_len; len>=1; --len)
+    writeZeroBoardLength(input_set, zeroboard, n, len, epsilon, dp);
+}
 
 
 #endif /* SUBSETSUMMER_H */
\ No newline at end of file
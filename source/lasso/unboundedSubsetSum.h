@@ -17,6 +17,10 @@
 
 #include "processInputs.h"
 #include "subsetSummer.h"
+#include "perfCounters.h"
+#include "sampler.h"
+#include "queryCursor.h"
+#include "fixedPoint.h"
 
 
 /**
@@ -30,6 +34,7 @@
  * @param print_comb Require printing of all commbinations summing to the target value 
  * @param print_details Require printing of details about the algorithm run
  * @param print_test_times Require printing of total runtime
+ * @param options Optional query settings, e.g. per-index multiplicity constraints (indexes refer to the sorted input set); NULL for an unconstrained query
  */
 void unboundedSubsetSum(
   double* input_set,
@@ -39,7 +44,8 @@ void unboundedSubsetSum(
   int print_times, 
   int print_comb, 
   int print_details, 
-  int print_test_times) 
+  int print_test_times,
+  query_options* options = NULL) 
 {
   
   if (print_details) printf("\n *** Running Unbounded Subset Sum Algorithm: ***\n\n");
@@ -47,11 +53,20 @@ void unboundedSubsetSum(
   // Timing variables
   clock_t start, finish;
   double time_used_write, time_used_query, time_used_delete, total_time_used = 0;
+  // Hardware counter variables, used when a profile is requested in the options
+  perf_profile* profile = (options != NULL) ? options->profile : NULL;
+  perf_counters counters;
+  long long phase_counts[NUM_PHASES][NUM_PERF_COUNTERS];
+  double    phase_coverage[NUM_PHASES][NUM_PERF_COUNTERS];
+  if (profile != NULL)
+    open_perf_counters(&counters);
+  // The fixed-point engine is used in place of the standard zeroboard when a fixed-point scale is set in the options
+  bool fixed_point = options != NULL && options->fixed_point_scale > 0;
   
   // Assignment of algorithm variables
   int     search_space_comb_len = 0,    // Combination length of the search space
-          search_space_min      = 3,    // Minimum combination length of search space 
-          search_space_max      = 7,    // User setting for the maximum search space combination length; if 0, then automated (a reasonable max is dependent on the size of the input input_set and number of queries to be performed)
+          search_space_min      = SEARCH_SPACE_MIN,    // Minimum combination length of search space 
+          search_space_max      = SEARCH_SPACE_MAX,    // User setting for the maximum search space combination length; if 0, then automated (a reasonable max is dependent on the size of the input input_set and number of queries to be performed)
           combination_length    = 0;    // If specified, algorithm searches that combination length only; if 0, all combination lengths are searched
   double  dp_precision          = 0.0;  // Order of magnitude of epsilon - determines width of bins in zeroboard hash-table
   
@@ -59,10 +74,33 @@ void unboundedSubsetSum(
   process_inputs(input_set, input_set_size, query_value, epsilon, &dp_precision, &search_space_comb_len, search_space_min, search_space_max, dp_precision, combination_length, print_details);
   
   // create the zeroboard
+  if (profile != NULL) start_perf_counters(&counters);
   start              = clock();
+    trace_span build_span;
+    begin_trace_span(&build_span, query_tracer(options), "build", "comb_len", search_space_comb_len);
     Board zeroboard;
-    writeZeroBoard(input_set, &zeroboard, input_set_size, search_space_comb_len, epsilon, dp_precision);
+    FixedBoard fixed_zeroboard;
+    fixed_point_input fixed_input;
+    if (fixed_point) {
+      init_fixed_point_input(&fixed_input, input_set, input_set_size, query_value, epsilon, options->fixed_point_scale);
+      writeFixedZeroBoard(&fixed_input, &fixed_zeroboard, search_space_comb_len);
+    } else
+      writeZeroBoard(input_set, &zeroboard, input_set_size, search_space_comb_len, epsilon, dp_precision, options);
+    // summarise bins so that multiplicity constrained queries can reject whole bins; the fixed-point zeroboard has no summaries
+    if (!fixed_point && has_multiplicity_bounds(options))
+      summarise_multiplicities(&zeroboard, input_set_size);
+    // and so that queries restricted to a subset of the input set can accept or reject whole bins
+    if (!fixed_point && has_index_mask(options))
+      summarise_index_masks(&zeroboard, input_set_size);
+    // tabulate the sums reachable by each combination length so that the query can prune subtrees that cannot reach the query value
+    reachability_cache reachability;
+    init_reachability_cache(&reachability);
+    const reachability_table* reachability_ptr = NULL;
+    if (options != NULL && !fixed_point)
+      reachability_ptr = cached_reachability_table(&reachability, input_set, input_set_size, query_value, epsilon + 1.0/bin_scale(dp_precision), options->reachability_scale);
+    end_trace_span(&build_span);
   finish             = clock();
+  if (profile != NULL) stop_perf_counters(&counters, profile, PHASE_WRITE, phase_counts[PHASE_WRITE], phase_coverage[PHASE_WRITE]);
   time_used_write    = ((double) (finish - start)) / CLOCKS_PER_SEC;
   total_time_used   += time_used_write;
 
@@ -70,16 +108,32 @@ void unboundedSubsetSum(
   // print_zeroboard(&zeroboard);
 
   // query the zeroboard
+  if (profile != NULL) start_perf_counters(&counters);
   start         = clock();
-    queryZeroBoard(input_set, input_set_size, &zeroboard, search_space_comb_len, search_space_min, dp_precision, query_value, epsilon, combination_length, print_details, print_comb);
+    if (fixed_point)
+      queryFixedZeroBoard(input_set, &fixed_input, &fixed_zeroboard, search_space_comb_len, query_value, epsilon, combination_length, print_details, print_comb, options);
+    else
+      queryZeroBoard(input_set, input_set_size, &zeroboard, search_space_comb_len, search_space_min, dp_precision, query_value, epsilon, combination_length, print_details, print_comb, options, reachability_ptr);
   finish        = clock();
+  if (profile != NULL) stop_perf_counters(&counters, profile, PHASE_QUERY, phase_counts[PHASE_QUERY], phase_coverage[PHASE_QUERY]);
   time_used_query = ((double) (finish - start)) / CLOCKS_PER_SEC;
   total_time_used   += time_used_query;
 
   // free heap memory used by the zeroboard
+  if (profile != NULL) start_perf_counters(&counters);
   start         = clock();
-    delete_zeroboard(&zeroboard);
+    if (fixed_point) {
+      delete_fixed_zeroboard(&fixed_zeroboard);
+      free_fixed_point_input(&fixed_input);
+    } else
+      delete_zeroboard(&zeroboard);
+    free_reachability_cache(&reachability);
   finish        = clock();
+  if (profile != NULL) {
+    stop_perf_counters(&counters, profile, PHASE_DELETE, phase_counts[PHASE_DELETE], phase_coverage[PHASE_DELETE]);
+    close_perf_counters(&counters);
+    ++profile->runs;
+  }
   time_used_delete = ((double) (finish - start)) / CLOCKS_PER_SEC;
   total_time_used   += time_used_delete;
 
@@ -89,6 +143,12 @@ void unboundedSubsetSum(
     printf("%f seconds to query zeroboard\n", time_used_query);
     printf("%f seconds to free zeroboard memory\n", time_used_delete);
     printf("%f seconds total\n\n", total_time_used);
+    // print the hardware counters for each phase of this run
+    if (profile != NULL) {
+      for (int phase=0; phase<NUM_PHASES; ++phase)
+        print_phase_counts(phase, phase_counts[phase], phase_coverage[phase]);
+      printf("\n");
+    }
   }
   // print time taken overall
   if (print_test_times) {
@@ -98,4 +158,121 @@ void unboundedSubsetSum(
 
 }
 
+/**
+ * @brief Processes the input parameters and writes a zeroboard for a query, then sets up a cursor at the start of the query's results.
+ * The zeroboard stays in memory until closeQueryCursor() is called, so the results can be pulled from the cursor a page at a time.
+ * 
+ * @param cursor The cursor to set up
+ * @param zeroboard The zeroboard to write
+ * @param input_set The input set: a pointer to the first item in an array of double type values
+ * @param input_set_size The number of items in the input set
+ * @param query_value The target value to which combinations must sum
+ * @param epsilon The value that the target value can vary by
+ * @param options Optional query settings, e.g. per-index multiplicity constraints (indexes refer to the sorted input set); NULL for an unconstrained query
+ */
+void openQueryCursor(
+  query_cursor* cursor,
+  Board* zeroboard,
+  double* input_set,
+  int input_set_size,
+  double query_value,
+  double epsilon,
+  query_options* options = NULL )
+{
+  int     search_space_comb_len = 0;
+  double  dp_precision          = 0.0;
+  // Error check input values and sort input input_set
+  process_inputs(input_set, input_set_size, query_value, epsilon, &dp_precision, &search_space_comb_len, SEARCH_SPACE_MIN, SEARCH_SPACE_MAX, dp_precision, 0, 0);
+  writeZeroBoard(input_set, zeroboard, input_set_size, search_space_comb_len, epsilon, dp_precision, options);
+  if (has_multiplicity_bounds(options))
+    summarise_multiplicities(zeroboard, input_set_size);
+  init_query_cursor(cursor, input_set, input_set_size, zeroboard, search_space_comb_len, dp_precision, query_value, epsilon, 0, options);
+}
+
+/**
+ * @brief Frees the cursor and the zeroboard set up by openQueryCursor()
+ * 
+ * @param cursor The cursor
+ * @param zeroboard The zeroboard
+ */
+void closeQueryCursor(query_cursor* cursor, Board* zeroboard) {
+  free_query_cursor(cursor);
+  delete_zeroboard(zeroboard);
+}
+
+/**
+ * @brief Draws combinations uniformly at random from all combinations summing to the query value, with replacement, without listing every combination.
+ * The number of combinations in each part of the search space is counted once, so the cost of the draws grows with the number of samples rather than the number of combinations.
+ * 
+ * @param input_set The input set: a pointer to the first item in an array of double type values
+ * @param input_set_size The number of items in the input set
+ * @param query_value The target value to which combinations must sum
+ * @param epsilon The value that the target value can vary by
+ * @param num_samples The number of combinations to draw
+ * @param seed The seed for the random number generator
+ * @param scale The resolution at which values and sums are compared, e.g. 1e5 for values with five decimal places; 0 to use the zeroboard bin scale
+ * @param print_times Require printing of the time taken to count the combinations and to draw the samples
+ * @param print_comb Require printing of each sampled combination
+ * @param print_details Require printing of the number of combinations of each length
+ */
+void unboundedSubsetSumSample(
+  double* input_set,
+  int input_set_size,
+  double query_value,
+  double epsilon,
+  int num_samples,
+  unsigned long long seed,
+  double scale,
+  int print_times,
+  int print_comb,
+  int print_details )
+{
+  clock_t start, finish;
+  int     search_space_comb_len = 0;
+  double  dp_precision          = 0.0;
+
+  // Error check input values and sort input input_set
+  process_inputs(input_set, input_set_size, query_value, epsilon, &dp_precision, &search_space_comb_len, SEARCH_SPACE_MIN, SEARCH_SPACE_MAX, dp_precision, 0, print_details);
+  if (scale <= 0.0)
+    scale = bin_scale(dp_precision);
+
+  // count the combinations
+  start = clock();
+    combination_sampler sampler;
+    init_combination_sampler(&sampler, input_set, input_set_size, query_value, epsilon, scale, 0, seed);
+  finish = clock();
+  double time_used_count = ((double) (finish - start)) / CLOCKS_PER_SEC;
+
+  if (print_details) {
+    printf("Combination length : Num Results\n");
+    for (int len=sampler.max_len; len>=1; --len)
+      if (sampler.length_counts[len] > 0.0)
+        printf("\t%d\t\t%.0f\n", len, sampler.length_counts[len]);
+    printf("\nTotal results: %.0f\n\n", sampler.total);
+  }
+
+  // draw the samples
+  start = clock();
+    int* combination = (int*)malloc(sizeof(int)*(sampler.max_len+1));
+    for (int s=0; s<num_samples; ++s) {
+      int len = sample_combination(&sampler, combination);
+      if (len == 0)
+        break;
+      if (print_comb) {
+        for (int i=0; i<len; ++i)
+          printf("%f ", input_set[combination[i]]);
+        printf("\n");
+      }
+    }
+    free(combination);
+  finish = clock();
+  double time_used_draw = ((double) (finish - start)) / CLOCKS_PER_SEC;
+
+  if (print_times) {
+    printf("%f seconds to count combinations\n", time_used_count);
+    printf("%f seconds to draw %d samples\n\n", time_used_draw, num_samples);
+  }
+  free_combination_sampler(&sampler);
+}
+
 #endif /* UNBOUNDEDSUBSETSUM_H */
\ No newline at end of file
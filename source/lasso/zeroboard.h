@@ -9,18 +9,30 @@
 
 #define PRECISION 1e15 
 
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include "multiplicityBounds.h"
+#include "indexMask.h"
+#include "compositionOutput.h"
+#include "resultHeap.h"
+
 /**
  * @brief A struct that holds an array of indexes and is part of a linked list in a hash-table bucket. When those indexes are read as values of the input dataset, combinations stored in this struct will sum to the key of the bucket.
+ * The indexes are stored in place at the end of the struct, so a combination set is a single allocation; see new_combination_set().
+ * The array is declared with one entry, as flexible array members are not standard C++, and sets are allocated with combination_set_size() bytes.
  * 
- * @param combination Pointer to an array of indexes that are associated with specific values in the input dataset
- * @param combination_len Number of indexes stored in combination (i.e. length of the permutation or no. of values making up the query value)
- * @param prev Pointer to the previous combination set in the list
  * @param next Pointer to the next combination set in the list
+ * @param combination_len Number of indexes stored in combination (i.e. length of the permutation or no. of values making up the query value)
+ * @param combination The indexes, in ascending order, that are associated with specific values in the input dataset
  */
 struct combination_set {
-  int* combination;
-  int combination_len;
   combination_set* next;
+  int combination_len;
+  uint16_t combination[1];
 };
 
 /**
@@ -38,15 +50,36 @@ struct combination_set_item {
   combination_set_item* next;
 };
 
+/**
+ * @brief A summary of how many times each input set index appears across the combinations stored in a hash-table bin. 
+ * Only indexes that appear in at least one combination are listed; all other indexes appear zero times.
+ * 
+ * @param len Number of indexes listed in the summary
+ * @param index The listed input set indexes, in ascending order
+ * @param min_count The fewest times each listed index appears in a single combination in the bin
+ * @param max_count The most times each listed index appears in a single combination in the bin
+ */
+struct multiplicity_summary {
+  int len;
+  int* index;
+  unsigned char* min_count;
+  unsigned char* max_count;
+};
+
 /**
  * @brief A struct that holds an array of indexes and is part of a linked list in a hash-table bucket. When those indexes are read as values of the input dataset, combinations stored in this struct will sum to the key of the bucket.
  * 
  * @param head Pointer to the first combination set in the list
  * @param tail Pointer to the last combination set in the list
+ * @param summary Pointer to the multiplicity summary of the bin; NULL until summarise_multiplicities() is run
+ * @param index_masks The input set indexes used by any combination in the bin, followed by those used by every combination in the bin, 
+ *                    as two index masks (see indexMask.h); NULL until summarise_index_masks() is run
  */
 struct combination_set_list {
   combination_set_item* head;
   combination_set_item* tail;
+  multiplicity_summary* summary;
+  uint64_t* index_masks;
 };
 
 
@@ -55,6 +88,44 @@ struct combination_set_list {
 typedef boost::unordered_map< double, combination_set_list* > Board;
 
 
+/**
+ * @brief Calculates the number of bytes a combination set of a given length takes up
+ * 
+ * @param combination_len Number of indexes in the combination
+ * @return size_t: the size of the struct up to its indexes plus the indexes, and never less than the size of the struct itself
+ */
+size_t combination_set_size(int combination_len) {
+  size_t size = offsetof(combination_set, combination) + sizeof(uint16_t)*combination_len;
+  return (size < sizeof(combination_set)) ? sizeof(combination_set) : size;
+}
+
+/**
+ * @brief Allocates a combination set with its indexes stored in place
+ * 
+ * @param combination The combination of input set indexes to copy into the set
+ * @param combination_len Number of indexes in the combination
+ * @return combination_set*: the new set, with next set to NULL
+ */
+combination_set* new_combination_set(const uint16_t* combination, int combination_len) {
+  combination_set* new_set = (combination_set*)malloc(combination_set_size(combination_len));
+  memcpy(new_set->combination, combination, sizeof(uint16_t)*combination_len);
+  new_set->combination_len = combination_len;
+  new_set->next = NULL;
+  return new_set;
+}
+
+/**
+ * @brief Frees the memory used by a multiplicity summary
+ * 
+ * @param summary The summary to free
+ */
+void free_multiplicity_summary(multiplicity_summary* summary) {
+  free(summary->index);
+  free(summary->min_count);
+  free(summary->max_count);
+  free(summary);
+}
+
 /**
  * @brief Calculates which hash-table bin a specified key is associated with
  * 
@@ -66,27 +137,43 @@ double bin_value(double key, double decimal_places) {
   return ceil(key * decimal_places) / decimal_places;
 }
 
+/**
+ * @brief Calculates the scale used to map keys to hash-table bins: bins are 1/scale wide
+ * 
+ * @param decimal_places The number of decimal places that are significant to this query; 0 if epsilon is 0
+ * @return double: the bin scale
+ */
+double bin_scale(double decimal_places) {
+  return decimal_places ? decimal_places : 100.0;
+}
+
+/**
+ * @brief Rounds a key to the precision at which the items of a bin list are told apart
+ * 
+ * @param key The key
+ * @return long long: the key in units of 1/PRECISION, rounded up
+ */
+long long precision_key(double key) {
+  return ceil(key*PRECISION);
+}
+
 /**
  * @brief Inserts a combination set into the zeroboard, associated with a specific key
  * 
  * @param zeroboard The zeroboard to insert the key-value pair into
  * @param key The key for the bucket which is the sum of the combination being inserted
- * @param combination The combination of input set indexes summing to the key
- * @param combination_len 
+ * @param combination The combination of input set indexes summing to the key; it is copied into the zeroboard
+ * @param combination_len Number of indexes in the combination
  */
 void board_insert(
   Board* zeroboard, 
   double key, 
   double decimal_places, 
-  int* combination, 
+  const uint16_t* combination, 
   int combination_len ) 
 {
   // Which bin to put this key/value pair into
-  double bin_val = -1.0;
-  if (decimal_places)
-    bin_val = bin_value(key, decimal_places);
-  else
-    bin_val = ceil(key*100.0)/100.0;
+  double bin_val = bin_value(key, bin_scale(decimal_places));
   // Assert bin key is valid
   if (bin_val==-1.0) {
     printf("ERROR: Bad bin value\n");
@@ -106,11 +193,11 @@ void board_insert(
     // 1a. Assign new and only item as head and tail of bin list from step 1
     new_list->head = new_item;
     new_list->tail = new_item;
+    new_list->summary = NULL;
+    new_list->index_masks = NULL;
     // 3. Allocate memory for new combination set
-    combination_set* new_set = (combination_set*)malloc(sizeof(combination_set));
+    combination_set* new_set = new_combination_set(combination, combination_len);
     // 3a. Assign values to combination set
-    new_set->combination = combination;
-    new_set->combination_len = combination_len;
     new_set->next = NULL;
     // 2a. Insert combination set from step 3 into list from step 2 
     new_item->head = new_set;
@@ -135,10 +222,8 @@ void board_insert(
       // key is less than head key then assign this new key:value pair as new head
       if (key_max_precision < head_max_precision) {
         // Allocate memory for new combination set
-        combination_set* new_set = (combination_set*)malloc(sizeof(combination_set));
+        combination_set* new_set = new_combination_set(combination, combination_len);
         // Assign values to combination set
-        new_set->combination = combination;
-        new_set->combination_len = combination_len;
         new_set->next = NULL;
         // Allocate memory for new commbination set item
         combination_set_item* new_set_item = (combination_set_item*)malloc(sizeof(combination_set_item));
@@ -154,10 +239,8 @@ void board_insert(
       // key from new key:value pair is the same as key in head -> add to list
       } else { // else if (key == set_list->head->key)
         // Allocate memory for new combination set
-        combination_set* new_set = (combination_set*)malloc(sizeof(combination_set));
+        combination_set* new_set = new_combination_set(combination, combination_len);
         // Assign values to combination set
-        new_set->combination = combination;
-        new_set->combination_len = combination_len;
         // Add new_set to head of list
         new_set->next = set_list->head->head;
         set_list->head->head = new_set;
@@ -174,10 +257,8 @@ void board_insert(
       // key is greater than tail key then assign this new key:value pair as new tail
       if (key_max_precision > tail_max_precision) {
         // Allocate memory for new combination set
-        combination_set* new_set = (combination_set*)malloc(sizeof(combination_set));
+        combination_set* new_set = new_combination_set(combination, combination_len);
         // Assign values to combination set
-        new_set->combination = combination;
-        new_set->combination_len = combination_len;
         new_set->next = NULL;
         // Allocate memory for new commbination set item
         combination_set_item* new_set_item = (combination_set_item*)malloc(sizeof(combination_set_item));
@@ -190,16 +271,14 @@ void board_insert(
         set_list->tail = new_set_item;
         return;
       
-      // key from new key:value pair is the same as key in head -> add to list
-      } else { // else if (key == set_list->head->key)
+      // key from new key:value pair is the same as key in tail -> add to list
+      } else { // else if (key == set_list->tail->key)
         // Allocate memory for new combination set
-        combination_set* new_set = (combination_set*)malloc(sizeof(combination_set));
+        combination_set* new_set = new_combination_set(combination, combination_len);
         // Assign values to combination set
-        new_set->combination = combination;
-        new_set->combination_len = combination_len;
-        // Add new_set to head of list
-        new_set->next = set_list->head->head;
-        set_list->head->head = new_set;
+        // Add new_set to head of tail's list
+        new_set->next = set_list->tail->head;
+        set_list->tail->head = new_set;
         return;
 
       }
@@ -214,81 +293,45 @@ void board_insert(
     } else {
       // 1.
       double min = set_list->head->key;
-      double max = set_list->head->key;
+      double max = set_list->tail->key;
+      combination_set_item* item;
       if (key < (min+max)/2.0) {  // start at head of list
         // 2.
-        combination_set_item* item = set_list->head;
-        // Logic: if the key < item->key then we need to insert just before this item because the key is not found
-        while (key<item->key) {
-          // if the key to insert is found, add the combination to this list
-          if (key==item->key) {
-            // 2a.
-            // Allocate memory for new combination set
-            combination_set* new_set = (combination_set*)malloc(sizeof(combination_set));
-            // Assign values to combination set
-            new_set->combination = combination;
-            new_set->combination_len = combination_len;
-            // Make new combination set head of comb_set_item list
-            new_set->next = item->head;
-            item->head = new_set;
-            return;
-          }
+        // Logic: walk forward past every smaller key; the key is larger than the head key and smaller than the tail key, so this stops before the end of the list
+        item = set_list->head;
+        while (precision_key(item->key) < key_max_precision)
           item = item->next;
-        }
-        // 2b. if the key to insert was not found, create new comb_set_item
-        // Allocate memory for new combination set
-        combination_set* new_set = (combination_set*)malloc(sizeof(combination_set));
-        new_set->combination = combination;
-        new_set->combination_len = combination_len;
-        new_set->next = NULL;
-        // Allocate memory for new combination set item
-        combination_set_item* new_set_item = (combination_set_item*)malloc(sizeof(combination_set_item));
-        new_set_item->key = key;
-        new_set_item->head = new_set;
-        new_set_item->next = item;
-        new_set_item->prev = item->prev;
-        // Insert comb_set_item
-        item->prev->next = new_set_item;
-        item->prev = new_set_item;
-        return;
-
       } else {  // start at tail of list
         // 2.
-        combination_set_item* item = set_list->tail;
-        // Logic: if the key > item->key then we need to insert just after this item because the key is not found
-        while (key>item->key) {
-          // if the key to insert is found, add the combination to this list
-          if (key==item->key) {
-            // 2a.
-            // Allocate memory for new combination set
-            combination_set* new_set = (combination_set*)malloc(sizeof(combination_set));
-            // Assign values to combination set
-            new_set->combination = combination;
-            new_set->combination_len = combination_len;
-            // Make new combination set head of comb_set_item list
-            new_set->next = item->head;
-            item->head = new_set;
-            return;
-          }
+        // Logic: walk back past every larger key, then step forward to the first item whose key is not smaller than the key
+        item = set_list->tail;
+        while (precision_key(item->key) > key_max_precision)
+          item = item->prev;
+        if (precision_key(item->key) < key_max_precision)
           item = item->next;
-        }
-        // 2b. if the key to insert was not found, create new comb_set_item
-        // Allocate memory for new combination set
-        combination_set* new_set = (combination_set*)malloc(sizeof(combination_set));
-        new_set->combination = combination;
-        new_set->combination_len = combination_len;
-        new_set->next = NULL;
-        // Allocate memory for new combination set item
-        combination_set_item* new_set_item = (combination_set_item*)malloc(sizeof(combination_set_item));
-        new_set_item->key = key;
-        new_set_item->head = new_set;
-        new_set_item->prev = item->prev;
-        new_set_item->next = item;
-        // Insert comb_set_item
-        item->prev->next = new_set_item;
-        item->prev = new_set_item;
+      }
+      // Allocate memory for new combination set
+      combination_set* new_set = new_combination_set(combination, combination_len);
+      // if the key to insert is found, add the combination to this list
+      if (precision_key(item->key) == key_max_precision) {
+        // 2a.
+        // Make new combination set head of comb_set_item list
+        new_set->next = item->head;
+        item->head = new_set;
         return;
       }
+      // 2b. if the key to insert was not found, insert a new comb_set_item just before the first item with a larger key
+      new_set->next = NULL;
+      // Allocate memory for new combination set item
+      combination_set_item* new_set_item = (combination_set_item*)malloc(sizeof(combination_set_item));
+      new_set_item->key = key;
+      new_set_item->head = new_set;
+      new_set_item->next = item;
+      new_set_item->prev = item->prev;
+      // Insert comb_set_item
+      item->prev->next = new_set_item;
+      item->prev = new_set_item;
+      return;
 
     }
 
@@ -299,123 +342,614 @@ void board_insert(
 
 
 /**
- * @brief A function to directly query the zeroboard hash-table for combinations summing to a target value. If reuired, prints all combinations summing to target
+ * @brief Writes a multiplicity summary for every bin in the zeroboard so that multiplicity constrained queries can reject whole bins without iterating them
+ * 
+ * @param zeroboard The zeroboard to summarise
+ * @param n The number of values in the input set
+ */
+void summarise_multiplicities(Board* zeroboard, int n) {
+  // Scratch arrays shared by all bins; 'stamp' records which bin last touched an index so the arrays never need resetting
+  int *stamp       = (int*)malloc(sizeof(int)*n),
+      *appearances = (int*)malloc(sizeof(int)*n),
+      *min_present = (int*)malloc(sizeof(int)*n),
+      *max_count   = (int*)malloc(sizeof(int)*n),
+      *touched     = (int*)malloc(sizeof(int)*n),
+      bin_id       = 0;
+  for (int i=0; i<n; ++i)
+    stamp[i] = -1;
+
+  // Iterate over each bucket in the zeroboard
+  for (auto bucket : (*zeroboard) ) {
+    if (bucket.second->summary != NULL)
+      free_multiplicity_summary(bucket.second->summary);
+    int num_touched = 0,
+        num_sets    = 0;
+
+    // Iterate over every combination set in the bin
+    combination_set_item* item = bucket.second->head;
+    while (item != NULL) {
+      combination_set* set = item->head;
+      while (set != NULL) {
+        // Combinations are sorted so each index forms a single run
+        for (int i=0; i<set->combination_len; ) {
+          int index = set->combination[i],
+              count = 0;
+          while (i < set->combination_len && set->combination[i] == index) {
+            ++count;
+            ++i;
+          }
+          if (stamp[index] != bin_id) {
+            stamp[index]          = bin_id;
+            appearances[index]    = 0;
+            min_present[index]    = count;
+            max_count[index]      = count;
+            touched[num_touched++] = index;
+          }
+          ++appearances[index];
+          if (count < min_present[index]) min_present[index] = count;
+          if (count > max_count[index])   max_count[index]   = count;
+        }
+        ++num_sets;
+        set = set->next;
+      }
+      item = item->next;
+    }
+
+    // Sort the touched indexes (few per bin) and write the summary
+    for (int i=1; i<num_touched; ++i)
+      for (int j=i; j>0 && touched[j-1] > touched[j]; --j) {
+        int temp     = touched[j];
+        touched[j]   = touched[j-1];
+        touched[j-1] = temp;
+      }
+    multiplicity_summary* summary = (multiplicity_summary*)malloc(sizeof(multiplicity_summary));
+    summary->len       = num_touched;
+    summary->index     = (int*)malloc(sizeof(int)*num_touched);
+    summary->min_count = (unsigned char*)malloc(num_touched);
+    summary->max_count = (unsigned char*)malloc(num_touched);
+    for (int i=0; i<num_touched; ++i) {
+      int index = touched[i];
+      summary->index[i]     = index;
+      // An index missing from any combination in the bin has a minimum of zero
+      summary->min_count[i] = (appearances[index] == num_sets) ? min_present[index] : 0;
+      summary->max_count[i] = max_count[index];
+    }
+    bucket.second->summary = summary;
+    ++bin_id;
+
+  } // end bucket for loop
+
+  free(stamp);
+  free(appearances);
+  free(min_present);
+  free(max_count);
+  free(touched);
+}
+
+
+/**
+ * @brief Writes the index masks of every bin in the zeroboard so that queries restricted to a subset of the input set can accept or reject 
+ * whole bins without checking each combination
+ * 
+ * @param zeroboard The zeroboard to summarise
+ * @param n The number of values in the input set
+ */
+void summarise_index_masks(Board* zeroboard, int n) {
+  int words = index_mask_words(n);
+  uint64_t* used = new_index_mask(n);
+
+  // Iterate over each bucket in the zeroboard
+  for (auto bucket : (*zeroboard) ) {
+    free(bucket.second->index_masks);
+    uint64_t* masks  = (uint64_t*)malloc(sizeof(uint64_t)*2*words);
+    uint64_t* any    = masks;
+    uint64_t* every  = masks + words;
+    bool      first  = true;
+    memset(any, 0, sizeof(uint64_t)*words);
+    memset(every, 0, sizeof(uint64_t)*words);
+
+    // Iterate over every combination set in the bin
+    combination_set_item* item = bucket.second->head;
+    while (item != NULL) {
+      combination_set* set = item->head;
+      while (set != NULL) {
+        memset(used, 0, sizeof(uint64_t)*words);
+        for (int i=0; i<set->combination_len; ++i)
+          set_mask_index(used, set->combination[i]);
+        for (int w=0; w<words; ++w) {
+          any[w]  |= used[w];
+          every[w] = first ? used[w] : (every[w] & used[w]);
+        }
+        first = false;
+        set = set->next;
+      }
+      item = item->next;
+    }
+    bucket.second->index_masks = masks;
+
+  } // end bucket for loop
+
+  free(used);
+}
+
+
+/**
+ * @brief Checks a bin against the allowed index mask of a query, using the bin's index masks if they have been written
+ * 
+ * @param options The query options holding the allowed index mask
+ * @param set_list The bin
+ * @param check_each Set to true if some but not all combinations in the bin may be allowed, so that each combination must be checked
+ * @return false if no combination in the bin is allowed
+ */
+bool bin_within_index_mask(query_options* options, combination_set_list* set_list, bool* check_each) {
+  *check_each = true;
+  if (set_list->index_masks == NULL)
+    return true;
+  int words = index_mask_words(options->input_set_size);
+  const uint64_t* any   = set_list->index_masks;
+  const uint64_t* every = set_list->index_masks + words;
+  bool all_allowed = true;
+  for (int w=0; w<words; ++w) {
+    // An index used by every combination that is not allowed rules out the whole bin
+    if (every[w] & ~options->allowed[w])
+      return false;
+    if (any[w] & ~options->allowed[w])
+      all_allowed = false;
+  }
+  *check_each = !all_allowed;
+  return true;
+}
+
+
+/**
+ * @brief Checks whether any combination in a bin could satisfy the multiplicity constraints once joined to a prefix, using the bin's multiplicity summary.
+ * Only the indexes used by the prefix or listed in the summary are visited; every other index appears zero times, which only matters if it has a minimum.
+ * 
+ * @param options The query options holding the multiplicity constraints
+ * @param summary The multiplicity summary of the bin
+ * @param prefix The sorted prefix
+ * @param prefix_len The number of indexes in the prefix
+ * @return false if no combination in the bin can satisfy the constraints
+ */
+bool bin_within_multiplicity_bounds(
+  query_options* options, 
+  multiplicity_summary* summary, 
+  int* prefix,
+  int prefix_len ) 
+{
+  int *min_mult = options->min_multiplicity,
+      *max_mult = options->max_multiplicity,
+      covered   = 0,    // The number of indexes with a minimum that the walk has visited
+      i         = 0,
+      listed    = 0;
+
+  // Walk the runs of the prefix and the summary's indexes together, both being sorted
+  while (i < prefix_len || listed < summary->len) {
+    int index = (i < prefix_len) ? prefix[i] : summary->index[listed];
+    if (listed < summary->len && summary->index[listed] < index)
+      index = summary->index[listed];
+    int prefix_count = 0,
+        fewest       = 0,
+        most         = 0;
+    while (i < prefix_len && prefix[i] == index) {
+      ++prefix_count;
+      ++i;
+    }
+    if (listed < summary->len && summary->index[listed] == index) {
+      fewest = summary->min_count[listed];
+      most   = summary->max_count[listed];
+      ++listed;
+    }
+    if (max_mult != NULL && max_mult[index] >= 0 && prefix_count + fewest > max_mult[index])
+      return false;
+    if (min_mult != NULL && min_mult[index] > 0) {
+      if (prefix_count + most < min_mult[index])
+        return false;
+      ++covered;
+    }
+  }
+  // An index with a minimum that neither the prefix nor any combination in the bin uses cannot meet it
+  return min_mult == NULL || options->required_indexes < 0 || covered == options->required_indexes;
+}
+
+
+/**
+ * @brief The ranked version of get_stored_length_combinations(). Queries every bin overlapping the tolerance window around the tare value and offers each valid combination 
+ * to the result heap, which narrows the window as it fills.
  * 
  * @param input_set The input dataset
  * @param zeroboard The zeroboard to query for combinations summing to the tare_value
  * @param tare_value Rectified value to query for existence of in the zeroboard
- * @param num_results The counter maintaining the number of combinations summing to the target query value
- * @param array The array maintaining the combination being tracked in query_zeroboard()
- * @param array_size Size of the array maintaining the combination in query_zeroboard()
- * @param combin_len Length of combination to include from the 'array'
- * @param print_comb Require printing of all combinations summing to target value
+ * @param scale The bin scale the zeroboard was written with, see bin_scale()
+ * @param array The array maintaining the combination being tracked in the query
+ * @param prefix_len Number of indexes to include from the 'array'
+ * @param suffix_len Length of the zeroboard combinations to include
+ * @param query_val The target query value
+ * @param epsilon The amount by which the target query value can vary
+ * @param suffix_sum The kernel that sums a combination stored in the zeroboard; NULL to sum with a general loop
+ * @param options The query options holding the result heap and any multiplicity constraints
  */
-void get_combinations(
+void get_ranked_combinations(
   double* input_set,
-  Board* zeroboard,
+  const Board* zeroboard,
   double tare_value,
-  unsigned long* num_results,
+  double scale,
   int* array,
-  int array_size,
-  int combin_len,
-  int print_comb )
+  int prefix_len,
+  int suffix_len,
+  double query_val,
+  double epsilon,
+  double (*suffix_sum)(const double*, const uint16_t*),
+  query_options* options )
 {
-  
-  if (print_comb) {
-    // Using count has the same runtime complexity as the contains function from the C++20 std, except that count is included in C++11
-    // Runtime complexity is constant on average with worst case being linear in the size of the container
-    if (zeroboard->count(tare_value) != 0) {
-      
-      if (combin_len == -1) { // this means that the 'array' indexes should not be included
-        // Iterate over items in bin
-        combination_set_item* item = (*zeroboard)[tare_value]->head;
-        while (item != NULL) {
-          // Iterate over combination sets in item
-          combination_set* set = item->head;
-          while (set != NULL) {
-              for (int i=0; i<set->combination_len; ++i)
-                printf("%f ", input_set[set->combination[i]]);
-              printf("\n");
-              // Increment results counter for this combination set
-              ++(*num_results);
-              // Move to next combination set
-              set = set->next;
-          }
-          // Move to next item in bin
-          item = item->next;
-        }
+  result_heap* heap = options->ranked;
+  bool bounded      = has_multiplicity_bounds(options),
+       masked       = has_index_mask(options);
+  double window     = result_heap_window(heap, epsilon),
+         prefix_sum = 0.0;
+  for (int i=0; i<prefix_len; ++i)
+    prefix_sum += input_set[array[i]];
 
-      } else { // else if (combin_len !- -1) which means that we are above the combination length of the zeroboard, so we need to include the 'array' indexes 
-        // Iterate over items in bin
-        combination_set_item* item = (*zeroboard)[tare_value]->head;
-        while (item != NULL) {
-          // Iterate over combination sets in item
-          combination_set* set = item->head;
-          while (set != NULL) {
-            if (set->combination[0] >= array[combin_len]) {
-              for (int i=0; i<combin_len+1; ++i)
-                printf("%f ", input_set[array[i]]);
-              for (int i=0; i<set->combination_len; ++i)
-                printf("%f ", input_set[set->combination[i]]);
-              printf("\n");
-              // Increment results counter for this combination set
-              ++(*num_results);
-              // Move to next combination set
-              set = set->next;
-            } else break; // if the commbination is not valid, exit the loop
-          }
-          // Move to next item in bin
-          item = item->next;
+  // Iterate over the bins that keys within the window can be stored in
+  long long first_bin = (long long)ceil((tare_value - window - BOUND_SLACK)*scale),
+            last_bin  = (long long)ceil((tare_value + window + BOUND_SLACK)*scale);
+  for (long long bin=first_bin; bin<=last_bin; ++bin) {
+    Board::const_iterator bucket = zeroboard->find(bin/scale);
+    if (bucket == zeroboard->end())
+      continue;
+    bool check_mask = masked;
+    if (masked && !bin_within_index_mask(options, bucket->second, &check_mask))
+      continue;
+    combination_set_item* item = bucket->second->head;
+    while (item != NULL) {
+      combination_set* set = item->head;
+      while (set != NULL) {
+        // Lists are ordered from shortest to longest combination: skip shorter combinations and stop at longer ones
+        if (set->combination_len < suffix_len) {
+          set = set->next;
+          continue;
         }
+        if (set->combination_len > suffix_len || (prefix_len > 0 && set->combination[0] < array[prefix_len-1]))
+          break; // if the commbination is not valid, exit the loop
+        // Sum the combination directly so that the error does not depend on the bin or item key
+        double sum = prefix_sum;
+        if (suffix_sum != NULL)
+          sum += suffix_sum(input_set, set->combination);
+        else
+          for (int i=0; i<set->combination_len; ++i)
+            sum += input_set[set->combination[i]];
+        double error = fabs(sum - query_val);
+        if (error <= window + BOUND_SLACK
+            && (!check_mask || combination_within_index_mask(options, set->combination, set->combination_len))
+            && (!bounded || within_multiplicity_bounds(options, array, prefix_len, set->combination, set->combination_len))
+            && result_heap_offer(heap, error, sum, array, prefix_len, set->combination, set->combination_len))
+          window = result_heap_window(heap, epsilon);
+        set = set->next;
+      }
+      item = item->next;
+    }
+  }
+}
 
-      } // end if else block (combin_len == -1)
 
-    } // end if (zeroboard->count(tare_value) != 0)
+// The number of records in each block of the index of an out-of-core zeroboard
+#define EXTERNAL_INDEX_RECORDS 256
 
-  // else if printing results is not required, repeat the above block without printing all combinations to the terminal
-  } else {
-    if (zeroboard->count(tare_value) != 0) {
-      
-      if (combin_len == -1) {
-        // Iterate over items in bin
-        combination_set_item* item = (*zeroboard)[tare_value]->head;
-        while (item != NULL) {
-          // Iterate over combination sets in item
-          combination_set* set = item->head;
-          while (set != NULL) {
-              // Increment results counter for this combination set
-              ++(*num_results);
-              // Move to next combination set
-              set = set->next;
-          }
-          // Move to next item in bin
-          item = item->next;
-        }
+/**
+ * @brief An entry of the index of an out-of-core zeroboard: the key of the first record of one block of EXTERNAL_INDEX_RECORDS records
+ *
+ * @param bin The bin of the first record of the block
+ * @param len The combination length of the first record of the block
+ */
+struct external_index_entry {
+  double bin;
+  int    len;
+};
 
-      } else { // else if (combin_len !- -1)
-        // Iterate over items in bin
-        combination_set_item* item = (*zeroboard)[tare_value]->head;
-        while (item != NULL) {
-          // Iterate over combination sets in item
-          combination_set* set = item->head;
-          while (set != NULL) {
-            if (set->combination[0] >= array[combin_len]) {
-              // Increment results counter for this combination set
-              ++(*num_results);
-              // Move to next combination set
-              set = set->next;
-            } else break; // if the commbination is not valid, exit the loop
-          }
-          // Move to next item in bin
-          item = item->next;
-        }
-        
-      } // end if else block (combin_len == -1)
+/**
+ * @brief A zeroboard held on disk rather than in memory, written by writeExternalZeroBoard() (see externalBoard.h). The board file holds one
+ * fixed-size record per combination: its bin, its length and its indexes. Records are ordered by bin, then from the shortest combination to the
+ * longest, then from the largest first index to the smallest, which is the order in which get_bin_combinations() reads an in-memory bin.
+ * Bins are found through a sparse index held in memory, with one entry per block of records, and a binary search of the block. The board file
+ * is mapped read-only, so the bins in use stay in the page cache rather than in the memory of the process.
+ *
+ * @param file The board file
+ * @param records The board file, mapped into memory; NULL if it has no records
+ * @param search_space_comb_len The zeroboard combination length
+ * @param record_size The size of each record in bytes
+ * @param num_records The number of records in the board file
+ * @param index The index, one entry per block of EXTERNAL_INDEX_RECORDS records, in board file order
+ * @param index_len The number of index entries
+ * @param num_runs The number of sorted runs written to build the board file
+ */
+struct external_board {
+  FILE*  file;
+  const char* records;
+  int    search_space_comb_len;
+  size_t record_size;
+  unsigned long num_records;
+  external_index_entry* index;
+  unsigned long index_len;
+  int    num_runs;
+};
+
+/**
+ * @brief Reads the bin of an out-of-core zeroboard record
+ *
+ * @param record The record
+ * @return double: the bin
+ */
+double external_record_bin(const char* record) {
+  double bin;
+  memcpy(&bin, record, sizeof(double));
+  return bin;
+}
+
+/**
+ * @brief Orders the key of an out-of-core zeroboard record, its bin and combination length, against a bin and combination length
+ *
+ * @param record The record
+ * @param bin The bin
+ * @param len The combination length
+ * @return int: negative if the record comes before the bin and length, 0 if it has them, positive if it comes after
+ */
+int compare_external_key(const char* record, double bin, int len) {
+  double   record_bin = external_record_bin(record);
+  uint16_t record_len;
+  memcpy(&record_len, record + sizeof(double), sizeof(uint16_t));
+  if (record_bin != bin)
+    return (record_bin < bin) ? -1 : 1;
+  return (int)record_len - len;
+}
+
+/**
+ * @brief Lays out the part of a bin of an out-of-core zeroboard that a probe can use, in the same form as a bin of an in-memory zeroboard.
+ * A probe only reads combinations of one length whose first index is at least the last index of its prefix, and these come first among the
+ * combinations of that length, so the rest of the bin is not laid out. Each thread lays bins out in its own buffers, so several threads
+ * can read one board; the bin is valid until the thread reads the next one.
+ *
+ * @param board The out-of-core zeroboard
+ * @param tare_value The bin to read
+ * @param suffix_len The length of the combinations to read
+ * @param first_index The smallest first index of the combinations to read; 0 if the probe has no prefix
+ * @return combination_set_list*: the part of the bin, or NULL if the board has no such combinations
+ */
+combination_set_list* find_external_bin(external_board* board, double tare_value, int suffix_len, int first_index) {
+  static thread_local std::vector<char> sets;
+  static thread_local combination_set_item item;
+  static thread_local combination_set_list list;
+
+  // Find the first block that starts at or after the combinations wanted; they begin in the block before it, or at its start
+  unsigned long first = 0,
+                last  = board->index_len;
+  while (first < last) {
+    unsigned long mid = (first + last) / 2;
+    if (board->index[mid].bin < tare_value || (board->index[mid].bin == tare_value && board->index[mid].len < suffix_len))
+      first = mid+1;
+    else
+      last = mid;
+  }
+  if (first == 0 && (board->index_len == 0 || board->index[0].bin != tare_value || board->index[0].len != suffix_len))
+    return NULL;
+
+  // Find the first of the combinations wanted by binary search from the start of that block to the start of the next
+  size_t        record_size = board->record_size;
+  unsigned long low         = (first == 0) ? 0 : (first-1)*EXTERNAL_INDEX_RECORDS,
+                high        = std::min(first*EXTERNAL_INDEX_RECORDS, board->num_records);
+  while (low < high) {
+    unsigned long mid = (low + high) / 2;
+    if (compare_external_key(board->records + mid*record_size, tare_value, suffix_len) < 0)
+      low = mid+1;
+    else
+      high = mid;
+  }
+
+  // Count the combinations in order until the first of another bin or length, or whose first index is below the one wanted
+  const char*   start = board->records + low*record_size;
+  unsigned long found = 0;
+  for (unsigned long record=low; record<board->num_records; ++record, ++found) {
+    const char* next = board->records + record*record_size;
+    uint16_t    first;
+    memcpy(&first, next + sizeof(double) + sizeof(uint16_t), sizeof(uint16_t));
+    if (compare_external_key(next, tare_value, suffix_len) != 0 || first < first_index)
+      break;
+  }
+  if (found == 0)
+    return NULL;
 
-    } // end if (zeroboard->count(tare_value) != 0)
+  // Lay the combinations out as a list of combination sets, in record order, under a single item
+  size_t set_size = (combination_set_size(board->search_space_comb_len) + sizeof(combination_set*)-1)
+                  / sizeof(combination_set*) * sizeof(combination_set*);
+  sets.resize(found*set_size);
+  for (unsigned long i=0; i<found; ++i) {
+    const char*      next = start + i*record_size;
+    combination_set* set  = (combination_set*)(sets.data() + i*set_size);
+    uint16_t         len;
+    memcpy(&len, next + sizeof(double), sizeof(uint16_t));
+    set->combination_len = len;
+    memcpy(set->combination, next + sizeof(double) + sizeof(uint16_t), sizeof(uint16_t)*len);
+    set->next = (i+1 < found) ? (combination_set*)(sets.data() + (i+1)*set_size) : NULL;
+  }
+  item.prev = NULL;
+  item.next = NULL;
+  item.key  = tare_value;
+  item.head = (combination_set*)sets.data();
+  list.head        = &item;
+  list.tail        = &item;
+  list.summary     = NULL;
+  list.index_masks = NULL;
+  return &list;
+}
 
-  } // end if else printing results is/is-not required
 
+/**
+ * @brief Reads the combinations of one length in one zeroboard bin that complete a prefix to within epsilon of the query value. A bin also holds keys
+ * just outside epsilon of the probed tare value, so each combination is summed and reported only if it is within epsilon. If reuired, prints them.
+ * 
+ * @param input_set The input dataset
+ * @param set_list The bin to read, found in the zeroboard
+ * @param len The combination length to read; the zeroboard holds every length up to its search space combination length
+ * @param prefix_sum The sum of the prefix's values
+ * @param query_val The target query value
+ * @param epsilon The amount by which the target query value can vary
+ * @param suffix_sum The kernel that sums a combination of this length, see select_combination_sum(); NULL to sum with a general loop
+ * @param num_results The counter maintaining the number of combinations summing to the target query value
+ * @param print_comb Require printing of all combinations summing to target value
+ * @param options The query options; NULL for an unconstrained query
+ * @param prefix The input set indexes that come before each stored combination, in ascending order; only combinations starting at or after the
+ *               last of them are read. NULL for no prefix
+ * @param prefix_len The number of indexes in the prefix
+ */
+void get_bin_combinations(
+  double* input_set,
+  combination_set_list* set_list,
+  int len,
+  double prefix_sum,
+  double query_val,
+  double epsilon,
+  double (*suffix_sum)(const double*, const uint16_t*),
+  unsigned long* num_results,
+  int print_comb,
+  query_options* options,
+  int* prefix,
+  int prefix_len )
+{
+  bool bounded = has_multiplicity_bounds(options),
+       masked  = has_index_mask(options);
+  int  first   = (prefix_len > 0) ? prefix[prefix_len-1] : 0;
+
+  // Reject the bin outright if its index masks show that every combination in it uses an index that is not allowed
+  if (masked && !bin_within_index_mask(options, set_list, &masked))
+    return;
+  // Reject the bin outright if its summary shows that no combination in it can satisfy the constraints
+  if (bounded && set_list->summary != NULL && !bin_within_multiplicity_bounds(options, set_list->summary, prefix, prefix_len))
+    return;
+
+  // Iterate over items in bin
+  combination_set_item* item = set_list->head;
+  while (item != NULL) {
+    // Iterate over combination sets in item
+    combination_set* set = item->head;
+    while (set != NULL) {
+      // Lists are ordered from shortest to longest combination: skip shorter combinations and stop at longer ones
+      if (set->combination_len < len) {
+        set = set->next;
+        continue;
+      }
+      // Combinations of a length are stored with their first index descending, so the rest of the item cannot follow the prefix
+      if (set->combination_len > len || set->combination[0] < first)
+        break;
+      double sum = prefix_sum;
+      if (suffix_sum != NULL)
+        sum += suffix_sum(input_set, set->combination);
+      else
+        for (int i=0; i<len; ++i)
+          sum += input_set[set->combination[i]];
+      if (fabs(sum - query_val) <= epsilon + BOUND_SLACK
+          && (!masked || combination_within_index_mask(options, set->combination, len))
+          && (!bounded || within_multiplicity_bounds(options, prefix, prefix_len, set->combination, len))) {
+        if (print_comb)
+          print_query_combination(options, query_output(options), input_set, prefix, prefix_len, set->combination, len);
+        // Increment results counter for this combination set
+        ++(*num_results);
+      }
+      // Move to next combination set
+      set = set->next;
+    }
+    // Move to next item in bin
+    item = item->next;
+  }
+}
+
+
+/**
+ * @brief Queries the zeroboard for the combinations of one stored length whose sum, with an optional prefix, is within epsilon of the query value.
+ * Every bin that a key within epsilon of the tare value can be stored in is read, and each combination of that length is summed and reported only
+ * if it is within epsilon, as get_ranked_combinations() does, so a bin holding sums just outside the tolerance reports none of them.
+ * 
+ * @param input_set The input dataset
+ * @param zeroboard The zeroboard to query; an out-of-core zeroboard set in the options is read instead
+ * @param tare_value The key of a combination of this length that completes the prefix to exactly the query value, i.e. len*max - (query_val - prefix sum)
+ * @param scale The bin scale the zeroboard was written with, see bin_scale()
+ * @param len The combination length, at most the zeroboard combination length
+ * @param query_val The target query value
+ * @param epsilon The amount by which the target query value can vary
+ * @param suffix_sum The kernel that sums a combination of this length, see select_combination_sum(); NULL to sum with a general loop
+ * @param num_results The counter maintaining the number of combinations summing to the target query value
+ * @param print_comb Require printing of all combinations summing to target value
+ * @param options The query options; NULL for an unconstrained query
+ * @param prefix The input set indexes that come before each stored combination, in ascending order; only combinations starting at or after the
+ *               last of them are read. The caller checks the prefix against any index mask. NULL for no prefix
+ * @param prefix_len The number of indexes in the prefix
+ */
+void get_stored_length_combinations(
+  double* input_set,
+  const Board* zeroboard,
+  double tare_value,
+  double scale,
+  int len,
+  double query_val,
+  double epsilon,
+  double (*suffix_sum)(const double*, const uint16_t*),
+  unsigned long* num_results,
+  int print_comb,
+  query_options* options,
+  int* prefix = NULL,
+  int prefix_len = 0 )
+{
+  bool   external   = options != NULL && options->external != NULL;
+  int    first      = (prefix_len > 0) ? prefix[prefix_len-1] : 0;
+  double prefix_sum = 0.0;
+  for (int i=0; i<prefix_len; ++i)
+    prefix_sum += input_set[prefix[i]];
+
+  // Iterate over the bins that keys within epsilon can be stored in
+  long long first_bin = (long long)ceil((tare_value - epsilon - BOUND_SLACK)*scale),
+            last_bin  = (long long)ceil((tare_value + epsilon + BOUND_SLACK)*scale);
+  for (long long bin=first_bin; bin<=last_bin; ++bin) {
+    // Out-of-core zeroboards are read from disk rather than from the in-memory zeroboard
+    if (external) {
+      combination_set_list* set_list = find_external_bin(options->external, bin/scale, len, first);
+      if (set_list != NULL)
+        get_bin_combinations(input_set, set_list, len, prefix_sum, query_val, epsilon, suffix_sum, num_results, print_comb, options, prefix, prefix_len);
+      continue;
+    }
+    // A single find looks the bin up without operator[], which could insert, so the zeroboard is only ever read and can be shared by query threads
+    Board::const_iterator bucket = zeroboard->find(bin/scale);
+    if (bucket != zeroboard->end())
+      get_bin_combinations(input_set, bucket->second, len, prefix_sum, query_val, epsilon, suffix_sum, num_results, print_comb, options, prefix, prefix_len);
+  }
+}
+
+
+/**
+ * @brief Estimates the memory used by a zeroboard: its hash-table and everything allocated for its bins
+ * 
+ * @param zeroboard The zeroboard
+ * @param n The number of values in the input set the zeroboard was written for
+ * @return size_t: the estimated number of bytes
+ */
+size_t zeroboard_bytes(Board* zeroboard, int n) {
+  // Each hash-table entry is a node holding the key, the list pointer and a link to the next node
+  size_t bytes = zeroboard->bucket_count()*sizeof(void*)
+               + zeroboard->size()*(sizeof(Board::value_type) + sizeof(void*) + sizeof(combination_set_list));
+  for (auto bucket : (*zeroboard) ) {
+    if (bucket.second->summary != NULL)
+      bytes += sizeof(multiplicity_summary) + bucket.second->summary->len*(sizeof(int) + 2);
+    if (bucket.second->index_masks != NULL)
+      bytes += sizeof(uint64_t)*2*index_mask_words(n);
+    combination_set_item* item = bucket.second->head;
+    while (item != NULL) {
+      bytes += sizeof(combination_set_item);
+      combination_set* set = item->head;
+      while (set != NULL) {
+        bytes += combination_set_size(set->combination_len);
+        set = set->next;
+      }
+      item = item->next;
+    }
+  }
+  return bytes;
 }
 
 
@@ -450,7 +984,10 @@ void delete_zeroboard(Board* zeroboard) {
 
     } // end while item!=NULL loop
     
-    // 3. free combination_set_list
+    // 3. free the multiplicity summary and index masks if they were written, then the combination_set_list
+    if (bucket.second->summary != NULL)
+      free_multiplicity_summary(bucket.second->summary);
+    free(bucket.second->index_masks);
     free(bucket.second);
 
   } // end bucket for loop
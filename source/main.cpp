@@ -1,8 +1,17 @@
 #include <iostream>
+#include <string.h>
 
 #include "lasso/unboundedSubsetSum.h"
+#include "lasso/differentialTest.h"
 
-int main() {
+int main(int argc, char** argv) {
+
+  // uss --differential [trials] [seed]: check every mode of the engine against the brute-force reference and the standard engine on random queries
+  if (argc > 1 && strcmp(argv[1], "--differential") == 0) {
+    int           trials = (argc > 2) ? atoi(argv[2]) : 100;
+    unsigned long seed   = (argc > 3) ? strtoul(argv[3], NULL, 10) : 1;
+    return differentialTest(trials, seed, P_tmpdir, stdout) ? EXIT_FAILURE : EXIT_SUCCESS;
+  }
 
   double input_set[] = {
     // 1.3, 2.2, 3.1